@@ -0,0 +1,347 @@
+#include "ld.h"
+
+// libraries are mapped by the kernel (uselib) and only relocated here, only DT_HASH is supported.
+// Nothing that needs relocation is touched before the loader relocates itself
+#define __NR_exit 1
+#define __NR_write 4
+#define __NR_uselib 86
+
+extern Elf32_Dyn _DYNAMIC[];
+void _dl_runtime_resolve();
+
+static struct dso objects[LD_MAX_OBJECTS];
+static uint32_t nr_objects;
+
+static int32_t ld_syscall(uint32_t nr, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+  int32_t ret;
+  __asm__ __volatile__("int $0x80"
+                       : "=a"(ret)
+                       : "0"(nr), "b"(arg1), "c"(arg2), "d"(arg3)
+                       : "memory");
+  return ret;
+}
+
+// compiler can emit calls to them
+void *memcpy(void *dest, const void *src, uint32_t n) {
+  char *d = dest;
+  const char *s = src;
+  while (n--)
+    *d++ = *s++;
+  return dest;
+}
+
+void *memset(void *s, int c, uint32_t n) {
+  char *p = s;
+  while (n--)
+    *p++ = c;
+  return s;
+}
+
+static uint32_t ld_strlen(const char *s) {
+  uint32_t len = 0;
+  while (s[len])
+    len++;
+  return len;
+}
+
+static int ld_strcmp(const char *s1, const char *s2) {
+  while (*s1 && *s1 == *s2) {
+    s1++;
+    s2++;
+  }
+  return *(unsigned char *)s1 - *(unsigned char *)s2;
+}
+
+static void ld_puts(const char *s) {
+  ld_syscall(__NR_write, 2, (uint32_t)s, ld_strlen(s));
+}
+
+static void ld_fail(const char *msg, const char *name) {
+  ld_puts("ld.so: ");
+  ld_puts(msg);
+  ld_puts(name);
+  ld_puts("\n");
+  ld_syscall(__NR_exit, 127, 0, 0);
+}
+
+static void ld_relocate_self(uint32_t base) {
+  Elf32_Rel *rel = 0;
+  uint32_t relsz = 0;
+
+  for (Elf32_Dyn *dyn = _DYNAMIC; dyn->d_tag != DT_NULL; ++dyn) {
+    if (dyn->d_tag == DT_REL)
+      rel = (Elf32_Rel *)(base + dyn->d_val);
+    else if (dyn->d_tag == DT_RELSZ)
+      relsz = dyn->d_val;
+  }
+
+  for (uint32_t i = 0; i < relsz / sizeof(Elf32_Rel); ++i) {
+    if (ELF32_R_TYPE(rel[i].r_info) == R_386_RELATIVE)
+      *(uint32_t *)(base + rel[i].r_offset) += base;
+  }
+}
+
+static void ld_init_object(struct dso *dso, const char *name, uint32_t base, Elf32_Dyn *dynamic) {
+  dso->name = name;
+  dso->base = base;
+  dso->dynamic = dynamic;
+
+  for (Elf32_Dyn *dyn = dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+    uint32_t addr = base + dyn->d_val;
+
+    switch (dyn->d_tag) {
+    case DT_HASH:
+      dso->hash = (uint32_t *)addr;
+      break;
+    case DT_SYMTAB:
+      dso->symtab = (Elf32_Sym *)addr;
+      break;
+    case DT_STRTAB:
+      dso->strtab = (const char *)addr;
+      break;
+    case DT_REL:
+      dso->rel = (Elf32_Rel *)addr;
+      break;
+    case DT_RELSZ:
+      dso->relsz = dyn->d_val;
+      break;
+    case DT_JMPREL:
+      dso->jmprel = (Elf32_Rel *)addr;
+      break;
+    case DT_PLTRELSZ:
+      dso->pltrelsz = dyn->d_val;
+      break;
+    case DT_PLTGOT:
+      dso->pltgot = (uint32_t *)addr;
+      break;
+    case DT_INIT:
+      dso->init = addr;
+      break;
+    case DT_INIT_ARRAY:
+      dso->init_array = (uint32_t *)addr;
+      break;
+    case DT_INIT_ARRAYSZ:
+      dso->init_arraysz = dyn->d_val;
+      break;
+    case DT_BIND_NOW:
+      dso->bind_now = 1;
+      break;
+    case DT_FLAGS:
+      dso->bind_now |= (dyn->d_val & DF_BIND_NOW) != 0;
+      break;
+    }
+  }
+}
+
+static Elf32_Dyn *ld_find_dynamic(Elf32_Phdr *phdr, uint32_t phnum, uint32_t base) {
+  for (uint32_t i = 0; i < phnum; ++i) {
+    if (phdr[i].p_type == PT_DYNAMIC)
+      return (Elf32_Dyn *)(base + phdr[i].p_vaddr);
+  }
+  return 0;
+}
+
+static void ld_load_library(const char *name) {
+  for (uint32_t i = 0; i < nr_objects; ++i) {
+    if (objects[i].name && ld_strcmp(objects[i].name, name) == 0)
+      return;
+  }
+
+  if (nr_objects == LD_MAX_OBJECTS)
+    ld_fail("too many libraries, cannot load ", name);
+
+  char path[256];
+  uint32_t prefix = ld_strlen(LD_LIBRARY_PATH);
+  uint32_t len = ld_strlen(name);
+  if (prefix + len >= sizeof(path))
+    ld_fail("name is too long ", name);
+  memcpy(path, LD_LIBRARY_PATH, prefix);
+  memcpy(path + prefix, name, len + 1);
+
+  int32_t base = ld_syscall(__NR_uselib, (uint32_t)path, 0, 0);
+  if (base < 0)
+    ld_fail("cannot load library ", path);
+
+  // the first page of shared object contains elf and program headers
+  Elf32_Ehdr *ehdr = (Elf32_Ehdr *)base;
+  Elf32_Dyn *dynamic = ld_find_dynamic((Elf32_Phdr *)(base + ehdr->e_phoff), ehdr->e_phnum, base);
+  if (!dynamic)
+    ld_fail("no dynamic section in ", path);
+
+  ld_init_object(&objects[nr_objects++], name, base, dynamic);
+}
+
+static uint32_t ld_hash(const char *name) {
+  uint32_t h = 0, g;
+  while (*name) {
+    h = (h << 4) + (unsigned char)*name++;
+    if ((g = h & 0xf0000000))
+      h ^= g >> 24;
+    h &= ~g;
+  }
+  return h;
+}
+
+static Elf32_Sym *ld_lookup_object(struct dso *dso, const char *name, uint32_t hash) {
+  if (!dso->hash)
+    return 0;
+
+  uint32_t nbucket = dso->hash[0];
+  uint32_t *bucket = dso->hash + 2;
+  uint32_t *chain = bucket + nbucket;
+
+  for (uint32_t i = bucket[hash % nbucket]; i; i = chain[i]) {
+    Elf32_Sym *sym = &dso->symtab[i];
+    if (sym->st_shndx != SHN_UNDEF && ld_strcmp(dso->strtab + sym->st_name, name) == 0)
+      return sym;
+  }
+  return 0;
+}
+
+// symbol is searched in the program first, then in libraries in load order
+static Elf32_Sym *ld_lookup(const char *name, struct dso *skip, struct dso **owner) {
+  uint32_t hash = ld_hash(name);
+
+  for (uint32_t i = 0; i < nr_objects; ++i) {
+    if (&objects[i] == skip)
+      continue;
+
+    Elf32_Sym *sym = ld_lookup_object(&objects[i], name, hash);
+    if (sym) {
+      *owner = &objects[i];
+      return sym;
+    }
+  }
+  return 0;
+}
+
+static uint32_t ld_resolve(struct dso *dso, uint32_t index, struct dso *skip, Elf32_Sym **res) {
+  Elf32_Sym *sym = &dso->symtab[index];
+  const char *name = dso->strtab + sym->st_name;
+
+  struct dso *owner = 0;
+  Elf32_Sym *def = ld_lookup(name, skip, &owner);
+  if (!def) {
+    if (ELF32_ST_BIND(sym->st_info) == STB_WEAK)
+      return 0;
+    ld_fail("undefined symbol ", name);
+  }
+
+  if (res)
+    *res = def;
+  return owner->base + def->st_value;
+}
+
+static void ld_relocate(struct dso *dso, Elf32_Rel *rel, uint32_t size) {
+  for (uint32_t i = 0; i < size / sizeof(Elf32_Rel); ++i) {
+    uint32_t *where = (uint32_t *)(dso->base + rel[i].r_offset);
+    uint32_t index = ELF32_R_SYM(rel[i].r_info);
+    Elf32_Sym *def = 0;
+
+    switch (ELF32_R_TYPE(rel[i].r_info)) {
+    case R_386_NONE:
+      break;
+    case R_386_RELATIVE:
+      *where += dso->base;
+      break;
+    case R_386_32:
+      *where += ld_resolve(dso, index, 0, 0);
+      break;
+    case R_386_PC32:
+      *where += ld_resolve(dso, index, 0, 0) - (uint32_t)where;
+      break;
+    case R_386_GLOB_DAT:
+    case R_386_JMP_SLOT:
+      *where = ld_resolve(dso, index, 0, 0);
+      break;
+    case R_386_COPY:
+      // program has its own copy of library data, definition is searched in libraries only
+      memcpy(where, (void *)ld_resolve(dso, index, dso, &def), def ? def->st_size : 0);
+      break;
+    default:
+      ld_fail("unsupported relocation in ", dso->name ? dso->name : "program");
+    }
+  }
+}
+
+static void ld_relocate_plt(struct dso *dso) {
+  if (!dso->jmprel)
+    return;
+
+  if (dso->bind_now || !dso->pltgot) {
+    ld_relocate(dso, dso->jmprel, dso->pltrelsz);
+    return;
+  }
+
+  // slots point back to their plt entries, which push relocation offset and jump to plt0
+  for (uint32_t i = 0; i < dso->pltrelsz / sizeof(Elf32_Rel); ++i)
+    *(uint32_t *)(dso->base + dso->jmprel[i].r_offset) += dso->base;
+
+  dso->pltgot[1] = (uint32_t)dso;
+  dso->pltgot[2] = (uint32_t)_dl_runtime_resolve;
+}
+
+// called from _dl_runtime_resolve when plt entry is used for the first time
+uint32_t _dl_fixup(struct dso *dso, uint32_t offset) {
+  Elf32_Rel *rel = (Elf32_Rel *)((char *)dso->jmprel + offset);
+  uint32_t addr = ld_resolve(dso, ELF32_R_SYM(rel->r_info), 0, 0);
+
+  *(uint32_t *)(dso->base + rel->r_offset) = addr;
+  return addr;
+}
+
+uint32_t _dl_start(uint32_t *sp) {
+  uint32_t aux[AT_ENTRY + 1];
+  for (uint32_t i = 0; i <= AT_ENTRY; ++i)
+    aux[i] = 0;
+
+  // sp[1] argc, sp[2] argv, sp[3] envp
+  for (uint32_t *auxv = (uint32_t *)sp[4]; auxv[0] != AT_NULL; auxv += 2) {
+    if (auxv[0] <= AT_ENTRY)
+      aux[auxv[0]] = auxv[1];
+  }
+
+  ld_relocate_self(aux[AT_BASE]);
+
+  Elf32_Phdr *phdr = (Elf32_Phdr *)aux[AT_PHDR];
+  if (!phdr)
+    ld_fail("program headers are not loaded", "");
+
+  uint32_t bias = 0;
+  for (uint32_t i = 0; i < aux[AT_PHNUM]; ++i) {
+    if (phdr[i].p_type == PT_PHDR)
+      bias = aux[AT_PHDR] - phdr[i].p_vaddr;
+  }
+
+  Elf32_Dyn *dynamic = ld_find_dynamic(phdr, aux[AT_PHNUM], bias);
+  if (!dynamic)
+    return aux[AT_ENTRY];
+
+  ld_init_object(&objects[nr_objects++], 0, bias, dynamic);
+
+  // breadth first, libraries needed by libraries are appended to the end
+  for (uint32_t i = 0; i < nr_objects; ++i) {
+    struct dso *dso = &objects[i];
+    for (Elf32_Dyn *dyn = dso->dynamic; dyn->d_tag != DT_NULL; ++dyn) {
+      if (dyn->d_tag == DT_NEEDED)
+        ld_load_library(dso->strtab + dyn->d_val);
+    }
+  }
+
+  // copy relocations of the program take data which is already relocated in libraries
+  for (int32_t i = nr_objects - 1; i >= 0; --i) {
+    ld_relocate(&objects[i], objects[i].rel, objects[i].relsz);
+    ld_relocate_plt(&objects[i]);
+  }
+
+  // crt0 of the program doesn't run constructors, libraries are initialized here
+  for (int32_t i = nr_objects - 1; i > 0; --i) {
+    struct dso *dso = &objects[i];
+    if (dso->init)
+      ((void (*)())dso->init)();
+    for (uint32_t j = 0; j < dso->init_arraysz / sizeof(uint32_t); ++j)
+      ((void (*)())dso->init_array[j])();
+  }
+
+  return aux[AT_ENTRY];
+}
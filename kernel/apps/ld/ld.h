@@ -0,0 +1,116 @@
+#ifndef LD_H
+#define LD_H
+
+#include <stdint.h>
+
+// loader is linked with -nostdlib, only what relocation of i386 objects needs
+typedef struct {
+  unsigned char e_ident[16];
+  uint16_t e_type;
+  uint16_t e_machine;
+  uint32_t e_version;
+  uint32_t e_entry;
+  uint32_t e_phoff;
+  uint32_t e_shoff;
+  uint32_t e_flags;
+  uint16_t e_ehsize;
+  uint16_t e_phentsize;
+  uint16_t e_phnum;
+  uint16_t e_shentsize;
+  uint16_t e_shnum;
+  uint16_t e_shstrndx;
+} Elf32_Ehdr;
+
+typedef struct {
+  uint32_t p_type;
+  uint32_t p_offset;
+  uint32_t p_vaddr;
+  uint32_t p_paddr;
+  uint32_t p_filesz;
+  uint32_t p_memsz;
+  uint32_t p_flags;
+  uint32_t p_align;
+} Elf32_Phdr;
+
+typedef struct {
+  int32_t d_tag;
+  uint32_t d_val;
+} Elf32_Dyn;
+
+typedef struct {
+  uint32_t st_name;
+  uint32_t st_value;
+  uint32_t st_size;
+  unsigned char st_info;
+  unsigned char st_other;
+  uint16_t st_shndx;
+} Elf32_Sym;
+
+typedef struct {
+  uint32_t r_offset;
+  uint32_t r_info;
+} Elf32_Rel;
+
+#define PT_DYNAMIC 2
+#define PT_PHDR 6
+
+#define DT_NULL 0
+#define DT_NEEDED 1
+#define DT_PLTRELSZ 2
+#define DT_PLTGOT 3
+#define DT_HASH 4
+#define DT_STRTAB 5
+#define DT_SYMTAB 6
+#define DT_INIT 12
+#define DT_REL 17
+#define DT_RELSZ 18
+#define DT_JMPREL 23
+#define DT_BIND_NOW 24
+#define DT_INIT_ARRAY 25
+#define DT_INIT_ARRAYSZ 27
+#define DT_FLAGS 30
+#define DF_BIND_NOW 0x8
+
+#define R_386_NONE 0
+#define R_386_32 1
+#define R_386_PC32 2
+#define R_386_COPY 5
+#define R_386_GLOB_DAT 6
+#define R_386_JMP_SLOT 7
+#define R_386_RELATIVE 8
+
+#define ELF32_R_SYM(i) ((i) >> 8)
+#define ELF32_R_TYPE(i) ((unsigned char)(i))
+#define ELF32_ST_BIND(i) ((i) >> 4)
+#define STB_WEAK 2
+#define SHN_UNDEF 0
+
+// same as kernel/proc/elf.h
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHNUM 5
+#define AT_BASE 7
+#define AT_ENTRY 9
+
+#define LD_LIBRARY_PATH "/lib/"
+#define LD_MAX_OBJECTS 16
+
+struct dso {
+  const char *name;
+  uint32_t base;
+  Elf32_Dyn *dynamic;
+  uint32_t *hash;
+  Elf32_Sym *symtab;
+  const char *strtab;
+  Elf32_Rel *rel;
+  uint32_t relsz;
+  Elf32_Rel *jmprel;
+  uint32_t pltrelsz;
+  uint32_t *pltgot;
+  uint32_t init;
+  uint32_t *init_array;
+  uint32_t init_arraysz;
+  int bind_now;
+};
+
+#endif
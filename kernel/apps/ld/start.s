@@ -0,0 +1,29 @@
+## entered from the kernel instead of the program, stack is the same as for crt0
+## (%esp) fake return, 4(%esp) argc, 8(%esp) argv, 12(%esp) envp, 16(%esp) auxv
+.global _start
+.hidden _start
+.type _start, @function
+_start:
+  push %esp               # pointer to the frame of the program
+  call _dl_start          # returns entry of the program
+  add $4, %esp
+  jmp *%eax               # stack is untouched, program sees it as it was built by the kernel
+
+## lazy binding, plt0 pushes GOT[1] (struct dso) and jumps here with relocation offset below it
+.global _dl_runtime_resolve
+.hidden _dl_runtime_resolve
+.type _dl_runtime_resolve, @function
+_dl_runtime_resolve:
+  push %eax
+  push %ecx
+  push %edx
+  mov 16(%esp), %edx      # relocation offset
+  mov 12(%esp), %eax      # struct dso
+  push %edx
+  push %eax
+  call _dl_fixup
+  add $8, %esp
+  pop %edx
+  pop %ecx
+  xchg %eax, (%esp)       # restore eax, resolved address is the return address
+  ret $8
@@ -0,0 +1,49 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHM_NAME "/tshm"
+#define SHM_SIZE 4096
+
+void main(int argc, char** argv) {
+  fprintf(stdout, "TEST SHARED MEMORY");
+
+  int fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0600);
+  if (fd == -1) {
+    fprintf(stderr, "can't open shared memory object");
+    return -1;
+  }
+
+  if (ftruncate(fd, SHM_SIZE) == -1) {
+    fprintf(stderr, "can't resize shared memory object");
+    return -1;
+  }
+
+  char *buf = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (buf == MAP_FAILED) {
+    fprintf(stderr, "can't map shared memory object");
+    return -1;
+  }
+  close(fd);
+
+  int pid_child = fork();
+  if (pid_child == -1) {
+    fprintf(stderr, "Can't create child");
+    return -1;
+  } else if (pid_child == 0) {
+    // child writes into the same frames parent reads from
+    strcpy(buf, "hello from child");
+    return 0;
+  }
+
+  int wstatus;
+  waitpid(pid_child, &wstatus, 0);
+  fprintf(stdout, "\nParent: %s", buf);
+
+  munmap(buf, SHM_SIZE);
+  shm_unlink(SHM_NAME);
+  return 0;
+}
@@ -5,8 +5,12 @@
 #include "kernel/cpu/hal.h"
 #include "kernel/proc/task.h"
 #include "kernel/cpu/idt.h"
+#include "kernel/include/errno.h"
 #include "kernel/cpu/gdt.h"
+#include "kernel/cpu/tss.h"
 #include "kernel/ipc/signal.h"
+#include "kernel/memory/kernel_info.h"
+#include "kernel/memory/vmm.h"
 #include "kernel/util/debug.h"
 
 extern uint32_t DEBUG_LAST_TID = 0;
@@ -68,8 +72,15 @@ void no_device_fault(struct interrupt_registers *registers) {
 }
 
 //! double fault
-void double_fault_abort(struct interrupt_registers *registers) {
-  assert_not_reached("Double fault", NULL);
+// runs as a separate task on its own stack (tss.c), faulting thread is in the task's TSS
+static void double_fault_task() {
+  uint32_t faultAddr = 0;
+  __asm__ __volatile__("mov %%cr2, %0" : "=r"(faultAddr));
+  struct tss_entry *prev = tss_get_task();
+
+  if (kstack_is_guard(faultAddr) || kstack_is_guard(prev->esp))
+    err("Double fault: kernel stack overflow at 0x%x (esp 0x%x, eip 0x%x)", faultAddr, prev->esp, prev->eip);
+  assert_not_reached("Double fault at eip 0x%x", prev->eip);
 }
 
 //! invalid Task State Segment (TSS)
@@ -133,6 +144,17 @@ void machine_check_abort(struct interrupt_registers *registers) {
 void simd_fpu_fault(struct interrupt_registers *registers) {
   assert_not_reached("FPU SIMD fault", NULL);
 }
+// reserved but not yet populated part of user heap, stack or shared library
+static bool is_lazy_user_area(mm_struct_mos *mm, virtual_addr addr) {
+  for (uint32_t i = 0; i < mm->nr_libraries; ++i) {
+    if (mm->libraries[i].start <= addr && addr < mm->libraries[i].end)
+      return true;
+  }
+
+  return (mm->heap_start <= addr && addr < PAGE_ALIGN(mm->brk)) ||
+         (mm->start_stack - USER_STACK_SIZE <= addr && addr < mm->start_stack);
+}
+
 // 0xC8060ED8
 int32_t thread_page_fault(interrupt_registers *regs) {
 	uint32_t faultAddr = 0;
@@ -140,6 +162,32 @@ int32_t thread_page_fault(interrupt_registers *regs) {
 	 										 "mov %%eax, %0			\n"
 	 										 : "=r"(faultAddr));
 
+  // non-present user page, touched by userspace or by kernel (exec params), is filled on demand
+  struct process *proc = get_current_process();
+  if (!(regs->err_code & 0b1) && faultAddr < KERNEL_HIGHER_HALF &&
+      proc && proc->mm_mos && !vmm_is_kernel_directory(proc->va_dir)) {
+    // page is swapped out, -EFAULT means pte is not a swap entry
+    int32_t swap_ret = swap_in_page(faultAddr);
+    if (swap_ret == 0)
+      return IRQ_HANDLER_STOP;
+
+    // data of the page only lives in swap, it must not be replaced by a zero page.
+    // Swap slot is released with the address space when the process is killed below
+    if (swap_ret != -EFAULT)
+      err("Page Fault: unable to swap in 0x%x (%d)", faultAddr, swap_ret);
+    else if (is_lazy_user_area(proc->mm_mos, faultAddr)) {
+      if (vmm_map_zeroed_page(faultAddr & PAGE_MASK, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER)) {
+        proc->mm_mos->rss.min_flt++;
+        lru_add_current_page(faultAddr);
+        return IRQ_HANDLER_STOP;
+      }
+      err("Page Fault: out of memory at 0x%x", faultAddr);
+    }
+  }
+
+  if (kstack_is_guard(faultAddr))
+    err("Page Fault: kernel stack overflow at 0x%x", faultAddr);
+
   page_fault_print(regs, faultAddr);
 
 	if (regs->cs == USER_CODE && faultAddr == (uint32_t)sigreturn) {
@@ -172,7 +220,9 @@ void exception_init() {
   register_interrupt_handler(5, (I86_IRQ_HANDLER)bounds_check_fault);
   register_interrupt_handler(6, (I86_IRQ_HANDLER)invalid_opcode_fault);
   register_interrupt_handler(7, (I86_IRQ_HANDLER)no_device_fault);
-  register_interrupt_handler(8, (I86_IRQ_HANDLER)double_fault_abort);
+  // #DF switches to its own task, overflowed stack can't take the exception frame
+  install_double_fault_tss(DOUBLE_FAULT_TSS_IDX, (uint32_t)double_fault_task, pmm_get_PDBR());
+  i86_install_ir(8, 0, DOUBLE_FAULT_TSS_IDX * sizeof(gdt_entry_t), I86_IDT_DESC_PRESENT | I86_IDT_DESC_TASK);
   register_interrupt_handler(10, (I86_IRQ_HANDLER)invalid_tss_fault);
   register_interrupt_handler(11, (I86_IRQ_HANDLER)no_segment_fault);
   register_interrupt_handler(12, (I86_IRQ_HANDLER)stack_fault);
@@ -10,7 +10,7 @@
 #define KERNEL_CODE 8
 
 //! maximum amount of descriptors allowed
-#define MAX_DESCRIPTORS 6
+#define MAX_DESCRIPTORS 7
 
 //! set access bit
 #define I86_GDT_DESC_ACCESS 0x0001  // 00000001
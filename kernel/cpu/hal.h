@@ -1,5 +1,6 @@
 #ifndef HAL_H
 #define HAL_H
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -28,6 +29,29 @@ static __inline void disable_interrupts() {
   __asm__ __volatile__("cli");
 }
 
+//! disable interrupts and return previous eflags, safe to be used from irq context
+static __inline uint32_t irq_save() {
+  uint32_t flags;
+  __asm__ __volatile__("pushf; pop %0; cli"
+                       : "=r"(flags)
+                       :
+                       : "memory");
+  return flags;
+}
+
+static __inline bool interrupts_enabled() {
+  uint32_t flags;
+  __asm__ __volatile__("pushf; pop %0"
+                       : "=r"(flags));
+  return flags & 0x200;
+}
+
+//! enable interrupts only if they were enabled before irq_save
+static __inline void irq_restore(uint32_t flags) {
+  if (flags & 0x200)
+    enable_interrupts();
+}
+
 static __inline void halt() {
   __asm__ __volatile__("hlt");
 }
@@ -60,6 +84,13 @@ static __inline void outportw(unsigned short _port, unsigned short _data) {
                : "dN"(_port), "a"(_data));
 }
 
+static __inline uint64_t rdtsc() {
+  uint64_t ret;
+  __asm__ __volatile__("rdtsc"
+                       : "=A"(ret));
+  return ret;
+}
+
 static __inline unsigned int ESP() {
   uint32_t esp;
   asm volatile("mov %%esp, %0"
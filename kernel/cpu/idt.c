@@ -3,6 +3,8 @@
 #include "kernel/util/stdio.h"
 #include "kernel/include/list.h"
 #include "kernel/util/debug.h"
+#include "kernel/proc/task.h"
+#include "kernel/system/softirq.h"
 #include "../devices/terminal.h"
 #include "hal.h"
 #include "pic.h"
@@ -220,6 +222,11 @@ void register_interrupt_handler(uint8_t n, I86_IRQ_HANDLER handler) {
 
 // This gets called from our ASM interrupt handler stub.
 void irq_handler(interrupt_registers *regs) {
+  preempt_disable();
   handle_interrupt(regs);
   interruptdone(regs->int_no);
+  preempt_enable_no_resched();
+
+  do_softirq();
+  preempt_schedule_irq();
 }
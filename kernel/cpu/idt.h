@@ -10,6 +10,7 @@
 //! must be in the format 0D110, where D is descriptor type
 #define I86_IDT_DESC_BIT16 0x06    // 00000110
 #define I86_IDT_DESC_BIT32 0x0E    // 00001110
+#define I86_IDT_DESC_TASK 0x05     // 00000101
 #define I86_IDT_DESC_RING1 0x40    // 01000000
 #define I86_IDT_DESC_RING2 0x20    // 00100000
 #define I86_IDT_DESC_RING3 0x60    // 01100000
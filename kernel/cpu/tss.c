@@ -5,6 +5,10 @@
 
 static struct tss_entry TSS;
 
+// overflowed kernel stack can't take the #PF frame either, so #DF switches to a task with its own stack
+static struct tss_entry DF_TSS;
+static uint8_t df_stack[0x1000] __attribute__((aligned(16)));
+
 void tss_set_stack(uint32_t kernelSS, uint32_t kernelESP) {
   TSS.ss0 = kernelSS;
   TSS.esp0 = kernelESP;
@@ -43,3 +47,27 @@ void install_tss(uint32_t idx, uint32_t kernelSS, uint32_t kernelESP) {
 
   flush_tss(idx * sizeof(gdt_entry_t));
 }
+
+// cr3 is a directory with kernel mappings, it's used whichever address space was active
+void install_double_fault_tss(uint32_t idx, uint32_t handler, uint32_t cr3) {
+  uint32_t base = (uint32_t)&DF_TSS;
+  gdt_set_descriptor(idx, base, base + sizeof(struct tss_entry),
+                     I86_GDT_DESC_ACCESS | I86_GDT_DESC_EXEC_CODE | I86_GDT_DESC_MEMORY,
+                     0);
+
+  memset((void *)&DF_TSS, 0, sizeof(struct tss_entry));
+  DF_TSS.cr3 = cr3;
+  DF_TSS.eip = handler;
+  DF_TSS.eflags = 0x2;  // interrupts disabled
+  DF_TSS.esp = (uint32_t)df_stack + sizeof(df_stack);
+  DF_TSS.ss0 = DF_TSS.ss = KERNEL_DATA;
+  DF_TSS.esp0 = DF_TSS.esp;
+  DF_TSS.cs = KERNEL_CODE;
+  DF_TSS.ds = DF_TSS.es = DF_TSS.fs = DF_TSS.gs = KERNEL_DATA;
+  DF_TSS.iomap = sizeof(struct tss_entry);
+}
+
+// state of the task which was interrupted by the double fault
+struct tss_entry *tss_get_task() {
+  return &TSS;
+}
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+// gdt index of the double fault task, main TSS is in 5 (selector 0x2b)
+#define DOUBLE_FAULT_TSS_IDX 6
+
 #pragma pack(1)
 struct tss_entry
 {
@@ -38,5 +41,7 @@ struct tss_entry
 
 void tss_set_stack(uint32_t kernelSS, uint32_t kernelESP);
 void install_tss(uint32_t sel, uint32_t kernelSS, uint32_t kernelESP);
+void install_double_fault_tss(uint32_t idx, uint32_t handler, uint32_t cr3);
+struct tss_entry *tss_get_task();
 
 #endif
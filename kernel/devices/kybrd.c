@@ -4,6 +4,7 @@
 #include "kernel/cpu/idt.h"
 #include "kernel/util/debug.h"
 #include "kernel/proc/wait.h"
+#include "kernel/system/softirq.h"
 #include "kernel/fs/poll.h"
 #include "kernel/include/fcntl.h"
 #include "kybrd.h"
@@ -303,120 +304,153 @@ void kybrd_notify_readers(struct key_event *ev) {
   wake_up(&hwait);
 }
 
-//!	keyboard interrupt handler
-void i86_kybrd_irq() {
-  static bool _extended = false;
-
-  int code = 0;
+#define KYBRD_SCANCODE_BUFFER 64
 
-  //! read scan code only if the kkybrd controller output buffer is full (scan code is in it)
-  if (kybrd_ctrl_read_status() & KYBRD_CTRL_STATS_MASK_OUT_BUF) {
-    //! read the scan code
-    code = kybrd_enc_read_buf();
+// scan codes are read in irq and then translated to key events in bottom half
+static volatile uint8_t scancode_buffer[KYBRD_SCANCODE_BUFFER];
+static volatile uint32_t scancode_head = 0, scancode_tail = 0;
 
-    //! is this an extended code? If so, set it and return
-    if (code == 0xE0 || code == 0xE1)
-      _extended = true;
-    else {
-      //! either the second byte of an extended scan code or a single byte scan code
-      _extended = false;
-
-      //! test if this is a break code (Original XT Scan Code Set specific)
-      if (code & 0x80) {  // test bit 7
-
-        //! covert the break code into its make code equivelant
-        code -= 0x80;
-
-        //! grab the key
-        int key = _kkybrd_scancode_std[code];
+static void kybrd_handle_scancode(int code) {
+  static bool _extended = false;
 
-        //! test if a special key has been released & set it
-        switch (key) {
-          case KEY_LCTRL:
-          case KEY_RCTRL:
-            _ctrl = false;
-            break;
+  //! is this an extended code? If so, set it and return
+  if (code == 0xE0 || code == 0xE1)
+    _extended = true;
+  else {
+    //! either the second byte of an extended scan code or a single byte scan code
+    _extended = false;
+
+    //! test if this is a break code (Original XT Scan Code Set specific)
+    if (code & 0x80) {  // test bit 7
+
+      //! covert the break code into its make code equivelant
+      code -= 0x80;
+
+      //! grab the key
+      int key = _kkybrd_scancode_std[code];
+
+      //! test if a special key has been released & set it
+      switch (key) {
+        case KEY_LCTRL:
+        case KEY_RCTRL:
+          _ctrl = false;
+          break;
+
+        case KEY_LSHIFT:
+        case KEY_RSHIFT:
+          _shift = false;
+          break;
+
+        case KEY_LALT:
+        case KEY_RALT:
+          _alt = false;
+          break;
+      }
 
-          case KEY_LSHIFT:
-          case KEY_RSHIFT:
-            _shift = false;
-            break;
+      current_kybrd_event.type = KEY_RELEASE;
+      current_kybrd_event.key = key;
+    } else {
+      //! this is a make code - set the scan code
+      _scancode = code;
+
+      //! grab the key
+      int key = _kkybrd_scancode_std[code];
+
+      //! test if user is holding down any special keys & set it
+      switch (key) {
+        case KEY_LCTRL:
+        case KEY_RCTRL:
+          _ctrl = true;
+          break;
+
+        case KEY_LSHIFT:
+        case KEY_RSHIFT:
+          _shift = true;
+          break;
+
+        case KEY_LALT:
+        case KEY_RALT:
+          _alt = true;
+          break;
+
+        case KEY_CAPSLOCK:
+          _capslock = (_capslock) ? false : true;
+          kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+          break;
+
+        case KEY_KP_NUMLOCK:
+          _numlock = (_numlock) ? false : true;
+          kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+          break;
+
+        case KEY_SCROLLLOCK:
+          _scrolllock = (_scrolllock) ? false : true;
+          kkybrd_set_leds(_numlock, _capslock, _scrolllock);
+          break;
+      }
 
-          case KEY_LALT:
-          case KEY_RALT:
-            _alt = false;
-            break;
-        }
+      current_kybrd_event.type = KEY_PRRESS;
+      current_kybrd_event.key = key;
+    }
 
-        current_kybrd_event.type = KEY_RELEASE;
-        current_kybrd_event.key = key;
-      } else {
-        //! this is a make code - set the scan code
-        _scancode = code;
+    
+    kybrd_set_event_state();
 
-        //! grab the key
-        int key = _kkybrd_scancode_std[code];
+    if (current_kybrd_event.key != KEY_LSHIFT && current_kybrd_event.key != KEY_LCTRL) {
+      kybrd_notify_readers(&current_kybrd_event);
+    }
+    
+  }
 
-        //! test if user is holding down any special keys & set it
-        switch (key) {
-          case KEY_LCTRL:
-          case KEY_RCTRL:
-            _ctrl = true;
-            break;
+  //! watch for errors
+  switch (code) {
+    case KYBRD_ERR_BAT_FAILED:
+      _kkybrd_bat_res = false;
+      break;
 
-          case KEY_LSHIFT:
-          case KEY_RSHIFT:
-            _shift = true;
-            break;
+    case KYBRD_ERR_DIAG_FAILED:
+      _kkybrd_diag_res = false;
+      break;
 
-          case KEY_LALT:
-          case KEY_RALT:
-            _alt = true;
-            break;
+    case KYBRD_ERR_RESEND_CMD:
+      _kkybrd_resend_res = true;
+      break;
+  }
+}
 
-          case KEY_CAPSLOCK:
-            _capslock = (_capslock) ? false : true;
-            kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-            break;
+static void kybrd_bottom_half(uint32_t data) {
+  while (true) {
+    uint32_t flags = irq_save();
+    if (scancode_head == scancode_tail) {
+      irq_restore(flags);
+      break;
+    }
 
-          case KEY_KP_NUMLOCK:
-            _numlock = (_numlock) ? false : true;
-            kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-            break;
+    int code = scancode_buffer[scancode_head];
+    scancode_head = (scancode_head + 1) % KYBRD_SCANCODE_BUFFER;
+    irq_restore(flags);
 
-          case KEY_SCROLLLOCK:
-            _scrolllock = (_scrolllock) ? false : true;
-            kkybrd_set_leds(_numlock, _capslock, _scrolllock);
-            break;
-        }
+    kybrd_handle_scancode(code);
+  }
+}
 
-        current_kybrd_event.type = KEY_PRRESS;
-        current_kybrd_event.key = key;
-      }
+static DECLARE_TASKLET(kybrd_tasklet, kybrd_bottom_half, 0);
 
-      
-      kybrd_set_event_state();
+//!	keyboard interrupt handler
+void i86_kybrd_irq() {
+  //! read scan code only if the kkybrd controller output buffer is full (scan code is in it)
+  if (kybrd_ctrl_read_status() & KYBRD_CTRL_STATS_MASK_OUT_BUF) {
+    //! read the scan code
+    uint8_t code = kybrd_enc_read_buf();
+    uint32_t next = (scancode_tail + 1) % KYBRD_SCANCODE_BUFFER;
 
-      if (current_kybrd_event.key != KEY_LSHIFT && current_kybrd_event.key != KEY_LCTRL) {
-        kybrd_notify_readers(&current_kybrd_event);
-      }
-      
+    // the newest scan code is dropped if bottom half is too slow
+    if (next != scancode_head) {
+      scancode_buffer[scancode_tail] = code;
+      scancode_tail = next;
     }
 
-    //! watch for errors
-    switch (code) {
-      case KYBRD_ERR_BAT_FAILED:
-        _kkybrd_bat_res = false;
-        break;
-
-      case KYBRD_ERR_DIAG_FAILED:
-        _kkybrd_diag_res = false;
-        break;
-
-      case KYBRD_ERR_RESEND_CMD:
-        _kkybrd_resend_res = true;
-        break;
-    }
+    tasklet_schedule(&kybrd_tasklet);
   }
 }
 
@@ -1,4 +1,5 @@
 #include "kernel/devices/pata.h"
+#include "kernel/devices/zram.h"
 
 #include "kernel/cpu/hal.h"
 #include "kernel/include/errno.h"
@@ -107,6 +108,9 @@ static struct ata_device *pata_detect(uint16_t io_addr1, uint8_t irq, bool is_ma
 }
 
 int8_t pata_read(pata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer) {
+  if (device->is_ram)
+    return zram_read(lba, n_sectors, buffer);
+
   outportb(device->io_base + 6, (device->is_master ? 0xE0 : 0xF0) | ((lba >> 24) & 0x0F));
   pata_400ns_delays(device);
 
@@ -131,6 +135,9 @@ int8_t pata_read(pata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t
 }
 
 int8_t pata_write(pata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t *buffer) {
+  if (device->is_ram)
+    return zram_write(lba, n_sectors, buffer);
+
   outportb(device->io_base + 6, (device->is_master ? 0xE0 : 0xF0) | ((lba >> 24) & 0x0F));
   pata_400ns_delays(device);
 
@@ -157,9 +164,13 @@ int8_t pata_write(pata_device *device, uint32_t lba, uint8_t n_sectors, uint16_t
 
 pata_device *get_pata_device(char *dev_name) {
   for (uint8_t i = 0; i < MAX_ATA_DEVICE; ++i) {
-    if (strcmp(devices[i].dev_name, dev_name) == 0)
+    // device slot is empty if the device is not detected
+    if (devices[i].dev_name && strcmp(devices[i].dev_name, dev_name) == 0)
       return &devices[i];
   }
+
+  if (strcmp(dev_name, ZRAM_DEVICE) == 0)
+    return zram_get_device();
   return NULL;
 }
 
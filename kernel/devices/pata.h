@@ -30,6 +30,9 @@ typedef struct _pata_device {
 	char *dev_name;
 	bool is_master;
 	bool is_harddisk;
+	// compressed ram disk (devices/zram.c) served through the same interface
+	bool is_ram;
+	uint32_t sectors;
 } pata_device;
 
 uint8_t pata_init();
@@ -231,7 +231,7 @@ void terminal_run() {
     setpgid(0, 0);
     struct process *proc_child = get_current_process();
     
-    proc_child->sid = proc_child->pid;
+    process_set_sid(proc_child, proc_child->pid);
     proc_child->tty = NULL;
     assert(proc_child->sid == proc_child->gid && proc_child->gid == proc_child->pid);
 
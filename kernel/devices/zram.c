@@ -0,0 +1,175 @@
+#include "kernel/fs/vfs.h"
+#include "kernel/include/errno.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/memory/pmm.h"
+#include "kernel/proc/task.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/lzf.h"
+#include "kernel/util/math.h"
+#include "kernel/util/string/string.h"
+
+#include "kernel/devices/zram.h"
+
+// each page is compressed separately into kernel heap, zero-filled page takes no memory.
+// Reads and writes share one scratch page, so they are not preemptible
+#define ZRAM_PAGES (ZRAM_DISKSIZE / PMM_FRAME_SIZE)
+#define SECTORS_PER_PAGE (PMM_FRAME_SIZE / BYTES_PER_SECTOR)
+
+struct zram_entry {
+  uint8_t *handle;
+  uint16_t size;
+  bool zero;
+};
+
+static pata_device zram_device;
+static struct zram_entry *zram_table = NULL;
+static uint8_t zram_page[PMM_FRAME_SIZE];
+static uint8_t zram_buf[PMM_FRAME_SIZE];
+static struct zram_stats zram_stats;
+
+static bool is_zero_page(uint8_t *page) {
+  uint32_t *words = (uint32_t *)page;
+  for (uint32_t i = 0; i < PMM_FRAME_SIZE / sizeof(uint32_t); ++i) {
+    if (words[i])
+      return false;
+  }
+  return true;
+}
+
+static void zram_free_page(struct zram_entry *entry) {
+  if (entry->handle) {
+    kfree(entry->handle);
+    zram_stats.stored_pages--;
+    zram_stats.orig_data_size -= PMM_FRAME_SIZE;
+    zram_stats.compr_data_size -= entry->size;
+  } else if (entry->zero)
+    zram_stats.zero_pages--;
+
+  entry->handle = NULL;
+  entry->size = 0;
+  entry->zero = false;
+}
+
+static void zram_read_page(uint32_t index, uint8_t *page) {
+  struct zram_entry *entry = &zram_table[index];
+
+  if (!entry->handle) {
+    memset(page, 0, PMM_FRAME_SIZE);
+    return;
+  }
+
+  zram_stats.read_hits++;
+  if (entry->size == PMM_FRAME_SIZE)
+    memcpy(page, entry->handle, PMM_FRAME_SIZE);
+  else if (lzf_decompress(entry->handle, entry->size, page, PMM_FRAME_SIZE) != PMM_FRAME_SIZE)
+    assert_not_reached("zram: page %d is corrupted", index);
+}
+
+static int8_t zram_write_page(uint32_t index, uint8_t *page) {
+  struct zram_entry *entry = &zram_table[index];
+  zram_free_page(entry);
+
+  if (is_zero_page(page)) {
+    entry->zero = true;
+    zram_stats.zero_pages++;
+    return 0;
+  }
+
+  uint8_t *src = zram_buf;
+  uint32_t size = lzf_compress(page, PMM_FRAME_SIZE, zram_buf, PMM_FRAME_SIZE - 1);
+  if (!size) {
+    src = page;
+    size = PMM_FRAME_SIZE;
+  }
+
+  entry->handle = kmalloc(size);
+  if (!entry->handle) {
+    zram_stats.failed_writes++;
+    return -ENOMEM;
+  }
+
+  memcpy(entry->handle, src, size);
+  entry->size = size;
+  zram_stats.stored_pages++;
+  zram_stats.orig_data_size += PMM_FRAME_SIZE;
+  zram_stats.compr_data_size += size;
+  return 0;
+}
+
+int8_t zram_read(uint32_t lba, uint8_t n_sectors, uint16_t *buffer) {
+  uint8_t *buf = (uint8_t *)buffer;
+  if (lba + n_sectors > ZRAM_PAGES * SECTORS_PER_PAGE)
+    return -ENXIO;
+
+  preempt_disable();
+  zram_stats.num_reads++;
+
+  while (n_sectors > 0) {
+    uint32_t index = lba / SECTORS_PER_PAGE;
+    uint32_t offset = lba % SECTORS_PER_PAGE;
+    uint32_t count = min_t(uint32_t, n_sectors, SECTORS_PER_PAGE - offset);
+
+    zram_read_page(index, zram_page);
+    memcpy(buf, zram_page + offset * BYTES_PER_SECTOR, count * BYTES_PER_SECTOR);
+
+    buf += count * BYTES_PER_SECTOR;
+    lba += count;
+    n_sectors -= count;
+  }
+
+  preempt_enable();
+  return 0;
+}
+
+int8_t zram_write(uint32_t lba, uint8_t n_sectors, uint16_t *buffer) {
+  uint8_t *buf = (uint8_t *)buffer;
+  if (lba + n_sectors > ZRAM_PAGES * SECTORS_PER_PAGE)
+    return -ENXIO;
+
+  int8_t ret = 0;
+  preempt_disable();
+  zram_stats.num_writes++;
+
+  while (n_sectors > 0 && ret == 0) {
+    uint32_t index = lba / SECTORS_PER_PAGE;
+    uint32_t offset = lba % SECTORS_PER_PAGE;
+    uint32_t count = min_t(uint32_t, n_sectors, SECTORS_PER_PAGE - offset);
+
+    if (count == SECTORS_PER_PAGE) {
+      ret = zram_write_page(index, buf);
+    } else {
+      // partial page is read, patched and compressed again
+      zram_read_page(index, zram_page);
+      memcpy(zram_page + offset * BYTES_PER_SECTOR, buf, count * BYTES_PER_SECTOR);
+      ret = zram_write_page(index, zram_page);
+    }
+
+    buf += count * BYTES_PER_SECTOR;
+    lba += count;
+    n_sectors -= count;
+  }
+
+  preempt_enable();
+  return ret;
+}
+
+pata_device *zram_get_device() {
+  return zram_table ? &zram_device : NULL;
+}
+
+struct zram_stats *get_zram_stats() {
+  return &zram_stats;
+}
+
+void zram_init() {
+  if (!ZRAM_PAGES)
+    return;
+
+  zram_table = kcalloc(ZRAM_PAGES, sizeof(struct zram_entry));
+  memset(&zram_device, 0, sizeof(pata_device));
+  zram_device.dev_name = ZRAM_DEVICE;
+  zram_device.is_ram = true;
+  zram_device.sectors = ZRAM_PAGES * SECTORS_PER_PAGE;
+
+  log("zram: %s with %dKB", ZRAM_DEVICE, ZRAM_DISKSIZE / 1024);
+}
@@ -0,0 +1,29 @@
+#ifndef KERNEL_DEVICES_ZRAM_H
+#define KERNEL_DEVICES_ZRAM_H
+
+#include <stdint.h>
+
+#include "kernel/devices/pata.h"
+
+#define ZRAM_DEVICE "/dev/zram0"
+// size of uncompressed data, 0 disables the device
+#define ZRAM_DISKSIZE 0x1000000  // 16mb
+
+struct zram_stats {
+  uint32_t num_reads;
+  uint32_t num_writes;
+  uint32_t read_hits;  // pages which are decompressed, others are never written or zero-filled
+  uint32_t failed_writes;
+  uint32_t zero_pages;
+  uint32_t stored_pages;
+  uint32_t orig_data_size;
+  uint32_t compr_data_size;
+};
+
+void zram_init();
+pata_device *zram_get_device();
+int8_t zram_read(uint32_t lba, uint8_t n_sectors, uint16_t *buffer);
+int8_t zram_write(uint32_t lba, uint8_t n_sectors, uint16_t *buffer);
+struct zram_stats *get_zram_stats();
+
+#endif
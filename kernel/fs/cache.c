@@ -1,29 +1,199 @@
+#include "kernel/cpu/hal.h"
 #include "kernel/include/list.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/util/debug.h"
 #include "kernel/util/string/string.h"
 
 #include "kernel/fs/vfs.h"
 
-// TODO: optimization: use red-black trees
-struct list_head all_dentries;
+// dentries are hashed by (parent, name), failed lookups stay as negative dentries.
+// Unused ones wait in lru list, dentries of mount, mknod and pipes are never hashed
+static struct list_head dentry_hashtable[DCACHE_HASH_SIZE];
+static LIST_HEAD(dentry_lru);
+static struct dcache_stats dcache_stats;
 
-int vfs_cache(struct vfs_dentry* dentry) {
-  list_add_tail(&dentry->d_cache_sibling, &all_dentries);
+uint32_t vfs_name_hash(const char *name) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (; *name; ++name)
+    hash = (hash ^ (uint8_t)*name) * 16777619u;
+  return hash;
 }
 
-int vfs_cache_remove(struct vfs_dentry* dentry) {
-  list_del(&dentry->d_cache_sibling);  
+static struct list_head *d_hash_bucket(struct vfs_dentry *parent, uint32_t hash) {
+  hash ^= ((uint32_t)parent >> 4) * 2654435761u;
+  return &dentry_hashtable[hash % DCACHE_HASH_SIZE];
 }
 
-struct vfs_dentry* vfs_cache_get(struct vfs_dentry *parent, char *name) {
-  struct vfs_dentry* iter;
-  list_for_each_entry(iter, &all_dentries, d_cache_sibling) {
-    if (iter->d_parent == parent && strcmp(name, iter->d_name)) {
-      return iter;
+struct vfs_dentry *dget(struct vfs_dentry *dentry) {
+  if (!dentry)
+    return NULL;
+
+  uint32_t flags = irq_save();
+  if (dentry->d_count++ == 0 && !list_empty(&dentry->d_lru)) {
+    list_del_init(&dentry->d_lru);
+    dcache_stats.unused--;
+  }
+  irq_restore(flags);
+  return dentry;
+}
+
+// only hashed and unlinked dentries are released, inodes of pipes and shm are not in inode cache
+static void d_free(struct vfs_dentry *dentry) {
+  struct vfs_inode *inode = dentry->d_inode;
+
+  list_del_init(&dentry->d_sibling);
+  if (inode && inode->i_state & I_HASHED)
+    iput(inode);
+  else if (inode)
+    kfree(inode);
+
+  kfree(dentry->d_name);
+  kfree(dentry);
+}
+
+static void d_unhash(struct vfs_dentry *dentry) {
+  list_del_init(&dentry->d_hash);
+  dentry->d_flags &= ~DCACHE_HASHED;
+  dcache_stats.entries--;
+  if (!dentry->d_inode)
+    dcache_stats.negative--;
+}
+
+void dput(struct vfs_dentry *dentry) {
+  while (dentry) {
+    uint32_t flags = irq_save();
+    assert(dentry->d_count > 0, "dput of unused dentry %s", dentry->d_name);
+
+    if (--dentry->d_count > 0 || !(dentry->d_flags & (DCACHE_HASHED | DCACHE_UNLINKED))) {
+      irq_restore(flags);
+      return;
     }
+
+    if (dentry->d_flags & DCACHE_HASHED) {
+      list_add_tail(&dentry->d_lru, &dentry_lru);
+      dcache_stats.unused++;
+      bool shrink = dcache_stats.unused > DCACHE_MAX_UNUSED;
+      irq_restore(flags);
+
+      if (shrink)
+        vfs_cache_shrink(DCACHE_SHRINK_BATCH);
+      return;
+    }
+
+    // unlinked, the last user is gone
+    struct vfs_dentry *parent = dentry->d_parent;
+    irq_restore(flags);
+    d_free(dentry);
+    dentry = parent;
+  }
+}
+
+// positive dentry is linked into parent's subdirs, negative one is only in the hash.
+// dentry is returned with a reference taken
+void vfs_cache(struct vfs_dentry *dentry) {
+  uint32_t flags = irq_save();
+  dentry->d_count++;
+  dentry->d_hash_value = vfs_name_hash(dentry->d_name);
+  list_add(&dentry->d_hash, d_hash_bucket(dentry->d_parent, dentry->d_hash_value));
+  dentry->d_flags |= DCACHE_HASHED;
+  dget(dentry->d_parent);
+  if (dentry->d_inode)
+    list_add_tail(&dentry->d_sibling, &dentry->d_parent->d_subdirs);
+  else
+    dcache_stats.negative++;
+  dcache_stats.entries++;
+  irq_restore(flags);
+}
+
+// dentry disappears from lookups, it's freed after the last reference is dropped
+void vfs_cache_remove(struct vfs_dentry *dentry) {
+  uint32_t flags = irq_save();
+  if (!(dentry->d_flags & DCACHE_HASHED)) {
+    irq_restore(flags);
+    return;
   }
+
+  d_unhash(dentry);
+  list_del_init(&dentry->d_sibling);
+  dentry->d_flags |= DCACHE_UNLINKED;
+  if (dentry->d_count > 0) {
+    irq_restore(flags);
+    return;
+  }
+
+  list_del_init(&dentry->d_lru);
+  dcache_stats.unused--;
+  struct vfs_dentry *parent = dentry->d_parent;
+  irq_restore(flags);
+
+  d_free(dentry);
+  dput(parent);
+}
+
+// returns positive or negative dentry with a reference taken
+struct vfs_dentry *vfs_cache_get(struct vfs_dentry *parent, char *name) {
+  uint32_t hash = vfs_name_hash(name);
+  struct vfs_dentry *iter;
+
+  uint32_t flags = irq_save();
+  list_for_each_entry(iter, d_hash_bucket(parent, hash), d_hash) {
+    if (iter->d_parent != parent || iter->d_hash_value != hash || strcmp(name, iter->d_name) != 0)
+      continue;
+
+    dget(iter);
+    if (iter->d_inode)
+      dcache_stats.hits++;
+    else
+      dcache_stats.negative_hits++;
+    irq_restore(flags);
+    return iter;
+  }
+  dcache_stats.misses++;
+  irq_restore(flags);
   return NULL;
 }
 
+// frees up to `count` unused dentries starting from the least recently used one,
+// their parents become unused and are freed by the next call
+uint32_t vfs_cache_shrink(uint32_t count) {
+  uint32_t freed = 0;
+  LIST_HEAD(victims);
+
+  uint32_t flags = irq_save();
+  struct vfs_dentry *iter, *next;
+  list_for_each_entry_safe(iter, next, &dentry_lru, d_lru) {
+    if (freed == count)
+      break;
+    // mount points and device nodes under the directory
+    if (!list_empty(&iter->d_subdirs))
+      continue;
+
+    list_del(&iter->d_lru);
+    list_add_tail(&iter->d_lru, &victims);
+    list_del_init(&iter->d_sibling);
+    dcache_stats.unused--;
+    d_unhash(iter);
+    freed++;
+  }
+  dcache_stats.shrunk += freed;
+  irq_restore(flags);
+
+  // inode might be written back
+  list_for_each_entry_safe(iter, next, &victims, d_lru) {
+    struct vfs_dentry *parent = iter->d_parent;
+    d_free(iter);
+    dput(parent);
+  }
+
+  return freed;
+}
+
+struct dcache_stats *get_dcache_stats() {
+  return &dcache_stats;
+}
+
 void vfs_cache_init() {
-  INIT_LIST_HEAD(&all_dentries);
-}
\ No newline at end of file
+  for (uint32_t i = 0; i < DCACHE_HASH_SIZE; ++i)
+    INIT_LIST_HEAD(&dentry_hashtable[i]);
+}
@@ -7,4 +7,6 @@ struct vfs_file_operations devfs_file_operations = {};
 
 struct vfs_file_operations devfs_dir_operations = {
 	.readdir = generic_memory_readdir,
+	.readdirplus = generic_memory_readdirplus,
+	.llseek = vfs_generic_llseek,
 };
\ No newline at end of file
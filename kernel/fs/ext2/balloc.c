@@ -0,0 +1,366 @@
+#include "kernel/include/errno.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/math.h"
+#include "kernel/util/string/string.h"
+
+#include "kernel/fs/ext2/ext2.h"
+
+// bitmaps are read on first use and stay in memory, allocation only marks the group dirty and
+// ext2_sync_metadata writes it back. Each group keeps the lowest free bit and the longest free run.
+// Blocks are allocated near a goal, up to EXT2_PREALLOC_BLOCKS following ones are reserved for the file.
+// s_lock is held by allocation, freeing and sync, bitmap accessors, ext2_take_block and
+// ext2_sync_groups expect the caller to hold it
+#define BITS_PER_WORD 32
+
+// returns index of the first zero bit at or after `offset`, `size` if there is none
+uint32_t ext2_find_next_zero_bit(const uint32_t *map, uint32_t size, uint32_t offset) {
+  uint32_t index = offset / BITS_PER_WORD;
+  if (offset >= size)
+    return size;
+
+  // bits below offset in the first word count as used
+  uint32_t word = map[index] | ((1u << (offset % BITS_PER_WORD)) - 1);
+  while (word == 0xFFFFFFFF) {
+    if (++index * BITS_PER_WORD >= size)
+      return size;
+    word = map[index];
+  }
+
+  uint32_t bit = index * BITS_PER_WORD + __builtin_ctz(~word);
+  return min_t(uint32_t, bit, size);
+}
+
+static uint32_t ext2_find_next_bit(const uint32_t *map, uint32_t size, uint32_t offset) {
+  uint32_t index = offset / BITS_PER_WORD;
+  if (offset >= size)
+    return size;
+
+  uint32_t word = map[index] & ~((1u << (offset % BITS_PER_WORD)) - 1);
+  while (!word) {
+    if (++index * BITS_PER_WORD >= size)
+      return size;
+    word = map[index];
+  }
+
+  uint32_t bit = index * BITS_PER_WORD + __builtin_ctz(word);
+  return min_t(uint32_t, bit, size);
+}
+
+static inline void set_bit(uint32_t *map, uint32_t bit) {
+  map[bit / BITS_PER_WORD] |= 1u << (bit % BITS_PER_WORD);
+}
+
+static inline void clear_bit(uint32_t *map, uint32_t bit) {
+  map[bit / BITS_PER_WORD] &= ~(1u << (bit % BITS_PER_WORD));
+}
+
+static inline bool test_bit(const uint32_t *map, uint32_t bit) {
+  return map[bit / BITS_PER_WORD] & (1u << (bit % BITS_PER_WORD));
+}
+
+// the last group can be shorter
+static uint32_t ext2_group_blocks(ext2_superblock *ext2_sb, uint32_t group) {
+  uint32_t start = group * ext2_sb->s_blocks_per_group;
+  return min_t(uint32_t, ext2_sb->s_blocks_per_group,
+               ext2_sb->s_blocks_count - ext2_sb->s_first_data_block - start);
+}
+
+int ext2_load_groups(struct vfs_superblock *sb) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  ext2_fs_info *mi = EXT2_INFO(sb);
+
+  mi->nr_groups = div_ceil(ext2_sb->s_blocks_count - ext2_sb->s_first_data_block, ext2_sb->s_blocks_per_group);
+  mi->gdt_blocks = div_ceil(mi->nr_groups * sizeof(ext2_group_desc), sb->s_blocksize);
+  // refere GDT from first block group as other GDTs are just copies
+  mi->gdt = (ext2_group_desc *)ext2_bread(sb, EXT2_GDT_BLOCK(ext2_sb), mi->gdt_blocks * sb->s_blocksize);
+  mi->groups = kcalloc(mi->nr_groups, sizeof(ext2_group_info));
+  if (!mi->gdt || !mi->groups)
+    return -ENOMEM;
+
+  return 0;
+}
+
+ext2_group_desc *ext2_get_group_desc(struct vfs_superblock *sb, uint32_t group) {
+  ext2_fs_info *mi = EXT2_INFO(sb);
+  assert(group < mi->nr_groups, "group %d is out of range", group);
+  return &mi->gdt[group];
+}
+
+void ext2_mark_group_dirty(struct vfs_superblock *sb, uint32_t group, uint32_t flags) {
+  EXT2_INFO(sb)->groups[group].dirty |= flags;
+  // free counters in superblock always change together with the group
+  sb->s_dirt = true;
+}
+
+// longest run of free blocks, it is only a hint for the allocator
+static void ext2_scan_free_run(struct vfs_superblock *sb, uint32_t group) {
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+  uint32_t size = ext2_group_blocks(EXT2_SB(sb), group);
+
+  gi->free_run_start = gi->free_run_len = 0;
+  for (uint32_t start = ext2_find_next_zero_bit(gi->block_bitmap, size, gi->block_hint); start < size;) {
+    uint32_t end = ext2_find_next_bit(gi->block_bitmap, size, start);
+    if (end - start > gi->free_run_len) {
+      gi->free_run_start = start;
+      gi->free_run_len = end - start;
+    }
+    start = ext2_find_next_zero_bit(gi->block_bitmap, size, end);
+  }
+}
+
+uint32_t *ext2_block_bitmap(struct vfs_superblock *sb, uint32_t group) {
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+
+  if (!gi->block_bitmap) {
+    gi->block_bitmap = (uint32_t *)ext2_bread_block(sb, ext2_get_group_desc(sb, group)->bg_block_bitmap);
+    gi->block_hint = ext2_find_next_zero_bit(gi->block_bitmap, ext2_group_blocks(EXT2_SB(sb), group), 0);
+    ext2_scan_free_run(sb, group);
+  }
+  return gi->block_bitmap;
+}
+
+uint32_t *ext2_inode_bitmap(struct vfs_superblock *sb, uint32_t group) {
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+
+  if (!gi->inode_bitmap) {
+    gi->inode_bitmap = (uint32_t *)ext2_bread_block(sb, ext2_get_group_desc(sb, group)->bg_inode_bitmap);
+    gi->inode_hint = ext2_find_next_zero_bit(gi->inode_bitmap, EXT2_SB(sb)->s_inodes_per_group, 0);
+  }
+  return gi->inode_bitmap;
+}
+
+// marks the block as used in bitmap and all counters
+void ext2_take_block(struct vfs_superblock *sb, uint32_t group, uint32_t bit) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+
+  set_bit(gi->block_bitmap, bit);
+  ext2_get_group_desc(sb, group)->bg_free_blocks_count--;
+  ext2_sb->s_free_blocks_count--;
+
+  if (bit == gi->block_hint)
+    gi->block_hint = ext2_find_next_zero_bit(gi->block_bitmap, ext2_group_blocks(ext2_sb, group), bit + 1);
+  if (gi->free_run_start <= bit && bit < gi->free_run_start + gi->free_run_len) {
+    // the longer side stays as the summary
+    uint32_t before = bit - gi->free_run_start;
+    uint32_t after = gi->free_run_start + gi->free_run_len - bit - 1;
+    if (after >= before)
+      gi->free_run_start = bit + 1;
+    gi->free_run_len = max_t(uint32_t, before, after);
+  }
+
+  ext2_mark_group_dirty(sb, group, EXT2_GROUP_DESC_DIRTY | EXT2_BLOCK_BITMAP_DIRTY);
+}
+
+static void __ext2_free_block(struct vfs_superblock *sb, uint32_t block) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  uint32_t group = get_group_from_block(ext2_sb, block);
+  uint32_t bit = get_relative_block_in_group(ext2_sb, block);
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+  uint32_t *bitmap = ext2_block_bitmap(sb, group);
+
+  assert(test_bit(bitmap, bit), "block %d is already free", block);
+  clear_bit(bitmap, bit);
+  ext2_get_group_desc(sb, group)->bg_free_blocks_count++;
+  ext2_sb->s_free_blocks_count++;
+
+  gi->block_hint = min_t(uint32_t, gi->block_hint, bit);
+  if (bit + 1 == gi->free_run_start) {
+    gi->free_run_start--;
+    gi->free_run_len++;
+  } else if (bit == gi->free_run_start + gi->free_run_len) {
+    gi->free_run_len++;
+  }
+
+  ext2_mark_group_dirty(sb, group, EXT2_GROUP_DESC_DIRTY | EXT2_BLOCK_BITMAP_DIRTY);
+}
+
+void ext2_free_block(struct vfs_superblock *sb, uint32_t block) {
+  semaphore_down(EXT2_INFO(sb)->s_lock);
+  __ext2_free_block(sb, block);
+  semaphore_up(EXT2_INFO(sb)->s_lock);
+}
+
+// free bit at or after the goal, then start of the longest free run in the group
+static uint32_t ext2_find_block_in_group(struct vfs_superblock *sb, uint32_t group, uint32_t goal_bit) {
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+  uint32_t *bitmap = ext2_block_bitmap(sb, group);
+  uint32_t size = ext2_group_blocks(EXT2_SB(sb), group);
+
+  uint32_t bit = ext2_find_next_zero_bit(bitmap, size, max_t(uint32_t, goal_bit, gi->block_hint));
+  if (bit < size && (bit == goal_bit || gi->free_run_len < EXT2_PREALLOC_BLOCKS))
+    return bit;
+  if (gi->free_run_len)
+    return gi->free_run_start;
+  return ext2_find_next_zero_bit(bitmap, size, gi->block_hint);
+}
+
+// returns number of the allocated block closest to the goal, -ENOSPC if the disk is full
+int32_t ext2_new_block(struct vfs_superblock *sb, uint32_t goal) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  ext2_fs_info *mi = EXT2_INFO(sb);
+
+  if (goal < ext2_sb->s_first_data_block || goal >= ext2_sb->s_blocks_count)
+    goal = ext2_sb->s_first_data_block;
+  uint32_t goal_group = get_group_from_block(ext2_sb, goal);
+
+  for (uint32_t i = 0; i < mi->nr_groups; ++i) {
+    uint32_t group = (goal_group + i) % mi->nr_groups;
+    if (!ext2_get_group_desc(sb, group)->bg_free_blocks_count)
+      continue;
+
+    uint32_t goal_bit = group == goal_group ? get_relative_block_in_group(ext2_sb, goal) : 0;
+    uint32_t bit = ext2_find_block_in_group(sb, group, goal_bit);
+    if (bit == ext2_group_blocks(ext2_sb, group))
+      continue;
+
+    ext2_take_block(sb, group, bit);
+    return group * ext2_sb->s_blocks_per_group + bit + ext2_sb->s_first_data_block;
+  }
+  return -ENOSPC;
+}
+
+// reserves free blocks which directly follow the block
+static void ext2_reserve_window(struct vfs_inode *inode, uint32_t block) {
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+  struct vfs_superblock *sb = inode->i_sb;
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  uint32_t group = get_group_from_block(ext2_sb, block);
+  uint32_t size = ext2_group_blocks(ext2_sb, group);
+  uint32_t *bitmap = ext2_block_bitmap(sb, group);
+
+  ii->prealloc_start = block + 1;
+  ii->prealloc_count = 0;
+  for (uint32_t bit = get_relative_block_in_group(ext2_sb, block) + 1;
+       bit < size && ii->prealloc_count < EXT2_PREALLOC_BLOCKS - 1 && !test_bit(bitmap, bit); ++bit) {
+    ext2_take_block(sb, group, bit);
+    ii->prealloc_count++;
+  }
+}
+
+static void __ext2_discard_prealloc(struct vfs_inode *inode) {
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+
+  for (uint32_t i = 0; i < ii->prealloc_count; ++i)
+    __ext2_free_block(inode->i_sb, ii->prealloc_start + i);
+  ii->prealloc_count = 0;
+}
+
+void ext2_discard_prealloc(struct vfs_inode *inode) {
+  semaphore_down(EXT2_INFO(inode->i_sb)->s_lock);
+  __ext2_discard_prealloc(inode);
+  semaphore_up(EXT2_INFO(inode->i_sb)->s_lock);
+}
+
+// goal 0 means after the last allocated block of the inode
+int32_t ext2_alloc_block(struct vfs_inode *inode, uint32_t goal) {
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+  struct vfs_superblock *sb = inode->i_sb;
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+
+  if (!goal && ii->last_block)
+    goal = ii->last_block + 1;
+  else if (!goal)
+    goal = get_group_from_inode(ext2_sb, inode->i_ino) * ext2_sb->s_blocks_per_group + ext2_sb->s_first_data_block;
+
+  int32_t block;
+  semaphore_down(EXT2_INFO(sb)->s_lock);
+  if (ii->prealloc_count && goal == ii->prealloc_start) {
+    block = ii->prealloc_start++;
+    ii->prealloc_count--;
+  } else {
+    // file is not written sequentially, reservation is useless
+    __ext2_discard_prealloc(inode);
+    block = ext2_new_block(sb, goal);
+    if (block >= 0 && S_ISREG(inode->i_mode))
+      ext2_reserve_window(inode, block);
+  }
+
+  if (block >= 0)
+    ii->last_block = block;
+  semaphore_up(EXT2_INFO(sb)->s_lock);
+  return block;
+}
+
+// returns number of the allocated inode, -ENOSPC if there is no free inode
+int32_t ext2_new_ino(struct vfs_superblock *sb, mode_t mode) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  ext2_fs_info *mi = EXT2_INFO(sb);
+
+  semaphore_down(mi->s_lock);
+  for (uint32_t group = 0; group < mi->nr_groups; ++group) {
+    ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+    if (!gdp->bg_free_inodes_count)
+      continue;
+
+    ext2_group_info *gi = &mi->groups[group];
+    uint32_t *bitmap = ext2_inode_bitmap(sb, group);
+    uint32_t bit = ext2_find_next_zero_bit(bitmap, ext2_sb->s_inodes_per_group, gi->inode_hint);
+    if (bit == ext2_sb->s_inodes_per_group)
+      continue;
+
+    set_bit(bitmap, bit);
+    gi->inode_hint = ext2_find_next_zero_bit(bitmap, ext2_sb->s_inodes_per_group, bit + 1);
+    gdp->bg_free_inodes_count--;
+    if (S_ISDIR(mode))
+      gdp->bg_used_dirs_count++;
+    ext2_sb->s_free_inodes_count--;
+    ext2_mark_group_dirty(sb, group, EXT2_GROUP_DESC_DIRTY | EXT2_INODE_BITMAP_DIRTY);
+
+    semaphore_up(mi->s_lock);
+    return group * ext2_sb->s_inodes_per_group + bit + EXT2_STARTING_INO;
+  }
+  semaphore_up(mi->s_lock);
+  return -ENOSPC;
+}
+
+void ext2_free_ino(struct vfs_superblock *sb, ino_t ino, mode_t mode) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  uint32_t group = get_group_from_inode(ext2_sb, ino);
+  uint32_t bit = get_relative_inode_in_group(ext2_sb, ino);
+  ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
+
+  semaphore_down(EXT2_INFO(sb)->s_lock);
+  uint32_t *bitmap = ext2_inode_bitmap(sb, group);
+  assert(test_bit(bitmap, bit), "inode %d is already free", ino);
+  clear_bit(bitmap, bit);
+  gdp->bg_free_inodes_count++;
+  if (S_ISDIR(mode))
+    gdp->bg_used_dirs_count--;
+  ext2_sb->s_free_inodes_count++;
+
+  ext2_group_info *gi = &EXT2_INFO(sb)->groups[group];
+  gi->inode_hint = min_t(uint32_t, gi->inode_hint, bit);
+  ext2_mark_group_dirty(sb, group, EXT2_GROUP_DESC_DIRTY | EXT2_INODE_BITMAP_DIRTY);
+  semaphore_up(EXT2_INFO(sb)->s_lock);
+}
+
+// writes changed bitmaps and blocks of descriptor table
+void ext2_sync_groups(struct vfs_superblock *sb) {
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  ext2_fs_info *mi = EXT2_INFO(sb);
+  uint32_t descs_per_block = EXT2_GROUP_DESC_PER_BLOCK(ext2_sb);
+
+  for (uint32_t gdt_block = 0; gdt_block < mi->gdt_blocks; ++gdt_block) {
+    bool gdt_dirty = false;
+
+    for (uint32_t group = gdt_block * descs_per_block;
+         group < mi->nr_groups && group < (gdt_block + 1) * descs_per_block; ++group) {
+      ext2_group_info *gi = &mi->groups[group];
+      ext2_group_desc *gdp = &mi->gdt[group];
+      // cleared before writing, a change made meanwhile marks the group dirty again
+      uint32_t dirty = gi->dirty;
+      gi->dirty = 0;
+
+      if (dirty & EXT2_BLOCK_BITMAP_DIRTY)
+        ext2_bwrite_block(sb, gdp->bg_block_bitmap, (char *)gi->block_bitmap);
+      if (dirty & EXT2_INODE_BITMAP_DIRTY)
+        ext2_bwrite_block(sb, gdp->bg_inode_bitmap, (char *)gi->inode_bitmap);
+      gdt_dirty |= dirty & EXT2_GROUP_DESC_DIRTY;
+    }
+
+    if (gdt_dirty)
+      ext2_bwrite_block(sb, EXT2_GDT_BLOCK(ext2_sb) + gdt_block, (char *)mi->gdt + gdt_block * sb->s_blocksize);
+  }
+}
@@ -0,0 +1,111 @@
+#include <test/greatest.h>
+
+#include "kernel/include/errno.h"
+#include "kernel/fs/ext2/ext2.h"
+
+#define TEST_GROUPS 2
+#define TEST_GROUP_BLOCKS 64
+
+static ext2_superblock ext2_sb;
+static ext2_fs_info fs_info;
+static struct vfs_superblock sb;
+static ext2_group_desc gdt[TEST_GROUPS];
+static ext2_group_info groups[TEST_GROUPS];
+static uint32_t bitmaps[TEST_GROUPS][TEST_GROUP_BLOCKS / 32];
+
+// bitmaps are already in memory, so nothing is read from a disk
+static void setup_groups(void) {
+  memset(&ext2_sb, 0, sizeof(ext2_sb));
+  memset(gdt, 0, sizeof(gdt));
+  memset(groups, 0, sizeof(groups));
+  memset(bitmaps, 0, sizeof(bitmaps));
+
+  ext2_sb.s_first_data_block = 1;
+  ext2_sb.s_blocks_per_group = TEST_GROUP_BLOCKS;
+  ext2_sb.s_blocks_count = TEST_GROUPS * TEST_GROUP_BLOCKS + 1;
+  fs_info.sb = &ext2_sb;
+  fs_info.gdt = gdt;
+  fs_info.nr_groups = TEST_GROUPS;
+  fs_info.groups = groups;
+  sb.s_fs_info = &fs_info;
+
+  // first 16 blocks of group 0 are used, the rest of the disk is free
+  bitmaps[0][0] = 0x0000FFFF;
+  for (uint32_t group = 0; group < TEST_GROUPS; ++group) {
+    groups[group].block_bitmap = bitmaps[group];
+    gdt[group].bg_free_blocks_count = TEST_GROUP_BLOCKS;
+    groups[group].free_run_len = TEST_GROUP_BLOCKS;
+  }
+  gdt[0].bg_free_blocks_count = TEST_GROUP_BLOCKS - 16;
+  groups[0].block_hint = groups[0].free_run_start = 16;
+  groups[0].free_run_len = TEST_GROUP_BLOCKS - 16;
+  ext2_sb.s_free_blocks_count = 2 * TEST_GROUP_BLOCKS - 16;
+}
+
+TEST TEST_EXT2_FIND_NEXT_ZERO_BIT(void) {
+  uint32_t map[2] = {0xFFFF00FF, 0x0000000F};
+
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 64, 0), 8);
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 64, 9), 9);
+  // the rest of the first word is used
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 64, 16), 36);
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 64, 63), 63);
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 64, 64), 64);
+  // bits after size don't count
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 34, 16), 34);
+
+  map[0] = map[1] = 0xFFFFFFFF;
+  ASSERT_EQ(ext2_find_next_zero_bit(map, 64, 0), 64);
+
+  PASS();
+}
+
+TEST TEST_EXT2_TAKE_BLOCK(void) {
+  setup_groups();
+
+  // the longer side of the free run is kept
+  ext2_take_block(&sb, 0, 20);
+  ASSERT_EQ(groups[0].free_run_start, 21);
+  ASSERT_EQ(groups[0].free_run_len, 43);
+  ASSERT_EQ(groups[0].block_hint, 16);
+
+  ext2_take_block(&sb, 0, 60);
+  ASSERT_EQ(groups[0].free_run_start, 21);
+  ASSERT_EQ(groups[0].free_run_len, 39);
+
+  ext2_take_block(&sb, 0, 16);
+  ASSERT_EQ(groups[0].block_hint, 17);
+  ASSERT_EQ(gdt[0].bg_free_blocks_count, TEST_GROUP_BLOCKS - 19);
+  ASSERT_EQ(ext2_sb.s_free_blocks_count, 2 * TEST_GROUP_BLOCKS - 19);
+  ASSERT(groups[0].dirty & EXT2_BLOCK_BITMAP_DIRTY);
+  ASSERT(sb.s_dirt);
+
+  PASS();
+}
+
+TEST TEST_EXT2_NEW_BLOCK(void) {
+  setup_groups();
+
+  // free goal is taken as it is
+  ASSERT_EQ(ext2_new_block(&sb, 31), 31);
+  ASSERT_EQ(ext2_new_block(&sb, 31), 32);
+  // used goal moves to the longest free run instead of the first free block
+  ASSERT_EQ(ext2_new_block(&sb, 5), 33);
+  ASSERT_EQ(ext2_new_block(&sb, 0), 34);
+  ASSERT_EQ(groups[0].block_hint, 16);
+
+  // full group is skipped
+  gdt[0].bg_free_blocks_count = 0;
+  ASSERT_EQ(ext2_new_block(&sb, 40), 1 + TEST_GROUP_BLOCKS);
+
+  gdt[1].bg_free_blocks_count = 0;
+  ASSERT_EQ(ext2_new_block(&sb, 40), -ENOSPC);
+
+  PASS();
+}
+
+SUITE(SUITE_EXT2_BALLOC) {
+  RUN_TEST(TEST_EXT2_FIND_NEXT_ZERO_BIT);
+  RUN_TEST(TEST_EXT2_TAKE_BLOCK);
+  RUN_TEST(TEST_EXT2_NEW_BLOCK);
+}
@@ -0,0 +1,145 @@
+#include "kernel/include/errno.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/util/debug.h"
+
+#include "kernel/fs/ext2/ext2.h"
+
+// inode keeps the last indirect block it went through on each level, so sequential access
+// walks the path from memory. Changed indirect blocks are written with the inode
+
+// fills offsets on each level of the tree, returns its depth (0 for direct block)
+static int ext2_block_to_path(struct vfs_superblock *sb, uint32_t iblock, uint32_t offsets[EXT2_MAX_DATA_LEVEL + 1]) {
+  uint32_t ppb = sb->s_blocksize / sizeof(uint32_t);
+
+  if (iblock < EXT2_NDIR_BLOCKS) {
+    offsets[0] = iblock;
+    return 0;
+  }
+  iblock -= EXT2_NDIR_BLOCKS;
+  if (iblock < ppb) {
+    offsets[0] = EXT2_IND_BLOCK;
+    offsets[1] = iblock;
+    return 1;
+  }
+  iblock -= ppb;
+  if (iblock < ppb * ppb) {
+    offsets[0] = EXT2_DIND_BLOCK;
+    offsets[1] = iblock / ppb;
+    offsets[2] = iblock % ppb;
+    return 2;
+  }
+  iblock -= ppb * ppb;
+  if (iblock / ppb / ppb < ppb) {
+    offsets[0] = EXT2_TIND_BLOCK;
+    offsets[1] = iblock / ppb / ppb;
+    offsets[2] = (iblock / ppb) % ppb;
+    offsets[3] = iblock % ppb;
+    return 3;
+  }
+  return -EFBIG;
+}
+
+static void ext2_bmap_write(struct vfs_superblock *sb, ext2_bmap_path *path) {
+  if (!path->dirty)
+    return;
+  path->dirty = false;
+  ext2_bwrite_block(sb, path->block, (char *)path->data);
+}
+
+// indirect block on the level is kept in the inode, new one is only zeroed in memory
+static uint32_t *ext2_bmap_get(struct vfs_inode *inode, int level, uint32_t block, bool new) {
+  ext2_bmap_path *path = &EXT2_INODE_INFO(inode)->path[level];
+  struct vfs_superblock *sb = inode->i_sb;
+
+  if (path->data && path->block == block)
+    return path->data;
+
+  uint32_t *data = new ? kcalloc(sb->s_blocksize, sizeof(char)) : (uint32_t *)ext2_bread_block(sb, block);
+  ext2_bmap_write(sb, path);
+  kfree(path->data);
+  path->block = block;
+  path->data = data;
+  path->dirty = new;
+  return data;
+}
+
+/*
+  returns physical block of the logical block, 0 if it is a hole.
+  With `create`, missing indirect and data blocks are allocated, `new` is set when the data
+  block is fresh and its content on disk is garbage
+*/
+static int32_t ext2_bmap_walk(struct vfs_inode *inode, uint32_t iblock, bool create, bool *new) {
+  ext2_inode *ei = EXT2_INODE(inode);
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+  uint32_t offsets[EXT2_MAX_DATA_LEVEL + 1];
+  int depth = ext2_block_to_path(inode->i_sb, iblock, offsets);
+  if (depth < 0)
+    return depth;
+
+  // data block continues after the previous block of the file
+  if (create && iblock && !ii->last_block) {
+    int32_t prev = ext2_bmap_walk(inode, iblock - 1, false, NULL);
+    ii->last_block = prev > 0 ? prev : 0;
+  }
+
+  uint32_t *slot = &ei->i_block[offsets[0]];
+  ext2_bmap_path *parent = NULL;
+  for (int level = 0; level <= depth; ++level) {
+    bool fresh = false;
+
+    if (!*slot) {
+      if (!create)
+        return 0;
+
+      int32_t block = ext2_alloc_block(inode, 0);
+      if (block < 0)
+        return block;
+      *slot = block;
+      fresh = true;
+      if (parent)
+        parent->dirty = true;
+      mark_inode_dirty(inode);
+    }
+
+    if (level == depth) {
+      if (new)
+        *new = fresh;
+      return *slot;
+    }
+
+    uint32_t *data = ext2_bmap_get(inode, level, *slot, fresh);
+    parent = &ii->path[level];
+    slot = &data[offsets[level + 1]];
+  }
+  assert_not_reached();
+  return -EINVAL;
+}
+
+// indirect blocks kept in the inode are shared by all users of the file, so the whole walk is locked
+int32_t ext2_bmap(struct vfs_inode *inode, uint32_t iblock, bool create, bool *new) {
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+
+  semaphore_down(ii->bmap_lock);
+  int32_t block = ext2_bmap_walk(inode, iblock, create, new);
+  semaphore_up(ii->bmap_lock);
+  return block;
+}
+
+void ext2_bmap_sync(struct vfs_inode *inode) {
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+
+  semaphore_down(ii->bmap_lock);
+  for (int level = 0; level < EXT2_MAX_DATA_LEVEL; ++level)
+    ext2_bmap_write(inode->i_sb, &ii->path[level]);
+  semaphore_up(ii->bmap_lock);
+}
+
+void ext2_bmap_release(struct vfs_inode *inode) {
+  ext2_inode_info *ii = EXT2_INODE_INFO(inode);
+
+  ext2_bmap_sync(inode);
+  for (int level = 0; level < EXT2_MAX_DATA_LEVEL; ++level) {
+    kfree(ii->path[level].data);
+    ii->path[level].data = NULL;
+  }
+}
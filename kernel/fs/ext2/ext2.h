@@ -18,11 +18,26 @@
 #include "kernel/include/types.h"
 
 #include "kernel/fs/vfs.h"
+#include "kernel/locking/semaphore.h"
+#include "kernel/memory/pmm.h"
 
 #define EXT2_SUPER_MAGIC 0xEF53
 #define EXT2_STARTING_INO 1
 #define EXT2_MAX_DATA_LEVEL 3
+// indices in i_block
+#define EXT2_NDIR_BLOCKS 12
+#define EXT2_IND_BLOCK 12
+#define EXT2_DIND_BLOCK 13
+#define EXT2_TIND_BLOCK 14
 #define EXT2_SUPERRBLOCK_POS (1024 / BYTES_PER_SECTOR)
+#define SUPERBLOCK_SIZE_BLOCKS 1
+#define EXT2_GDT_BLOCK(sb) ((sb)->s_first_data_block + SUPERBLOCK_SIZE_BLOCKS)
+
+#define EXT2_PREALLOC_BLOCKS 8
+
+#define EXT2_GROUP_DESC_DIRTY 0x01
+#define EXT2_BLOCK_BITMAP_DIRTY 0x02
+#define EXT2_INODE_BITMAP_DIRTY 0x04
 
 #define EXT2_DIR_PAD 4
 #define EXT2_DIR_ROUND (EXT2_DIR_PAD - 1)
@@ -31,6 +46,8 @@
 
 #define EXT2_MIN_BLOCK_SIZE 1024
 #define EXT2_MAX_BLOCK_SIZE 4096
+// optimal IO size reported by stat, not the fs block size
+#define EXT2_IO_SIZE PMM_FRAME_SIZE
 
 #define EXT2_BLOCK_SIZE(sb) (EXT2_MIN_BLOCK_SIZE << sb->s_log_block_size)
 #define EXT2_INODES_PER_BLOCK(sb) (EXT2_BLOCK_SIZE(sb) / sb->s_inode_size)
@@ -68,6 +85,21 @@
 #define EXT2_FEATURE_RO_COMPAT_LARGE_FILE   0x0002	// Large file support, 64-bit file size
 #define EXT2_FEATURE_RO_COMPAT_BTREE_DIR    0x0004	// Binary tree sorted directory files
 
+// s_flags
+#define EXT2_FLAGS_SIGNED_HASH   0x0001
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002
+
+// directory hash versions (HTREE)
+#define EXT2_HASH_LEGACY            0
+#define EXT2_HASH_HALF_MD4          1
+#define EXT2_HASH_TEA               2
+#define EXT2_HASH_LEGACY_UNSIGNED   3
+#define EXT2_HASH_HALF_MD4_UNSIGNED 4
+#define EXT2_HASH_TEA_UNSIGNED      5
+#define EXT2_HTREE_EOF 0x7fffffff
+// levels of index nodes below root
+#define EXT2_HTREE_MAX_LEVELS 2
+
 // known reserved inode entries
 #define EXT2_BAD_INO	                  1	// bad blocks inode
 #define EXT2_ROOT_INO	                  2	// root directory inode
@@ -179,7 +211,13 @@ typedef struct {
 	uint16_t s_reserved_word_pad;
 	uint32_t s_default_mount_opts;
 	uint32_t s_first_meta_bg; /* First metablock block group */
-	uint32_t s_reserved[190]; /* Padding to the end of the block */
+	uint32_t s_mkfs_time;
+	uint32_t s_jnl_blocks[17];
+	uint32_t s_reserved_hi[3];  /* High words of block counts (ext4) */
+	uint16_t s_min_extra_isize;
+	uint16_t s_want_extra_isize;
+	uint32_t s_flags;         /* Miscellaneous flags, signedness of directory hash */
+	uint32_t s_reserved[167]; /* Padding to the end of the block */
 } ext2_superblock;
 
 typedef struct {
@@ -260,8 +298,54 @@ typedef struct ext2_inode {
 	} osd2; /* OS dependent 2 */
 } ext2_inode;
 
+// indirect block which the last lookup went through
+typedef struct {
+	uint32_t block;
+	uint32_t *data;
+	bool dirty;
+} ext2_bmap_path;
+
+// in-memory part of inode, raw inode goes first so EXT2_INODE works on it
+typedef struct {
+	ext2_inode raw;
+	uint32_t last_block;      /* Goal for the next allocation */
+	uint32_t prealloc_start;  /* Blocks reserved in bitmap but not used by the file yet */
+	uint32_t prealloc_count;
+	ext2_bmap_path path[EXT2_MAX_DATA_LEVEL];  /* One indirect block per level of the tree */
+	struct semaphore *bmap_lock;               /* Held while the path is walked or changed */
+} ext2_inode_info;
+
 #define EXT2_NAME_LEN 255
 
+/*
+  HTREE index, root is in the first block of directory behind "." and ".." entries,
+  nodes are blocks with one empty entry over the whole block. Old implementations see
+  both as ordinary directory blocks. Entries point to logical blocks of directory, the
+  first one has no hash, its place holds limit and count.
+*/
+typedef struct {
+	uint32_t reserved_zero;
+	uint8_t hash_version;
+	uint8_t info_length;  /* 8 */
+	uint8_t indirect_levels;
+	uint8_t unused_flags;
+} ext2_dx_root_info;
+
+typedef struct {
+	uint32_t hash;
+	uint32_t block;
+} ext2_dx_entry;
+
+typedef struct {
+	uint16_t limit;
+	uint16_t count;
+	uint32_t block;
+} ext2_dx_countlimit;
+
+// "." and ".." entries with minimal length
+#define EXT2_DX_ROOT_HEADER (EXT2_DIR_REC_LEN(1) + EXT2_DIR_REC_LEN(2))
+#define EXT2_DX_NODE_HEADER 8
+
 typedef struct {
 	uint32_t ino;	    /* Inode number */
   // TODO: SA 2023-12-19 sum of all rec_len's has to be equal to a block size?
@@ -271,10 +355,26 @@ typedef struct {
 	char name[];
 } ext2_dir_entry;
 
+// in-memory state of a block group, bitmaps are read on first use
+typedef struct {
+  uint32_t *block_bitmap;
+  uint32_t *inode_bitmap;
+  uint32_t block_hint;  // no free block below
+  uint32_t inode_hint;
+  uint32_t free_run_start;  // free extent summary, a run of free blocks
+  uint32_t free_run_len;
+  uint32_t dirty;
+} ext2_group_info;
+
 typedef struct {
   ext2_superblock* sb;
   uint64_t ino_upper_levels[4];
   bool is_readonly;
+  ext2_group_desc *gdt;
+  uint32_t gdt_blocks;
+  uint32_t nr_groups;
+  ext2_group_info *groups;
+  struct semaphore *s_lock;  // Held while bitmaps, counters or reservations are changed or written
 } ext2_fs_info;
 
 static inline ext2_fs_info* EXT2_INFO(struct vfs_superblock *sb) {
@@ -289,6 +389,10 @@ static inline ext2_inode* EXT2_INODE(struct vfs_inode *inode) {
 	return (ext2_inode*)inode->i_fs_info;
 }
 
+static inline ext2_inode_info* EXT2_INODE_INFO(struct vfs_inode *inode) {
+	return (ext2_inode_info*)inode->i_fs_info;
+}
+
 // super.c
 void ext2_init_fs();
 void ext2_init_fs();
@@ -296,19 +400,54 @@ char *ext2_bread_block(struct vfs_superblock *sb, uint32_t iblock);
 char *ext2_bread(struct vfs_superblock *sb, uint32_t iblock, uint32_t size);
 void ext2_bwrite_block(struct vfs_superblock *sb, uint32_t iblock, char *buf);
 void ext2_bwrite(struct vfs_superblock *sb, uint32_t iblock, char *buf, uint32_t size);
-uint32_t ext2_create_block(struct vfs_superblock *sb);
+int32_t ext2_create_block(struct vfs_inode *inode, uint32_t goal, bool zero);
+void ext2_sync_metadata(struct vfs_superblock *sb);
 
 void ext2_read_inode(struct vfs_inode* i);
 void ext2_write_inode(struct vfs_inode* i);
+uint32_t ext2_inode_location(struct vfs_superblock *sb, ino_t ino, uint32_t *offset);
 struct ext2_inode* ext2_get_inode(struct vfs_superblock* sb, ino_t ino);
+ext2_inode_info *ext2_new_inode_info();
+
+// balloc.c
+uint32_t ext2_find_next_zero_bit(const uint32_t *map, uint32_t size, uint32_t offset);
+int ext2_load_groups(struct vfs_superblock *sb);
 ext2_group_desc *ext2_get_group_desc(struct vfs_superblock* sb, uint32_t group);
-void ext2_write_group_desc(struct vfs_superblock *sb, ext2_group_desc *gdp);
+void ext2_mark_group_dirty(struct vfs_superblock *sb, uint32_t group, uint32_t flags);
+uint32_t *ext2_block_bitmap(struct vfs_superblock *sb, uint32_t group);
+uint32_t *ext2_inode_bitmap(struct vfs_superblock *sb, uint32_t group);
+void ext2_take_block(struct vfs_superblock *sb, uint32_t group, uint32_t bit);
+int32_t ext2_new_block(struct vfs_superblock *sb, uint32_t goal);
+void ext2_free_block(struct vfs_superblock *sb, uint32_t block);
+int32_t ext2_alloc_block(struct vfs_inode *inode, uint32_t goal);
+void ext2_discard_prealloc(struct vfs_inode *inode);
+int32_t ext2_new_ino(struct vfs_superblock *sb, mode_t mode);
+void ext2_free_ino(struct vfs_superblock *sb, ino_t ino, mode_t mode);
+void ext2_sync_groups(struct vfs_superblock *sb);
+
+// bmap.c
+int32_t ext2_bmap(struct vfs_inode *inode, uint32_t iblock, bool create, bool *new);
+void ext2_bmap_sync(struct vfs_inode *inode);
+void ext2_bmap_release(struct vfs_inode *inode);
+
+// hash.c
+uint32_t ext2_dirhash(struct vfs_superblock *sb, int version, const char *name, int len);
+
+// htree.c
+bool ext2_dx_supported(struct vfs_superblock *sb);
+int ext2_dx_find_entry(struct vfs_inode *dir, const char *name,
+                       int (*action)(struct vfs_superblock *, uint32_t, void *), void *arg);
+int ext2_dx_add_entry(struct vfs_inode *dir, struct vfs_dentry *dentry);
+int ext2_dx_make_indexed(struct vfs_inode *dir);
+void ext2_dx_clear(struct vfs_inode *dir);
 
 // file.c
 uint32_t ext2_read_file(struct vfs_file* file, char *buf, size_t count, off_t ppos);
 struct vfs_inode* ext2_alloc_inode(struct vfs_superblock* sb);
+void ext2_destroy_inode(struct vfs_inode* i);
 
 // inode.c
+int ext2_add_entry(struct vfs_superblock *sb, uint32_t block, void *arg);
 extern struct vfs_inode_operations ext2_dir_inode_operations;
 extern struct vfs_inode_operations ext2_file_inode_operations;
 extern struct vfs_inode_operations ext2_special_inode_operations;
@@ -2,78 +2,56 @@
 
 #include "kernel/fs/ext2/ext2.h"
 #include "kernel/fs/vfs.h"
+#include "kernel/memory/malloc.h"
 #include "kernel/util/math.h"
 #include "kernel/util/debug.h"
 #include "kernel/util/string/string.h"
 #include "kernel/include/limits.h"
 #include "kernel/include/fcntl.h"
 
-static void ext2_read_nth_block(
-  struct vfs_superblock *sb, uint32_t block, char **iter_buf, 
-  off_t ppos, uint32_t *p, size_t count, int level
-) {
-	assert(level <= EXT2_MAX_DATA_LEVEL);
-  uint32_t blocksize = sb->s_blocksize;
-  assert(blocksize % sizeof(uint32_t) == 0);
-
-  if (level == 0) {
-    char *block_buf = ext2_bread_block(sb, block);
-		int32_t pstart = (ppos > *p) ? ppos - *p : 0;
-		uint32_t pend = ((ppos + count) < (*p + blocksize)) ? (*p + blocksize - ppos - count) : 0;
-		memcpy(*iter_buf, block_buf + pstart, blocksize - pstart - pend);
-    kfree(block_buf);
-		*p += blocksize;
-		*iter_buf += blocksize - pstart - pend;
-    return;
-  }
-
-  uint32_t *block_buf = (uint32_t *)ext2_bread_block(sb, block);
-  for (uint32_t i = 0, times = blocksize / sizeof(uint32_t); *p < ppos + count && i < times; ++i) {
-    ext2_read_nth_block(sb, block_buf[i], iter_buf, ppos, p, count, level - 1);
-  }
-  kfree(block_buf);
-}
-// need 
 uint32_t ext2_write_file(struct vfs_file *file, const char *buf, size_t count, off_t ppos) {
 	struct vfs_inode *inode = file->f_dentry->d_inode;
 	struct ext2_inode *ei = EXT2_INODE(inode);
 	struct vfs_superblock *sb = inode->i_sb;
-  ext2_fs_info* mi = EXT2_INFO(sb);
-
-	if (ppos + count > inode->i_size) {
-		inode->i_size = ppos + count;
-    ei->i_size = inode->i_size;
-		inode->i_blocks = div_ceil(ppos + count, sb->s_blocksize /*BYTES_PER_SECTOR*/);
-		sb->s_op->write_inode(inode);
-	}
 
 	uint32_t p = (ppos / sb->s_blocksize) * sb->s_blocksize;
-	char *iter_buf = buf;
+	const char *iter_buf = buf;
+	int32_t ret = 0;
 	while (p < ppos + count) {
-		uint32_t relative_block = p / sb->s_blocksize;
-		uint32_t block = 0;
-		// FIXME: MQ 2019-07-18 Only support direct blocks
-		if (relative_block < mi->ino_upper_levels[0]) {
-			block = ei->i_block[relative_block];
-			if (!block) {
-				block = ext2_create_block(sb);
-				ei->i_block[relative_block] = block;
-				inode->i_mtime.tv_sec = get_seconds(NULL);
-				sb->s_op->write_inode(inode);
-			}
-		} else {
-			assert_not_reached("Only support direct blocks, fail writing at %d-nth block", relative_block);
-    }
-
-		char *block_buf = ext2_bread_block(sb, block);
+		bool new_block = false;
+		int32_t block = ext2_bmap(inode, p / sb->s_blocksize, true, &new_block);
+		if (block < 0) {
+			ret = block;
+			break;
+		}
+		if (new_block)
+			inode->i_mtime.tv_sec = get_seconds(NULL);
+
+		// new block is not zeroed on disk, the whole block is written from a zeroed buffer
+		char *block_buf = new_block ? kcalloc(sb->s_blocksize, sizeof(char)) : ext2_bread_block(sb, block);
 		uint32_t pstart = (ppos > p) ? ppos - p : 0;
 		uint32_t pend = ((ppos + count) < (p + sb->s_blocksize)) ? (p + sb->s_blocksize - ppos - count) : 0;
 		memcpy(block_buf + pstart, iter_buf, sb->s_blocksize - pstart - pend);
 		ext2_bwrite_block(sb, block, block_buf);
+		kfree(block_buf);
 		p += sb->s_blocksize;
 		iter_buf += sb->s_blocksize - pstart - pend;
 	}
 
+	// file is extended only by what has been written when the disk is full
+	count = iter_buf - buf;
+	if (ppos + count > inode->i_size) {
+		inode->i_size = ppos + count;
+		ei->i_size = inode->i_size;
+		inode->i_blocks = div_ceil(ppos + count, sb->s_blocksize /*BYTES_PER_SECTOR*/);
+		mark_inode_dirty(inode);
+	}
+
+	// inode, indirect blocks and allocation metadata are written once per call instead of once per new block
+	write_inode_now(inode);
+	ext2_sync_metadata(sb);
+	if (!count && ret < 0)
+		return ret;
 	file->f_pos = ppos + count;
 	return count;
 }
@@ -82,24 +60,29 @@ uint32_t ext2_read_file(struct vfs_file* file, char *buf, size_t count, off_t pp
 	struct vfs_inode* inode = file->f_dentry->d_inode;
   ext2_inode* ei = EXT2_INODE(inode);
 	struct vfs_superblock* sb = inode->i_sb;
-  ext2_fs_info* mi = EXT2_INFO(sb);
+
+	if (ppos >= ei->i_size)
+		return 0;
 
 	count = min_t(size_t, ppos + count, ei->i_size) - ppos;
 	uint32_t p = (ppos / sb->s_blocksize) * sb->s_blocksize;
 	char *iter_buf = buf;
 
 	while (p < ppos + count) {
-		uint32_t relative_block = p / sb->s_blocksize;
-    if (relative_block < mi->ino_upper_levels[0])
-			ext2_read_nth_block(sb, ei->i_block[relative_block], &iter_buf, ppos, &p, count, 0);
-		else if (relative_block < mi->ino_upper_levels[1])
-			ext2_read_nth_block(sb, ei->i_block[12], &iter_buf, ppos, &p, count, 1);
-		else if (relative_block < mi->ino_upper_levels[2])
-			ext2_read_nth_block(sb, ei->i_block[13], &iter_buf, ppos, &p, count, 2);
-		else if (relative_block < mi->ino_upper_levels[3])
-			ext2_read_nth_block(sb, ei->i_block[14], &iter_buf, ppos, &p, count, 3);
-		else
-      assert_not_reached();
+		uint32_t pstart = (ppos > p) ? ppos - p : 0;
+		uint32_t pend = ((ppos + count) < (p + sb->s_blocksize)) ? (p + sb->s_blocksize - ppos - count) : 0;
+		int32_t block = ext2_bmap(inode, p / sb->s_blocksize, false, NULL);
+
+		// hole reads as zeros
+		if (block > 0) {
+			char *block_buf = ext2_bread_block(sb, block);
+			memcpy(iter_buf, block_buf + pstart, sb->s_blocksize - pstart - pend);
+			kfree(block_buf);
+		} else {
+			memset(iter_buf, 0, sb->s_blocksize - pstart - pend);
+		}
+		p += sb->s_blocksize;
+		iter_buf += sb->s_blocksize - pstart - pend;
 	}
 
 	file->f_pos = ppos + count;
@@ -127,80 +110,132 @@ static int ext2_mode_to_vfs(int ft) {
   }
 }
 
-int ext2_readdir(struct vfs_file *file, struct dirent* dirent, uint32_t count) {
-  struct vfs_inode* inode = file->f_dentry->d_inode;
-  
-  if (!(S_ISDIR(inode->i_mode))) // not a directory
-    return -ENOTDIR;
-
-  char *buf = kcalloc(count, sizeof(char));
-	count = ext2_read_file(file, buf, count, file->f_pos);
-  
-  uint32_t size = 0;
-
-  int entries_size = 0;
-  struct dirent* idirent = dirent;
-  for (char *ibuf = buf; ibuf - buf < count;) {
-    ext2_dir_entry *entry = (struct ext2_dir_entry *)ibuf;
-		idirent->d_ino = entry->ino;
-		idirent->d_off = 0;
-		idirent->d_reclen = sizeof(struct dirent);
-
-		idirent->d_type = ext2_mode_to_vfs(entry->file_type);
-		memcpy(idirent->d_name, entry->name, entry->name_len);
-		idirent->d_name[entry->name_len] = 0;
-
-    entries_size += idirent->d_reclen;
-		ibuf += entry->rec_len;
-		idirent = (struct dirent *)((char *)idirent + idirent->d_reclen);
+// inode table block of the last entry which is not in the inode cache, inodes of a directory
+// are usually allocated together so a listing reads each table block once instead of once per entry
+struct ext2_itable_cache {
+	uint32_t block;
+	char *buf;
+};
+
+static void ext2_fill_entry_stat(struct vfs_superblock *sb, ino_t ino, struct kstat *stat,
+                                 struct ext2_itable_cache *itable) {
+	struct vfs_inode *inode = ilookup(sb, ino);
+	if (inode) {
+		generic_fillattr(inode, stat);
+		iput(inode);
+		return;
 	}
 
-  kfree(buf);
-  assert(size % sizeof(struct dirent) == 0);
-  //int ext2_size = size / sizeof(struct dirent);
-  
-  return entries_size;
-  /*
-  // check if it can be extended
-  struct dirent* virtual = 0;
-  int virtual_size = generic_memory_readdir(file, &virtual);
-  int final_size = virtual_size + ext2_size;
-
-  idirent = *dirent;
-  for (int i = 0; i < virtual_size; ++i) {
-    for (int j = 0; j < ext2_size; ++j) {
-      if (!strcmp(idirent[j].d_name, virtual[i].d_name) || !S_ISDIR(idirent[j].d_type)) {
-        virtual[i].d_reclen = 0; // ignore
-        --final_size;
-        break;
-      }
-    }
-  }
+	uint32_t offset;
+	uint32_t block = ext2_inode_location(sb, ino, &offset);
+	if (!itable->buf || itable->block != block) {
+		kfree(itable->buf);
+		itable->buf = ext2_bread_block(sb, block);
+		itable->block = block;
+	}
 
-  struct dirent* final = kcalloc(final_size, sizeof(struct dirent));
-  memcpy(final, *dirent, ext2_size * sizeof(struct dirent));
-  for (int i = ext2_size; i < final_size;) {
-    if (virtual[i - ext2_size].d_reclen != 0) {
-      memcpy(&final[i], &virtual[i - ext2_size], sizeof(struct dirent));
-      ++i;
-    }
-  }
+	memset(stat, 0, sizeof(struct kstat));
+	// inode table cannot be read, entry is returned without attributes
+	if (!itable->buf)
+		return;
+
+	ext2_inode *raw_node = (ext2_inode *)(itable->buf + offset);
+	stat->st_ino = ino;
+	stat->st_mode = raw_node->i_mode;
+	stat->st_nlink = raw_node->i_links_count;
+	stat->st_uid = raw_node->i_uid;
+	stat->st_gid = raw_node->i_gid;
+	stat->st_rdev = S_ISCHR(raw_node->i_mode) ? raw_node->i_block[0] : 0;
+	stat->st_size = raw_node->i_size;
+	stat->st_atim.tv_sec = raw_node->i_atime;
+	stat->st_mtim.tv_sec = raw_node->i_mtime;
+	stat->st_ctim.tv_sec = raw_node->i_ctime;
+	stat->st_blocks = raw_node->i_blocks;
+	stat->st_blksize = EXT2_IO_SIZE;
+}
+
+// f_pos is the byte offset of the next entry in the directory, entries are copied block by block
+// straight into the caller's buffer until it's full
+static int ext2_readdir_common(struct vfs_file *file, char *buf, uint32_t count, bool plus) {
+	struct vfs_inode *inode = file->f_dentry->d_inode;
+	struct vfs_superblock *sb = inode->i_sb;
+
+	if (!S_ISDIR(inode->i_mode))
+		return -ENOTDIR;
+
+	struct ext2_itable_cache itable = {0, NULL};
+	uint32_t size = 0;
+	bool full = false;
+	while (!full && file->f_pos < inode->i_size) {
+		uint32_t iblock = file->f_pos / sb->s_blocksize;
+		uint32_t offset = file->f_pos % sb->s_blocksize;
+		int32_t block = ext2_bmap(inode, iblock, false, NULL);
+		char *block_buf = block > 0 ? ext2_bread_block(sb, block) : NULL;
+
+		while (block_buf && offset < sb->s_blocksize) {
+			// f_pos comes from userspace, an entry has to be aligned and fit in the block
+			if (offset % 4 || offset + EXT2_DIR_REC_LEN(0) > sb->s_blocksize)
+				break;
+			ext2_dir_entry *entry = (ext2_dir_entry *)(block_buf + offset);
+			if (entry->rec_len < EXT2_DIR_REC_LEN(entry->name_len) ||
+			    offset + entry->rec_len > sb->s_blocksize)
+				break;
+
+			off_t next = iblock * sb->s_blocksize + offset + entry->rec_len;
+			// deleted entries and htree nodes have no inode
+			if (entry->ino) {
+				struct dirent *dirent = dirent_emit(buf, &size, count, plus, entry->ino, next,
+				                                    ext2_mode_to_vfs(entry->file_type), entry->name, entry->name_len);
+				if (!dirent) {
+					full = true;
+					break;
+				}
+				if (plus)
+					ext2_fill_entry_stat(sb, entry->ino, &container_of(dirent, struct dirent_plus, d_ent)->d_stat, &itable);
+			}
+			offset += entry->rec_len;
+			file->f_pos = next;
+		}
+
+		kfree(block_buf);
+		// hole or the rest of a broken block is skipped
+		if (!full)
+			file->f_pos = (iblock + 1) * sb->s_blocksize;
+	}
 
-  kfree(*dirent);
-  kfree(virtual);
-  *dirent = final;
+	kfree(itable.buf);
+	if (full && !size)
+		return -EINVAL;
+	return size;
+}
 
-	return final_size;
-  */
+int ext2_readdir(struct vfs_file *file, struct dirent *dirent, uint32_t count) {
+	return ext2_readdir_common(file, (char *)dirent, count, false);
+}
+
+int ext2_readdirplus(struct vfs_file *file, struct dirent_plus *dirent, uint32_t count) {
+	return ext2_readdir_common(file, (char *)dirent, count, true);
+}
+
+// blocks reserved for the file are given back when it is closed
+static int ext2_release_file(struct vfs_inode *inode, struct vfs_file *file) {
+	if (EXT2_INODE_INFO(inode)->prealloc_count) {
+		ext2_discard_prealloc(inode);
+		ext2_sync_metadata(inode->i_sb);
+	}
+	return 0;
 }
 
 struct vfs_file_operations ext2_file_operations = {
 	.llseek = vfs_generic_llseek,
 	.read = ext2_read_file,
 	.write = ext2_write_file,
+	.release = ext2_release_file,
 	//.mmap = ext2_mmap_file,
 };
 
 struct vfs_file_operations ext2_dir_operations = {
+	.llseek = vfs_generic_llseek,
 	.readdir = ext2_readdir,
+	.readdirplus = ext2_readdirplus,
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include <test/greatest.h>
+
+#include "kernel/fs/ext2/ext2.h"
+
+static ext2_superblock ext2_sb;
+static ext2_fs_info fs_info;
+static struct vfs_superblock sb;
+
+// expected values are from `debugfs -R "dx_hash -h <version> <name>"`
+static const char *names[] = {"hello", "caf\xc3\xa9", "a_file_name_which_is_longer_than_thirty_two_bytes"};
+static const uint32_t hashes[][6] = {
+  {0x32252546, 0x1746da32, 0x6f5bb1a8, 0x32252546, 0x1746da32, 0x6f5bb1a8},
+  {0x96ca5a2c, 0xfb9c5e5c, 0x105842ea, 0x6dde4230, 0x9d72aed6, 0x6621f032},
+  {0xe9ea8fb4, 0xb8ed4866, 0x0d67aae0, 0xe9ea8fb4, 0xb8ed4866, 0x0d67aae0},
+};
+
+static void setup_sb(void) {
+  memset(&ext2_sb, 0, sizeof(ext2_sb));
+  fs_info.sb = &ext2_sb;
+  sb.s_fs_info = &fs_info;
+}
+
+static uint32_t dirhash(int version, const char *name) {
+  return ext2_dirhash(&sb, version, name, strlen(name));
+}
+
+TEST TEST_EXT2_DIRHASH_VERSIONS(void) {
+  setup_sb();
+
+  for (uint32_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    for (int version = EXT2_HASH_LEGACY; version <= EXT2_HASH_TEA_UNSIGNED; ++version)
+      ASSERT_EQ(dirhash(version, names[i]), hashes[i][version]);
+
+  PASS();
+}
+
+TEST TEST_EXT2_DIRHASH_SIGNED(void) {
+  setup_sb();
+
+  // only names with bytes above 0x7f differ
+  ASSERT_EQ(dirhash(EXT2_HASH_TEA, "hello"), dirhash(EXT2_HASH_TEA_UNSIGNED, "hello"));
+  ASSERT(dirhash(EXT2_HASH_TEA, names[1]) != dirhash(EXT2_HASH_TEA_UNSIGNED, names[1]));
+
+  PASS();
+}
+
+TEST TEST_EXT2_DIRHASH_SEED(void) {
+  static const uint8_t seed[16] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+                                   0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef};
+  setup_sb();
+  memcpy(ext2_sb.s_hash_seed, seed, sizeof(seed));
+
+  ASSERT_EQ(dirhash(EXT2_HASH_HALF_MD4, "hello"), 0xa26e4a80);
+
+  PASS();
+}
+
+SUITE(SUITE_EXT2_HASH) {
+  RUN_TEST(TEST_EXT2_DIRHASH_VERSIONS);
+  RUN_TEST(TEST_EXT2_DIRHASH_SIGNED);
+  RUN_TEST(TEST_EXT2_DIRHASH_SEED);
+}
@@ -0,0 +1,421 @@
+#include "kernel/include/errno.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/string/string.h"
+
+#include "kernel/fs/ext2/ext2.h"
+
+// root and nodes map hash ranges to leaf blocks, so lookup reads one path instead of every block.
+// Index which can't grow anymore is dropped and directory is scanned linearly
+struct dx_frame {
+  char *buf;
+  uint32_t block;  // physical block of the node
+  ext2_dx_entry *entries;
+  ext2_dx_entry *at;
+};
+
+struct dx_map_entry {
+  uint32_t hash;
+  uint16_t offs;
+  uint16_t size;
+};
+
+static inline ext2_dx_countlimit *dx_countlimit(ext2_dx_entry *entries) {
+  return (ext2_dx_countlimit *)entries;
+}
+
+static inline ext2_dx_root_info *dx_root_info(char *buf) {
+  return (ext2_dx_root_info *)(buf + EXT2_DX_ROOT_HEADER);
+}
+
+static inline bool dx_full(struct dx_frame *frame) {
+  ext2_dx_countlimit *cl = dx_countlimit(frame->entries);
+  return cl->count >= cl->limit;
+}
+
+bool ext2_dx_supported(struct vfs_superblock *sb) {
+  return EXT2_SB(sb)->s_feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX;
+}
+
+static int dx_hash_version(struct vfs_superblock *sb, uint8_t version) {
+  if (version <= EXT2_HASH_TEA && EXT2_SB(sb)->s_flags & EXT2_FLAGS_UNSIGNED_HASH)
+    return version + EXT2_HASH_LEGACY_UNSIGNED;
+  return version;
+}
+
+static char *dx_read(struct vfs_inode *dir, uint32_t lblock, uint32_t *block) {
+  int32_t b = ext2_bmap(dir, lblock, false, NULL);
+  if (b <= 0)
+    return NULL;
+
+  *block = b;
+  return ext2_bread_block(dir->i_sb, b);
+}
+
+static void dx_release(struct dx_frame *frames, int count) {
+  for (int i = 0; i < count; ++i)
+    kfree(frames[i].buf);
+}
+
+// new block at the end of directory
+static int32_t dx_append_block(struct vfs_inode *dir, uint32_t *lblock) {
+  *lblock = dir->i_blocks;
+  int32_t block = ext2_bmap(dir, *lblock, true, NULL);
+  if (block < 0)
+    return block;
+
+  dir->i_blocks += 1;
+  dir->i_size += dir->i_sb->s_blocksize;
+  mark_inode_dirty(dir);
+  return block;
+}
+
+/*
+  fills the path from root to the node which points to the leaf of the name,
+  returns number of frames or -EINVAL if index is broken or uses a hash we don't know
+*/
+static int dx_probe(struct vfs_inode *dir, const char *name, uint32_t *hash, struct dx_frame *frames) {
+  struct vfs_superblock *sb = dir->i_sb;
+  struct dx_frame *frame = frames;
+
+  frame->buf = dx_read(dir, 0, &frame->block);
+  if (!frame->buf)
+    return -EINVAL;
+
+  ext2_dx_root_info *info = dx_root_info(frame->buf);
+  if (info->reserved_zero || info->info_length != sizeof(ext2_dx_root_info) ||
+      info->hash_version > EXT2_HASH_TEA || info->indirect_levels >= EXT2_HTREE_MAX_LEVELS) {
+    dx_release(frames, 1);
+    return -EINVAL;
+  }
+
+  *hash = ext2_dirhash(sb, dx_hash_version(sb, info->hash_version), name, strlen(name));
+  frame->entries = (ext2_dx_entry *)((char *)info + info->info_length);
+
+  for (int level = 0;; ++level, ++frame) {
+    ext2_dx_countlimit *cl = dx_countlimit(frame->entries);
+    if (!cl->count || cl->count > cl->limit) {
+      dx_release(frames, level + 1);
+      return -EINVAL;
+    }
+
+    // the last entry with hash <= hash, the first one covers everything below the second
+    ext2_dx_entry *p = frame->entries + 1, *q = frame->entries + cl->count - 1;
+    while (p <= q) {
+      ext2_dx_entry *m = p + (q - p) / 2;
+      if (m->hash > *hash)
+        q = m - 1;
+      else
+        p = m + 1;
+    }
+    frame->at = p - 1;
+
+    if (level == info->indirect_levels)
+      return level + 1;
+
+    struct dx_frame *next = frame + 1;
+    if (!(next->buf = dx_read(dir, frame->at->block, &next->block))) {
+      dx_release(frames, level + 1);
+      return -EINVAL;
+    }
+    next->entries = (ext2_dx_entry *)(next->buf + EXT2_DX_NODE_HEADER);
+  }
+}
+
+// names with the same hash can continue in the next leaf, its hash has the lowest bit set
+static bool dx_next_leaf(struct vfs_inode *dir, uint32_t hash, struct dx_frame *frames, int count) {
+  int level = count - 1;
+  while (level >= 0 &&
+         frames[level].at + 1 >= frames[level].entries + dx_countlimit(frames[level].entries)->count)
+    level--;
+  if (level < 0 || ((frames[level].at + 1)->hash & ~1) != hash)
+    return false;
+
+  frames[level].at++;
+  for (++level; level < count; ++level) {
+    kfree(frames[level].buf);
+    if (!(frames[level].buf = dx_read(dir, frames[level - 1].at->block, &frames[level].block)))
+      return false;
+    frames[level].entries = (ext2_dx_entry *)(frames[level].buf + EXT2_DX_NODE_HEADER);
+    frames[level].at = frames[level].entries;
+  }
+  return true;
+}
+
+// runs action on leaves where the name can be, -EINVAL means index has to be ignored
+int ext2_dx_find_entry(struct vfs_inode *dir, const char *name,
+                       int (*action)(struct vfs_superblock *, uint32_t, void *), void *arg) {
+  struct dx_frame frames[EXT2_HTREE_MAX_LEVELS] = {0};
+  uint32_t hash;
+  int count = dx_probe(dir, name, &hash, frames);
+  if (count < 0)
+    return count;
+
+  int ret;
+  do {
+    int32_t block = ext2_bmap(dir, frames[count - 1].at->block, false, NULL);
+    ret = block > 0 ? action(dir->i_sb, block, arg) : -ENOENT;
+  } while (ret < 0 && dx_next_leaf(dir, hash, frames, count));
+
+  dx_release(frames, count);
+  return ret;
+}
+
+// adds entry behind the current one of the frame
+static void dx_insert(struct vfs_superblock *sb, struct dx_frame *frame, uint32_t hash, uint32_t lblock) {
+  ext2_dx_countlimit *cl = dx_countlimit(frame->entries);
+  ext2_dx_entry *new = frame->at + 1;
+
+  memmove(new + 1, new, (frame->entries + cl->count - new) * sizeof(ext2_dx_entry));
+  new->hash = hash;
+  new->block = lblock;
+  cl->count++;
+  ext2_bwrite_block(sb, frame->block, frame->buf);
+}
+
+// entries of root move to a new node, root points only to it
+static int dx_grow_root(struct vfs_inode *dir, struct dx_frame *root) {
+  struct vfs_superblock *sb = dir->i_sb;
+  uint32_t lblock;
+  int32_t block = dx_append_block(dir, &lblock);
+  if (block < 0)
+    return block;
+
+  ext2_dx_countlimit *cl = dx_countlimit(root->entries);
+  char *buf = kcalloc(sb->s_blocksize, sizeof(char));
+  ((ext2_dir_entry *)buf)->rec_len = sb->s_blocksize;
+  ext2_dx_entry *entries = (ext2_dx_entry *)(buf + EXT2_DX_NODE_HEADER);
+  memcpy(entries, root->entries, cl->count * sizeof(ext2_dx_entry));
+  dx_countlimit(entries)->limit = (sb->s_blocksize - EXT2_DX_NODE_HEADER) / sizeof(ext2_dx_entry);
+  ext2_bwrite_block(sb, block, buf);
+  kfree(buf);
+
+  cl->count = 1;
+  cl->block = lblock;
+  dx_root_info(root->buf)->indirect_levels++;
+  ext2_bwrite_block(sb, root->block, root->buf);
+  return 0;
+}
+
+// upper half of the node moves to a new node
+static int dx_split_node(struct vfs_inode *dir, struct dx_frame *parent, struct dx_frame *node) {
+  struct vfs_superblock *sb = dir->i_sb;
+  uint32_t lblock;
+  int32_t block = dx_append_block(dir, &lblock);
+  if (block < 0)
+    return block;
+
+  ext2_dx_countlimit *cl = dx_countlimit(node->entries);
+  uint32_t half = cl->count / 2;
+  uint32_t split_hash = node->entries[half].hash;
+
+  char *buf = kcalloc(sb->s_blocksize, sizeof(char));
+  ((ext2_dir_entry *)buf)->rec_len = sb->s_blocksize;
+  ext2_dx_entry *entries = (ext2_dx_entry *)(buf + EXT2_DX_NODE_HEADER);
+  memcpy(entries, node->entries + half, (cl->count - half) * sizeof(ext2_dx_entry));
+  dx_countlimit(entries)->limit = cl->limit;
+  dx_countlimit(entries)->count = cl->count - half;
+  ext2_bwrite_block(sb, block, buf);
+  kfree(buf);
+
+  cl->count = half;
+  ext2_bwrite_block(sb, node->block, node->buf);
+  dx_insert(sb, parent, split_hash, lblock);
+  return 0;
+}
+
+// packs entries from the map into zeroed block, the last one takes the rest of it
+static void dx_copy_entries(char *dst, char *src, struct dx_map_entry *map, uint32_t count, uint32_t blocksize) {
+  ext2_dir_entry *entry = (ext2_dir_entry *)dst;
+  uint32_t offs = 0;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    entry = (ext2_dir_entry *)(dst + offs);
+    memcpy(entry, src + map[i].offs, map[i].size);
+    entry->rec_len = map[i].size;
+    offs += map[i].size;
+  }
+  entry->rec_len += blocksize - offs;
+}
+
+// entries of the leaf are sorted by hash and the upper half moves to a new leaf
+static int dx_split_leaf(struct vfs_inode *dir, int version, struct dx_frame *frame) {
+  struct vfs_superblock *sb = dir->i_sb;
+  uint32_t blocksize = sb->s_blocksize;
+  int32_t block = ext2_bmap(dir, frame->at->block, false, NULL);
+  if (block <= 0)
+    return -EINVAL;
+
+  char *buf = ext2_bread_block(sb, block);
+  struct dx_map_entry *map = kcalloc(blocksize / EXT2_DIR_REC_LEN(1), sizeof(struct dx_map_entry));
+  uint32_t count = 0;
+  for (uint32_t offs = 0; offs < blocksize;) {
+    ext2_dir_entry *entry = (ext2_dir_entry *)(buf + offs);
+    if (!entry->rec_len)
+      break;
+    if (entry->ino) {
+      struct dx_map_entry *m = &map[count++];
+      m->hash = ext2_dirhash(sb, version, entry->name, entry->name_len);
+      m->offs = offs;
+      m->size = EXT2_DIR_REC_LEN(entry->name_len);
+    }
+    offs += entry->rec_len;
+  }
+
+  int ret = -ENOSPC;
+  if (count < 2)
+    goto clean;
+
+  for (uint32_t i = 1; i < count; ++i) {
+    struct dx_map_entry m = map[i];
+    uint32_t j = i;
+    for (; j > 0 && map[j - 1].hash > m.hash; --j)
+      map[j] = map[j - 1];
+    map[j] = m;
+  }
+
+  uint32_t split = count / 2;
+  uint32_t split_hash = map[split].hash;
+  // lookup of this hash has to continue into the new leaf
+  bool continued = split_hash == map[split - 1].hash;
+
+  uint32_t lblock;
+  int32_t new_block = dx_append_block(dir, &lblock);
+  if (new_block < 0) {
+    ret = new_block;
+    goto clean;
+  }
+
+  char *lo = kcalloc(blocksize, sizeof(char));
+  char *hi = kcalloc(blocksize, sizeof(char));
+  dx_copy_entries(lo, buf, map, split, blocksize);
+  dx_copy_entries(hi, buf, map + split, count - split, blocksize);
+  ext2_bwrite_block(sb, block, lo);
+  ext2_bwrite_block(sb, new_block, hi);
+  kfree(lo);
+  kfree(hi);
+
+  dx_insert(sb, frame, split_hash + continued, lblock);
+  ret = 0;
+
+clean:
+  kfree(map);
+  kfree(buf);
+  return ret;
+}
+
+// -EINVAL and -ENOSPC mean that entry has to be added without index
+int ext2_dx_add_entry(struct vfs_inode *dir, struct vfs_dentry *dentry) {
+  struct vfs_superblock *sb = dir->i_sb;
+
+  // each round either adds the entry or makes room on one level of the tree
+  for (int round = 0; round < EXT2_HTREE_MAX_LEVELS + 3; ++round) {
+    struct dx_frame frames[EXT2_HTREE_MAX_LEVELS] = {0};
+    uint32_t hash;
+    int count = dx_probe(dir, dentry->d_name, &hash, frames);
+    if (count < 0)
+      return count;
+
+    struct dx_frame *frame = &frames[count - 1];
+    int32_t block = ext2_bmap(dir, frame->at->block, false, NULL);
+    int ret = block > 0 ? ext2_add_entry(sb, block, dentry) : -EINVAL;
+    if (ret >= 0 || block <= 0) {
+      dx_release(frames, count);
+      return ret;
+    }
+
+    ext2_dx_root_info *info = dx_root_info(frames[0].buf);
+    if (!dx_full(frame))
+      ret = dx_split_leaf(dir, dx_hash_version(sb, info->hash_version), frame);
+    else if (count == 1 && info->indirect_levels + 1 < EXT2_HTREE_MAX_LEVELS)
+      ret = dx_grow_root(dir, frame);
+    else if (count > 1 && !dx_full(&frames[count - 2]))
+      ret = dx_split_node(dir, &frames[count - 2], frame);
+    else
+      ret = -ENOSPC;
+
+    dx_release(frames, count);
+    if (ret < 0)
+      return ret;
+  }
+  return -ENOSPC;
+}
+
+// entries of the only block move to a leaf, the block becomes root of the index
+int ext2_dx_make_indexed(struct vfs_inode *dir) {
+  struct vfs_superblock *sb = dir->i_sb;
+  ext2_superblock *ext2_sb = EXT2_SB(sb);
+  uint32_t blocksize = sb->s_blocksize;
+
+  if (ext2_sb->s_def_hash_version > EXT2_HASH_TEA)
+    return -EINVAL;
+
+  int32_t block = ext2_bmap(dir, 0, false, NULL);
+  if (block <= 0)
+    return -EINVAL;
+
+  char *buf = ext2_bread_block(sb, block);
+  ext2_dir_entry *dot = (ext2_dir_entry *)buf;
+  ext2_dir_entry *dotdot = (ext2_dir_entry *)(buf + dot->rec_len);
+  if (dot->name_len != 1 || dot->name[0] != '.' || dot->rec_len >= blocksize - EXT2_DIR_REC_LEN(2) ||
+      dotdot->name_len != 2 || memcmp(dotdot->name, "..", 2) != 0) {
+    kfree(buf);
+    return -EINVAL;
+  }
+
+  uint32_t lblock;
+  int32_t leaf = dx_append_block(dir, &lblock);
+  if (leaf < 0) {
+    kfree(buf);
+    return leaf;
+  }
+
+  struct dx_map_entry *map = kcalloc(blocksize / EXT2_DIR_REC_LEN(1), sizeof(struct dx_map_entry));
+  uint32_t count = 0;
+  for (uint32_t offs = dot->rec_len + dotdot->rec_len; offs < blocksize;) {
+    ext2_dir_entry *entry = (ext2_dir_entry *)(buf + offs);
+    if (!entry->rec_len)
+      break;
+    if (entry->ino) {
+      map[count].offs = offs;
+      map[count++].size = EXT2_DIR_REC_LEN(entry->name_len);
+    }
+    offs += entry->rec_len;
+  }
+
+  char *leaf_buf = kcalloc(blocksize, sizeof(char));
+  dx_copy_entries(leaf_buf, buf, map, count, blocksize);
+  ext2_bwrite_block(sb, leaf, leaf_buf);
+  kfree(leaf_buf);
+  kfree(map);
+
+  // "." and ".." stay, ".." covers the index so it is invisible for linear scan
+  uint32_t parent_ino = dotdot->ino;
+  memset(buf + EXT2_DIR_REC_LEN(1), 0, blocksize - EXT2_DIR_REC_LEN(1));
+  dot->rec_len = EXT2_DIR_REC_LEN(1);
+  dotdot = (ext2_dir_entry *)(buf + dot->rec_len);
+  dotdot->ino = parent_ino;
+  dotdot->rec_len = blocksize - dot->rec_len;
+  dotdot->name_len = 2;
+  dotdot->file_type = EXT2_FT_DIR;
+  memcpy(dotdot->name, "..", 2);
+
+  ext2_dx_root_info *info = dx_root_info(buf);
+  info->hash_version = ext2_sb->s_def_hash_version;
+  info->info_length = sizeof(ext2_dx_root_info);
+  ext2_dx_countlimit *cl = (ext2_dx_countlimit *)((char *)info + info->info_length);
+  cl->limit = (blocksize - EXT2_DX_ROOT_HEADER - sizeof(ext2_dx_root_info)) / sizeof(ext2_dx_entry);
+  cl->count = 1;
+  cl->block = lblock;
+  ext2_bwrite_block(sb, block, buf);
+  kfree(buf);
+
+  dir->i_flags |= EXT2_INDEX_FL;
+  mark_inode_dirty(dir);
+  return 0;
+}
+
+void ext2_dx_clear(struct vfs_inode *dir) {
+  dir->i_flags &= ~EXT2_INDEX_FL;
+  mark_inode_dirty(dir);
+}
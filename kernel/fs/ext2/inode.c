@@ -1,6 +1,7 @@
 #include <errno.h>
 #include "kernel/util/debug.h"
 #include "kernel/include/limits.h"
+#include "kernel/include/err.h"
 #include "kernel/util/string/string.h"
 #include "kernel/util/path.h"
 #include "kernel/fs/vfs.h"
@@ -9,40 +10,21 @@
 
 #include "kernel/fs/ext2/ext2.h"
 
-static int ext2_recursive_block_action(
-  struct vfs_superblock* sb,
-	int level, uint32_t block, void* arg,
-	int (*action)(struct vfs_superblock *, uint32_t, void *)) {
-
-	assert(level <= EXT2_MAX_DATA_LEVEL);
-  //ext2_superblock* sb = EXT2_SB(vsb);
-
-  if (level == 0) 
-    return action(sb, block, arg);
-
-  int ret = -ENOENT;
-  uint32_t *block_buf = (uint32_t *)ext2_bread_block(sb, block);
-  for (uint32_t i = 0, nblocks = sb->s_blocksize / sizeof(uint32_t); i < nblocks; ++i)
-    if ((ret = ext2_recursive_block_action(sb, level - 1, block_buf[i], arg, action)) >= 0)
-      break;
-  kfree(block_buf);
-  return ret;
+static inline bool ext2_match_entry(ext2_dir_entry *entry, const char *name, uint32_t len) {
+	return entry->ino && entry->name_len == len && memcmp(entry->name, name, len) == 0;
 }
 
 static int ext2_find_ino(struct vfs_superblock *sb, uint32_t block, void *arg) {
 	const char *name = arg;
+	uint32_t len = strlen(name);
 	char *block_buf = ext2_bread_block(sb, block);
 
-	char tmpname[NAME_MAX];
 	uint32_t size = 0;
 	ext2_dir_entry *entry = (ext2_dir_entry *)block_buf;
 
   int ret = -ENOENT;
-	while (size < sb->s_blocksize) {
-		memcpy(tmpname, entry->name, entry->name_len);
-		tmpname[entry->name_len] = '\0';
-
-		if (strcmp(tmpname, name) == 0) {
+	while (size < sb->s_blocksize && entry->rec_len) {
+		if (ext2_match_entry(entry, name, len)) {
       ret = entry->ino;
       break;
     }
@@ -56,18 +38,15 @@ static int ext2_find_ino(struct vfs_superblock *sb, uint32_t block, void *arg) {
 
 static int ext2_delete_entry(struct vfs_superblock *sb, uint32_t block, void *arg) {
 	const char *name = arg;
+	uint32_t len = strlen(name);
 	char *block_buf = ext2_bread_block(sb, block);
 
-	char tmpname[NAME_MAX];
 	uint32_t size = 0;
 	ext2_dir_entry *prev = NULL;
 	ext2_dir_entry *entry = (ext2_dir_entry *)block_buf;
 
-	while (size < sb->s_blocksize) {
-		memcpy(tmpname, entry->name, entry->name_len);
-		tmpname[entry->name_len] = 0;
-
-		if (strcmp(tmpname, name) == 0) {
+	while (size < sb->s_blocksize && entry->rec_len) {
+		if (ext2_match_entry(entry, name, len)) {
 			int ino = entry->ino;
 			entry->ino = 0;
 
@@ -75,6 +54,7 @@ static int ext2_delete_entry(struct vfs_superblock *sb, uint32_t block, void *ar
 				prev->rec_len += entry->rec_len;
 
 			ext2_bwrite_block(sb, block, block_buf);
+			kfree(block_buf);
 			return ino;
 		}
 
@@ -83,63 +63,47 @@ static int ext2_delete_entry(struct vfs_superblock *sb, uint32_t block, void *ar
 		entry = (ext2_dir_entry *)((char *)entry + entry->rec_len);
 	}
 
+	kfree(block_buf);
 	return -ENOENT;
 }
 
-struct vfs_inode* ext2_lookup_inode(struct vfs_inode *dir, char* name) {
-  ext2_inode *ei = EXT2_INODE(dir);
-	struct vfs_superblock *sb = dir->i_sb;
-  ext2_fs_info* mi = EXT2_INFO(sb);
-  
-	for (int32_t i = 0, ino = 0; i < ei->i_blocks; ++i) {
-		if (!ei->i_block[i])
-			continue;
-
-		if (
-      ((mi->ino_upper_levels[0] > i) && (ino = ext2_recursive_block_action(sb, 0, ei->i_block[i], name, ext2_find_ino)) > 0) ||
-			((mi->ino_upper_levels[0] <= i && i < mi->ino_upper_levels[1]) && (ino = ext2_recursive_block_action(mi, 1, ei->i_block[12], name, ext2_find_ino)) > 0) ||
-			((mi->ino_upper_levels[1] <= i && i < mi->ino_upper_levels[2]) && (ino = ext2_recursive_block_action(mi, 2, ei->i_block[13], name, ext2_find_ino)) > 0) ||
-			((mi->ino_upper_levels[2] <= i && i < mi->ino_upper_levels[3]) && (ino = ext2_recursive_block_action(mi, 3, ei->i_block[14], name, ext2_find_ino)) > 0))
-		{
-      struct vfs_inode *inode = dir->i_sb->s_op->alloc_inode(dir->i_sb);
-			inode->i_ino = ino;
-			ext2_read_inode(inode);
-			return inode;
-		}
+// runs action on blocks of directory where the name can be until it finds the entry
+static int ext2_dir_action(struct vfs_inode *dir, char *name, int (*action)(struct vfs_superblock *, uint32_t, void *)) {
+	if (dir->i_flags & EXT2_INDEX_FL) {
+		int ret = ext2_dx_find_entry(dir, name, action, name);
+		// index which we don't understand is ignored
+		if (ret != -EINVAL)
+			return ret;
 	}
-	return NULL;
+
+	for (uint32_t i = 0; i < dir->i_blocks; ++i) {
+		int32_t block = ext2_bmap(dir, i, false, NULL);
+		int ret;
+		if (block > 0 && (ret = action(dir->i_sb, block, name)) > 0)
+			return ret;
+	}
+	return -ENOENT;
+}
+
+struct vfs_inode* ext2_lookup_inode(struct vfs_inode *dir, char* name) {
+	int ino = ext2_dir_action(dir, name, ext2_find_ino);
+	return ino > 0 ? iget(dir->i_sb, ino) : NULL;
 }
 
 static int ext2_unlink(struct vfs_inode *dir, char* name) {
-	ext2_inode *ei = EXT2_INODE(dir);
-	struct vfs_superblock *sb = dir->i_sb;
-  ext2_fs_info* mi = EXT2_INFO(sb);
-
-	for (int32_t i = 0, ino = 0; i < ei->i_blocks; ++i) {
-		if (!ei->i_block[i])
-			continue;
-
-		if (
-      ((mi->ino_upper_levels[0] > i) && (ino = ext2_recursive_block_action(sb, 0, ei->i_block[i], name, ext2_delete_entry)) > 0) ||
-			((mi->ino_upper_levels[0] <= i && i < mi->ino_upper_levels[1]) && (ino = ext2_recursive_block_action(mi, 1, ei->i_block[12], name, ext2_delete_entry)) > 0) ||
-			((mi->ino_upper_levels[1] <= i && i < mi->ino_upper_levels[2]) && (ino = ext2_recursive_block_action(mi, 2, ei->i_block[13], name, ext2_delete_entry)) > 0) ||
-			((mi->ino_upper_levels[2] <= i && i < mi->ino_upper_levels[3]) && (ino = ext2_recursive_block_action(mi, 3, ei->i_block[14], name, ext2_delete_entry)) > 0))
-		{
-			struct vfs_inode *inode = dir->i_sb->s_op->alloc_inode(dir->i_sb);
-			inode->i_ino = ino;
-			ext2_read_inode(inode);
-
-			inode->i_nlink -= 1;
-			ext2_write_inode(inode);
-			// TODO: SA 2023-12-20 If i_nlink == 0, we delete ext2 inode
-      kfree(inode);
-			break;
-		}
+	int ino = ext2_dir_action(dir, name, ext2_delete_entry);
+	if (ino > 0) {
+		// dentry of the file still holds the inode, it's written back by iput
+		struct vfs_inode *inode = iget(dir->i_sb, ino);
+		inode->i_nlink -= 1;
+		mark_inode_dirty(inode);
+		// TODO: SA 2023-12-20 If i_nlink == 0, we delete ext2 inode
+		iput(inode);
 	}
 	return 0;
 }
 
-static int ext2_add_entry(struct vfs_superblock *sb, uint32_t block, void *arg) {
+int ext2_add_entry(struct vfs_superblock *sb, uint32_t block, void *arg) {
 	struct vfs_dentry *dentry = arg;
 	int filename_length = strlen(dentry->d_name);
 
@@ -195,71 +159,61 @@ clean:
 }
 
 static int ext2_create_entry(struct vfs_superblock *sb, struct vfs_inode *dir, struct vfs_dentry *dentry) {
-	ext2_inode* ei = EXT2_INODE(dir);
-  ext2_fs_info* mi = EXT2_INFO(sb);
-
-	// NOTE: MQ 2020-11-19 support nth-level block
-	for (int i = 0; i < dir->i_blocks; ++i) {
-		if (i >= mi->ino_upper_levels[0])
-			assert_not_reached();
-
-		uint32_t block = ei->i_block[i];
-		if (!block) {
-			block = ext2_create_block(dir->i_sb);
-			ei->i_block[i] = block;
-			dir->i_blocks += 1;
-			dir->i_size += sb->s_blocksize;
-			ext2_write_inode(dir);
-		}
+	if (dir->i_flags & EXT2_INDEX_FL) {
+		int ret = ext2_dx_add_entry(dir, dentry);
+		if (ret != -EINVAL && ret != -ENOSPC)
+			return ret;
+		// index cannot grow anymore, directory is scanned linearly from now on
+		ext2_dx_clear(dir);
+	}
 
-		if (ext2_add_entry(sb, block, dentry) >= 0)
+	for (uint32_t i = 0; i < dir->i_blocks; ++i) {
+		int32_t block = ext2_bmap(dir, i, false, NULL);
+		if (block > 0 && ext2_add_entry(sb, block, dentry) >= 0)
 			return 0;
 	}
-	return -ENOENT;
-}
 
-static int find_unused_inode_number(struct vfs_superblock *sb) {
-	ext2_superblock *ext2_sb = EXT2_SB(sb);
-
-	uint32_t number_of_groups = div_ceil(ext2_sb->s_blocks_count, ext2_sb->s_blocks_per_group);
-	for (uint32_t group = 0; group < number_of_groups; group += 1) {
-		ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
-		unsigned char *inode_bitmap = (unsigned char *)ext2_bread_block(sb, gdp->bg_inode_bitmap);
+	// the first block is full, directory is indexed instead of growing linearly
+	if (dir->i_blocks == 1 && ext2_dx_supported(sb) && ext2_dx_make_indexed(dir) == 0)
+		return ext2_dx_add_entry(dir, dentry);
+
+	// directory grows by one block
+	int32_t block = ext2_bmap(dir, dir->i_blocks, true, NULL);
+	if (block < 0)
+		return block;
+
+	// one unused entry over the whole block
+	char *block_buf = kcalloc(sb->s_blocksize, sizeof(char));
+	((ext2_dir_entry *)block_buf)->rec_len = sb->s_blocksize;
+	ext2_bwrite_block(sb, block, block_buf);
+	kfree(block_buf);
+
+	dir->i_blocks += 1;
+	dir->i_size += sb->s_blocksize;
+	mark_inode_dirty(dir);
+	return ext2_add_entry(sb, block, dentry);
+}
 
-		for (uint32_t i = 0; i < sb->s_blocksize; ++i)
-			if (inode_bitmap[i] != 0xff)
-				for (uint8_t j = 0; j < 8; ++j)
-					if (!(inode_bitmap[i] & (1 << j)))
-						return group * ext2_sb->s_inodes_per_group + i * 8 + j + EXT2_STARTING_INO;
-	}
-	return -ENOSPC;
+// inode which hasn't been linked yet, its number and first block are given back and nothing is written to disk,
+// preallocated blocks are released when the inode is destroyed
+static void ext2_discard_new_inode(struct vfs_inode *inode) {
+	ext2_inode *ei = EXT2_INODE(inode);
+	if (ei->i_block[0])
+		ext2_free_block(inode->i_sb, ei->i_block[0]);
+	ext2_free_ino(inode->i_sb, inode->i_ino, inode->i_mode);
+	inode->i_state &= ~I_DIRTY;
+	inode->i_nlink = 0;
+	iput(inode);
 }
 
 static struct vfs_inode *ext2_create_inode(struct vfs_inode *dir, struct vfs_dentry *dentry, mode_t mode, int32_t dev) {
 	struct vfs_superblock *sb = dir->i_sb;
-	ext2_superblock *ext2_sb = EXT2_SB(sb);
-	uint32_t ino = find_unused_inode_number(sb);
-	ext2_group_desc *gdp = ext2_get_group_desc(sb, get_group_from_inode(ext2_sb, ino));
-
-	// superblock
-	ext2_sb->s_free_inodes_count -= 1;
-	sb->s_op->write_super(sb);
-
-	// group descriptor
-	gdp->bg_free_inodes_count -= 1;
-	if (S_ISDIR(mode))
-		gdp->bg_used_dirs_count += 1;
-	ext2_write_group_desc(sb, gdp);
-
-	// inode bitmap
-	char *inode_bitmap_buf = ext2_bread_block(sb, gdp->bg_inode_bitmap);
-	uint32_t relative_inode = get_relative_inode_in_group(ext2_sb, ino);
-  // each bit represents one block, 1 byte = 8 bit
-	inode_bitmap_buf[relative_inode / 8] |= 1 << (relative_inode % 8);
-	ext2_bwrite_block(sb, gdp->bg_inode_bitmap, inode_bitmap_buf);
+	int32_t ino = ext2_new_ino(sb, mode);
+	if (ino < 0)
+		return ERR_PTR(ino);
 
 	// inode table
-	struct ext2_inode *ei_new = kcalloc(1, sizeof(struct ext2_inode));
+	struct ext2_inode *ei_new = &ext2_new_inode_info()->raw;
 	ei_new->i_links_count = 1;
 	struct vfs_inode *inode = sb->s_op->alloc_inode(sb);
 	inode->i_ino = ino;
@@ -272,29 +226,34 @@ static struct vfs_inode *ext2_create_inode(struct vfs_inode *dir, struct vfs_den
 	inode->i_mtime.tv_sec = get_seconds(NULL);
 	inode->i_flags = 0;
 	inode->i_blocks = 0;
+	inode->i_blksize = EXT2_IO_SIZE;
 	// NOTE: MQ 2020-11-18 When creating inode, it is safe to assume that it is linked to dir entry?
 	inode->i_nlink = 1;
+	insert_inode_hash(inode);
   
   ext2_inode *ei = EXT2_INODE(inode);
-	uint32_t block = ext2_create_block(inode->i_sb);
+	// near the inode table of its group, the first block of directory is filled below
+	int32_t block = ext2_create_block(inode, 0, !S_ISDIR(mode));
+	if (block < 0) {
+		ext2_discard_new_inode(inode);
+		ext2_sync_metadata(sb);
+		return ERR_PTR(block);
+	}
 	ei->i_block[0] = block;
 	inode->i_blocks += 1;
+	mark_inode_dirty(inode);
   if (S_ISCHR(mode)) {
     inode->i_rdev = dev;
 	  init_special_inode(inode, mode, dev);
-    ext2_write_inode(inode);
   } else if (S_ISREG(mode)) {
 		inode->i_op = &ext2_file_inode_operations;
 		inode->i_fop = &ext2_file_operations;
-    ext2_write_inode(inode);
-    
 	} else if (S_ISDIR(mode)) {
 		inode->i_op = &ext2_dir_inode_operations;
 		inode->i_fop = &ext2_dir_operations;
     inode->i_size += sb->s_blocksize;
-		ext2_write_inode(inode);
 
-		char *block_buf = ext2_bread_block(inode->i_sb, block);
+		char *block_buf = kcalloc(sb->s_blocksize, sizeof(char));
 
 		ext2_dir_entry *c_entry = (ext2_dir_entry *)block_buf;
 		c_entry->ino = inode->i_ino;
@@ -318,18 +277,27 @@ static struct vfs_inode *ext2_create_inode(struct vfs_inode *dir, struct vfs_den
 
 	dentry->d_inode = inode;
 
-	if (ext2_create_entry(sb, dir, dentry) >= 0)
-		return inode;
-	return NULL;
+	int ret = ext2_create_entry(sb, dir, dentry);
+	if (ret < 0) {
+		dentry->d_inode = NULL;
+		ext2_discard_new_inode(inode);
+		inode = ERR_PTR(ret);
+	} else
+		write_inode_now(inode);
+	// inodes and allocation metadata are written once for the whole creation
+	write_inode_now(dir);
+	ext2_sync_metadata(sb);
+	return inode;
 }
 
 static int ext2_mknod(struct vfs_inode *dir, struct vfs_dentry *dentry, int mode, int32_t dev) {
 	struct vfs_inode *inode = ext2_lookup_inode(dir, dentry->d_name);
 	if (inode == NULL)
 		inode = ext2_create_inode(dir, dentry, mode, dev);
-	
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+
 	dentry->d_inode = inode;
-  
 	return 0;
 }
 
@@ -9,8 +9,6 @@
 
 #include "kernel/fs/ext2/ext2.h"
 
-#define SUPERBLOCK_SIZE_BLOCKS 1
-
 char *ext2_bread(struct vfs_superblock* sb, uint32_t block, uint32_t size) {
 	return bread(sb->mnt_devname, block * (sb->s_blocksize / BYTES_PER_SECTOR), size);
 }
@@ -27,98 +25,75 @@ void ext2_bwrite_block(struct vfs_superblock* sb, uint32_t block, char *buf) {
 	return ext2_bwrite(sb, block, buf, sb->s_blocksize);
 }
 
-static int find_unused_block_number(struct vfs_superblock *sb) {
-	ext2_superblock *ext2_sb = EXT2_SB(sb);
-
-	uint32_t number_of_groups = div_ceil(ext2_sb->s_blocks_count, ext2_sb->s_blocks_per_group);
-	for (uint32_t group = 0; group < number_of_groups; group += 1) {
-		ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
-		unsigned char *block_bitmap = (unsigned char *)ext2_bread_block(sb, gdp->bg_block_bitmap);
-
-		for (uint32_t i = 0; i < sb->s_blocksize; ++i)
-			if (block_bitmap[i] != 0xff)
-				for (int j = 0; j < 8; ++j)
-					if (!(block_bitmap[i] & (1 << j)))
-						return group * ext2_sb->s_blocks_per_group + i * 8 + j + ext2_sb->s_first_data_block;
+// goal 0 means after the last block allocated for the inode,
+// block which caller is going to overwrite as a whole doesn't need to be zeroed
+int32_t ext2_create_block(struct vfs_inode *inode, uint32_t goal, bool zero) {
+	struct vfs_superblock *sb = inode->i_sb;
+	int32_t block = ext2_alloc_block(inode, goal);
+	if (block < 0 || !zero)
+		return block;
+
+	// clear block data, zeroed buffer is shared and never written
+	static char *zero_buf = NULL;
+	static uint32_t zero_buf_size = 0;
+	if (zero_buf_size < sb->s_blocksize) {
+		kfree(zero_buf);
+		zero_buf = kcalloc(sb->s_blocksize, sizeof(char));
+		zero_buf_size = sb->s_blocksize;
 	}
-	return -ENOSPC;
-}
-
-uint32_t ext2_create_block(struct vfs_superblock *sb) {
-	ext2_superblock* ext2_sb = EXT2_SB(sb);
-	uint32_t block = find_unused_block_number(sb);
-
-	// superblock
-	ext2_sb->s_free_blocks_count -= 1;
-	sb->s_op->write_super(sb);
-
-	// group
-	ext2_group_desc *gdp = ext2_get_group_desc(sb, get_group_from_block(ext2_sb, block));
-	gdp->bg_free_blocks_count -= 1;
-	ext2_write_group_desc(sb, gdp);
-
-	// block bitmap
-	char *bitmap_buf = ext2_bread_block(sb, gdp->bg_block_bitmap);
-	uint32_t relative_block = get_relative_block_in_group(ext2_sb, block);
-	bitmap_buf[relative_block / 8] |= 1 << (relative_block % 8); // set block as used
-	ext2_bwrite_block(sb, gdp->bg_block_bitmap, bitmap_buf);
-  kfree(bitmap_buf);
-
-	// clear block data
-	char *data_buf = kcalloc(sb->s_blocksize, sizeof(char));
-	ext2_bwrite_block(sb, block, data_buf);
-  kfree(data_buf);
+	ext2_bwrite_block(sb, block, zero_buf);
 
 	return block;
 }
 
-ext2_group_desc *ext2_get_group_desc(struct vfs_superblock* sb, uint32_t group) {
-	ext2_group_desc* gdp = kcalloc(1, sizeof(ext2_group_desc));
+// inode table block which contains the inode and its offset in that block
+uint32_t ext2_inode_location(struct vfs_superblock *sb, ino_t ino, uint32_t *offset) {
 	ext2_superblock* ext2_sb = EXT2_SB(sb);
-  // refere GDT from first block group as other GDTs are just copies
-	uint32_t block = ext2_sb->s_first_data_block + SUPERBLOCK_SIZE_BLOCKS + (group / EXT2_GROUP_DESC_PER_BLOCK(ext2_sb));
-	char *group_block_buf = ext2_bread_block(sb, block);
-	uint32_t offset = group % EXT2_GROUP_DESC_PER_BLOCK(ext2_sb) * sizeof(ext2_group_desc);
-	memcpy(gdp, group_block_buf + offset, sizeof(ext2_group_desc));
-  kfree(group_block_buf);
-	return gdp;
+	ext2_group_desc *gdp = ext2_get_group_desc(sb, get_group_from_inode(ext2_sb, ino));
+  ino_t rel_inode = get_relative_inode_in_group(ext2_sb, ino);
+  *offset = (rel_inode % EXT2_INODES_PER_BLOCK(ext2_sb)) * ext2_sb->s_inode_size;
+	return gdp->bg_inode_table + rel_inode / EXT2_INODES_PER_BLOCK(ext2_sb);
 }
 
-void ext2_write_group_desc(struct vfs_superblock *sb, ext2_group_desc *gdp) {
-	ext2_superblock *ext2_sb = EXT2_SB(sb);
-  // works because bg_block_bitmap is always within its block group
-	uint32_t group = get_group_from_block(ext2_sb, gdp->bg_block_bitmap);
-	uint32_t block = ext2_sb->s_first_data_block + SUPERBLOCK_SIZE_BLOCKS; + group / EXT2_GROUP_DESC_PER_BLOCK(ext2_sb);
-	uint32_t offset = group % EXT2_GROUP_DESC_PER_BLOCK(ext2_sb) * sizeof(ext2_group_desc);
-	char *group_block_buf = ext2_bread_block(sb, block);
-	memcpy(group_block_buf + offset, gdp, sizeof(ext2_group_desc));
-	ext2_bwrite_block(sb, block, group_block_buf);
-  kfree(group_block_buf);
+// raw inode is filled by the caller
+ext2_inode_info *ext2_new_inode_info() {
+	ext2_inode_info *ii = kcalloc(1, sizeof(ext2_inode_info));
+	ii->bmap_lock = semaphore_alloc(1, 1);
+	return ii;
 }
 
 struct ext2_inode* ext2_get_inode(struct vfs_superblock* sb, ino_t ino) {
-	ext2_superblock* ext2_sb = EXT2_SB(sb);
-  ext2_fs_info* mi = EXT2_INFO(sb);
-	uint32_t group = get_group_from_inode(ext2_sb, ino);
-	ext2_group_desc *gdp = ext2_get_group_desc(sb, group);
-  ino_t rel_inode = get_relative_inode_in_group(ext2_sb, ino);
-	uint32_t block = gdp->bg_inode_table + rel_inode / EXT2_INODES_PER_BLOCK(ext2_sb);
-	kfree(gdp);
-  uint32_t offset = (rel_inode % EXT2_INODES_PER_BLOCK(ext2_sb)) * ext2_sb->s_inode_size;
+	uint32_t offset;
+	uint32_t block = ext2_inode_location(sb, ino, &offset);
 	char *table_buf = ext2_bread_block(sb, block);
-  ext2_inode* inode = kcalloc(1, ext2_sb->s_inode_size);
-  memcpy(inode, table_buf + offset, ext2_sb->s_inode_size);
+  ext2_inode* inode = &ext2_new_inode_info()->raw;
+  memcpy(inode, table_buf + offset, sizeof(ext2_inode));
   kfree(table_buf);
 	return inode;
 }
 
 void ext2_write_super(struct vfs_superblock *sb) {
   ext2_superblock *ext2_sb = EXT2_SB(sb);
+  sb->s_dirt = false;
   bwrite(sb->mnt_devname, EXT2_SUPERRBLOCK_POS, (char *)ext2_sb, sizeof(ext2_superblock));
 }
 
+// allocation metadata (bitmaps, group descriptors and superblock) is only marked dirty,
+// it is written once at the end of an operation instead of for every block
+void ext2_sync_metadata(struct vfs_superblock *sb) {
+	semaphore_down(EXT2_INFO(sb)->s_lock);
+	ext2_sync_groups(sb);
+	if (sb->s_dirt)
+		ext2_write_super(sb);
+	semaphore_up(EXT2_INFO(sb)->s_lock);
+}
+
+void ext2_sync_fs(struct vfs_superblock *sb) {
+	sync_inodes(sb);
+	ext2_sync_metadata(sb);
+}
+
 void ext2_write_inode(struct vfs_inode* i) {
-  ext2_superblock *ext2_sb = EXT2_SB(i->i_sb);
 	ext2_inode *ei = EXT2_INODE(i);
 
 	ei->i_mode = i->i_mode;
@@ -136,12 +111,11 @@ void ext2_write_inode(struct vfs_inode* i) {
 
 	if (S_ISCHR(i->i_mode))
 		ei->i_block[0] = i->i_rdev;
+	else
+		ext2_bmap_sync(i);
 
-	uint32_t group = get_group_from_inode(ext2_sb, i->i_ino);
-  ext2_group_desc *gdp = ext2_get_group_desc(i->i_sb, group);
-	uint32_t block = gdp->bg_inode_table + get_relative_inode_in_group(ext2_sb, i->i_ino) / EXT2_INODES_PER_BLOCK(ext2_sb);
-	kfree(gdp); 
-  uint32_t offset = (get_relative_inode_in_group(ext2_sb, i->i_ino) % EXT2_INODES_PER_BLOCK(ext2_sb)) * ext2_sb->s_inode_size;
+	uint32_t offset;
+	uint32_t block = ext2_inode_location(i->i_sb, i->i_ino, &offset);
 	char *buf = ext2_bread_block(i->i_sb, block);
 	memcpy(buf + offset, ei, sizeof(struct ext2_inode));
 	ext2_bwrite_block(i->i_sb, block, buf);
@@ -177,6 +151,17 @@ struct vfs_inode* ext2_alloc_inode(struct vfs_superblock* sb) {
 	return i;
 }
 
+void ext2_destroy_inode(struct vfs_inode* i) {
+	if (EXT2_INODE_INFO(i)->prealloc_count) {
+		ext2_discard_prealloc(i);
+		ext2_sync_metadata(i->i_sb);
+	}
+	ext2_bmap_release(i);
+	semaphore_free(EXT2_INODE_INFO(i)->bmap_lock);
+	kfree(i->i_fs_info);
+	kfree(i);
+}
+
 void ext2_fill_super(struct vfs_superblock* vsb) {
   ext2_superblock* sb = bread(vsb->mnt_devname, EXT2_SUPERRBLOCK_POS, sizeof(ext2_superblock));
   assert_superblock(sb);
@@ -199,6 +184,7 @@ void ext2_fill_super(struct vfs_superblock* vsb) {
   fs_info->ino_upper_levels[2] = bp_count * bp_count + fs_info->ino_upper_levels[1];
   fs_info->ino_upper_levels[3] = bp_count * bp_count * bp_count + fs_info->ino_upper_levels[2];
   fs_info->sb = sb;
+  fs_info->s_lock = semaphore_alloc(1, 1);
 
   assert(vsb->s_blocksize <= PAGE_SIZE);
   assert(vsb->s_blocksize >= BYTES_PER_SECTOR);
@@ -213,6 +199,7 @@ void ext2_fill_super(struct vfs_superblock* vsb) {
   }
 
   vsb->s_fs_info = fs_info;
+  assert(ext2_load_groups(vsb) == 0);
 }
 
 void ext2_read_inode(struct vfs_inode* i) {
@@ -230,7 +217,7 @@ void ext2_read_inode(struct vfs_inode* i) {
 	i->i_mtime.tv_sec = raw_node->i_mtime;
 	i->i_atime.tv_nsec = i->i_ctime.tv_nsec = i->i_mtime.tv_nsec = 0;
 
-	i->i_blksize = PMM_FRAME_SIZE; /* This is the optimal IO size (for stat), not the fs block size */
+	i->i_blksize = EXT2_IO_SIZE;
 	i->i_blocks = raw_node->i_blocks;
 	i->i_flags = raw_node->i_flags;
 	i->i_fs_info = raw_node;
@@ -256,9 +243,7 @@ struct vfs_mount* ext2_mount(struct vfs_file_system_type *fs_type, char *dev_nam
 	sb->mnt_devname = strdup(dev_name);
 	ext2_fill_super(sb);
 
-  struct vfs_inode* i_root = ext2_alloc_inode(sb);
-	i_root->i_ino = EXT2_ROOT_INO;
-	ext2_read_inode(i_root);
+  struct vfs_inode* i_root = iget(sb, EXT2_ROOT_INO);
   assert(S_ISDIR(i_root->i_mode)); // check if directory
 
 	struct vfs_dentry* d_root = alloc_dentry(NULL, dir_name);
@@ -279,6 +264,8 @@ struct vfs_super_operations ext2_super_operations = {
 	.read_inode = ext2_read_inode,
 	.write_inode = ext2_write_inode,
 	.write_super = ext2_write_super,
+	.destroy_inode = ext2_destroy_inode,
+	.sync_fs = ext2_sync_fs,
 };
 
 struct vfs_file_system_type ext2_fs_type = {
@@ -0,0 +1,211 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/include/list.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/util/debug.h"
+
+#include "kernel/fs/vfs.h"
+
+// inodes are hashed by (superblock, ino), unused ones stay in lru list until evicted.
+// Dirty inode is written when it's synced, released by the last user or evicted
+static struct list_head inode_hashtable[ICACHE_HASH_SIZE];
+static LIST_HEAD(inode_lru);
+static struct icache_stats icache_stats;
+
+static struct list_head *i_hash_bucket(struct vfs_superblock *sb, ino_t ino) {
+  uint32_t hash = (((uint32_t)sb >> 4) ^ ino) * 2654435761u;
+  return &inode_hashtable[hash % ICACHE_HASH_SIZE];
+}
+
+static void i_write(struct vfs_inode *inode) {
+  inode->i_state &= ~I_DIRTY;
+  if (inode->i_sb && inode->i_sb->s_op && inode->i_sb->s_op->write_inode) {
+    inode->i_sb->s_op->write_inode(inode);
+    icache_stats.writes++;
+  }
+}
+
+static void i_destroy(struct vfs_inode *inode) {
+  if (inode->i_sb && inode->i_sb->s_op && inode->i_sb->s_op->destroy_inode)
+    inode->i_sb->s_op->destroy_inode(inode);
+  else
+    kfree(inode);
+}
+
+static void i_unhash(struct vfs_inode *inode) {
+  list_del_init(&inode->i_hash);
+  inode->i_state &= ~I_HASHED;
+  icache_stats.entries--;
+}
+
+// inode which has been just created is added to the cache with one reference
+void insert_inode_hash(struct vfs_inode *inode) {
+  uint32_t flags = irq_save();
+  list_add(&inode->i_hash, i_hash_bucket(inode->i_sb, inode->i_ino));
+  inode->i_state |= I_HASHED;
+  atomic_set(&inode->i_count, 1);
+  icache_stats.entries++;
+  irq_restore(flags);
+}
+
+static struct vfs_inode *ifind(struct vfs_superblock *sb, ino_t ino) {
+  struct vfs_inode *iter;
+  list_for_each_entry(iter, i_hash_bucket(sb, ino), i_hash) {
+    if (iter->i_sb != sb || iter->i_ino != ino)
+      continue;
+
+    if (atomic_read(&iter->i_count) == 0) {
+      list_del_init(&iter->i_lru);
+      icache_stats.unused--;
+    }
+    atomic_inc(&iter->i_count);
+    return iter;
+  }
+  return NULL;
+}
+
+// returns inode with a reference taken, it is read only if it's not in the cache
+struct vfs_inode *iget(struct vfs_superblock *sb, ino_t ino) {
+  uint32_t flags = irq_save();
+  struct vfs_inode *inode = ifind(sb, ino);
+  if (inode) {
+    icache_stats.hits++;
+    irq_restore(flags);
+    return inode;
+  }
+  icache_stats.misses++;
+  irq_restore(flags);
+
+  inode = sb->s_op->alloc_inode(sb);
+  inode->i_ino = ino;
+  sb->s_op->read_inode(inode);
+
+  // someone else might read it while we were waiting for disk
+  flags = irq_save();
+  struct vfs_inode *cached = ifind(sb, ino);
+  if (cached) {
+    irq_restore(flags);
+    i_destroy(inode);
+    return cached;
+  }
+  irq_restore(flags);
+
+  insert_inode_hash(inode);
+  return inode;
+}
+
+// returns cached inode with a reference taken, NULL if reading it would go to disk
+struct vfs_inode *ilookup(struct vfs_superblock *sb, ino_t ino) {
+  uint32_t flags = irq_save();
+  struct vfs_inode *inode = ifind(sb, ino);
+  if (inode)
+    icache_stats.hits++;
+  irq_restore(flags);
+  return inode;
+}
+
+void mark_inode_dirty(struct vfs_inode *inode) {
+  inode->i_state |= I_DIRTY;
+}
+
+void write_inode_now(struct vfs_inode *inode) {
+  if (inode->i_state & I_DIRTY)
+    i_write(inode);
+}
+
+// inodes which are not hashed (devfs, pipes) are owned by their dentry
+void iput(struct vfs_inode *inode) {
+  if (!inode || !(inode->i_state & I_HASHED))
+    return;
+
+  uint32_t flags = irq_save();
+  assert(atomic_read(&inode->i_count) > 0, "iput of unused inode %d", inode->i_ino);
+  if (atomic_read(&inode->i_count) > 1) {
+    atomic_dec(&inode->i_count);
+    irq_restore(flags);
+    return;
+  }
+  irq_restore(flags);
+
+  // the last reference is kept while writing, so nobody can find the inode half released
+  write_inode_now(inode);
+
+  flags = irq_save();
+  atomic_dec(&inode->i_count);
+  if (atomic_read(&inode->i_count) > 0) {
+    irq_restore(flags);
+    return;
+  }
+  if (!inode->i_nlink) {
+    i_unhash(inode);
+    irq_restore(flags);
+    i_destroy(inode);
+    return;
+  }
+
+  list_add_tail(&inode->i_lru, &inode_lru);
+  icache_stats.unused++;
+  bool shrink = icache_stats.unused > ICACHE_MAX_UNUSED;
+  irq_restore(flags);
+
+  if (shrink)
+    icache_shrink(ICACHE_SHRINK_BATCH);
+}
+
+// unused inodes are clean, they are written back when the last reference is dropped
+uint32_t icache_shrink(uint32_t count) {
+  uint32_t freed = 0;
+  LIST_HEAD(victims);
+
+  uint32_t flags = irq_save();
+  while (freed < count && !list_empty(&inode_lru)) {
+    struct vfs_inode *inode = list_first_entry(&inode_lru, struct vfs_inode, i_lru);
+    list_del(&inode->i_lru);
+    icache_stats.unused--;
+    i_unhash(inode);
+    list_add_tail(&inode->i_lru, &victims);
+    freed++;
+  }
+  icache_stats.evicted += freed;
+  irq_restore(flags);
+
+  struct vfs_inode *iter, *next;
+  list_for_each_entry_safe(iter, next, &victims, i_lru) {
+    write_inode_now(iter);
+    i_destroy(iter);
+  }
+  return freed;
+}
+
+static struct vfs_inode *find_dirty_inode(struct vfs_superblock *sb) {
+  for (uint32_t i = 0; i < ICACHE_HASH_SIZE; ++i) {
+    struct vfs_inode *iter;
+    list_for_each_entry(iter, &inode_hashtable[i], i_hash) {
+      if ((!sb || iter->i_sb == sb) && iter->i_state & I_DIRTY)
+        return ifind(iter->i_sb, iter->i_ino);
+    }
+  }
+  return NULL;
+}
+
+// writes dirty inodes of the superblock, all of them if sb is NULL
+void sync_inodes(struct vfs_superblock *sb) {
+  while (true) {
+    uint32_t flags = irq_save();
+    struct vfs_inode *inode = find_dirty_inode(sb);
+    irq_restore(flags);
+
+    if (!inode)
+      break;
+    write_inode_now(inode);
+    iput(inode);
+  }
+}
+
+struct icache_stats *get_icache_stats() {
+  return &icache_stats;
+}
+
+void icache_init() {
+  for (uint32_t i = 0; i < ICACHE_HASH_SIZE; ++i)
+    INIT_LIST_HEAD(&inode_hashtable[i]);
+}
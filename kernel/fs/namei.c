@@ -44,24 +44,18 @@ void vfs_build_path_backward(struct vfs_dentry *dentry, char *path) {
   kfree(tmp);
 }
 
-static void absolutize_path_from_process(const char *path, char **abs_path) {
-  if (path[0] != '/') {
-    struct process *current_process = get_current_process();
-    *abs_path = kcalloc(MAXPATHLEN, sizeof(char));
-    vfs_build_path_backward(current_process->fs->d_root, *abs_path);
-    strcat(*abs_path, "/");
-    strcat(*abs_path, path);
-  } else
-    *abs_path = path;
+int vfs_unlink(const char *path, int flag) {
+  return vfs_unlinkat(AT_FDCWD, path, flag);
 }
 
-int vfs_unlink(const char *path, int flag) {
+int vfs_unlinkat(int dirfd, const char *path, int flag) {
   struct process *cur_proc = get_current_process();
 
-  int ret = vfs_open(path, O_RDONLY);
+  int fd = vfs_openat(dirfd, path, O_RDONLY, 0);
+  int ret = fd;
 
-  if (ret >= 0) {
-    struct vfs_file *file = cur_proc->files->fd[ret];
+  if (fd >= 0) {
+    struct vfs_file *file = cur_proc->files->fd[fd];
     if (!file)
       ret = -EBADF;
     else if (flag & AT_REMOVEDIR && file->f_dentry->d_inode->i_mode & S_IFREG)
@@ -70,9 +64,13 @@ int vfs_unlink(const char *path, int flag) {
       struct vfs_inode *dir = file->f_dentry->d_parent->d_inode;
       if (dir->i_op && dir->i_op->unlink)
         ret = dir->i_op->unlink(dir, file->f_dentry->d_name);
-      list_del(&file->f_dentry->d_sibling);
+      // cached dentry is freed when the file is closed
+      if (file->f_dentry->d_flags & DCACHE_HASHED)
+        vfs_cache_remove(file->f_dentry);
+      else
+        list_del(&file->f_dentry->d_sibling);
     }
-    vfs_close(ret);
+    vfs_close(fd);
   }
 
   return ret;
@@ -15,6 +15,9 @@ struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name) {
   d->d_name = strdup(name);
   d->d_parent = parent;
   INIT_LIST_HEAD(&d->d_subdirs);
+  INIT_LIST_HEAD(&d->d_sibling);
+  INIT_LIST_HEAD(&d->d_hash);
+  INIT_LIST_HEAD(&d->d_lru);
 
   if (parent)
     d->d_sb = parent->d_sb;
@@ -64,6 +67,7 @@ int32_t vfs_close(int32_t fd) {
     if (!atomic_read(&file->f_count)) {
 			if (file->f_op && file->f_op->release)
 				ret = file->f_op->release(file->f_dentry->d_inode, file);
+			dput(file->f_dentry);
 			kfree(file);
       memset(file, 0, sizeof(struct vfs_file));
 		}
@@ -77,7 +81,7 @@ int32_t vfs_close(int32_t fd) {
   return ret;
 }
 
-static void generic_fillattr(struct vfs_inode *inode, struct kstat *stat) {
+void generic_fillattr(struct vfs_inode *inode, struct kstat *stat) {
   // stat->st_dev = inode->i_sb->s_dev;
   stat->st_ino = inode->i_ino;
   stat->st_mode = inode->i_mode;
@@ -130,54 +134,103 @@ int vfs_stat(const char *path, struct kstat *stat) {
 	if (ret < 0)
 		return ret;
 
-	return do_getattr(nd.dentry, stat);
+	ret = do_getattr(nd.dentry, stat);
+	dput(nd.dentry);
+	return ret;
 }
 
 int vfs_mknod(const char *path, int mode, int32_t dev) {
-  char *dir = NULL;
-  char *name = NULL;
-  strlsplat(path, strliof(path, "/"), &dir, &name);
+  return vfs_mknodat(AT_FDCWD, path, mode, dev);
+}
 
-  struct nameidata nd;
-  int ret = vfs_jmp(&nd, dir, 0, S_IFDIR);
-  if (ret < 0)
-    return ret;
+// parent is walked with the path up to the last slash, the slash itself is kept for "/name"
+int vfs_mknodat(int dirfd, const char *path, int mode, int32_t dev) {
+  char *slash = strrstr((char *)path, "/");
+  char *name = slash ? slash + 1 : (char *)path;
+  if (!*name)
+    return -EINVAL;
 
-  struct vfs_dentry *d_child = alloc_dentry(nd.dentry, name);
-  ret = nd.dentry->d_inode->i_op->mknod(nd.dentry->d_inode, d_child, mode, dev);
+  struct nameidata nd;
+  int ret = vfs_jmpat_len(&nd, dirfd, path, slash ? slash - path + 1 : 0, 0, S_IFDIR);
   if (ret < 0)
     return ret;
 
-  list_add_tail(&d_child->d_sibling, &nd.dentry->d_subdirs);
+  struct vfs_dentry *d_child = vfs_cache_get(nd.dentry, name);
+  if (d_child) {
+    // only negative dentry can be replaced by the node
+    bool exists = d_child->d_inode != NULL;
+    if (!exists)
+      vfs_cache_remove(d_child);
+    dput(d_child);
+    if (exists) {
+      dput(nd.dentry);
+      return -EEXIST;
+    }
+  }
 
+  d_child = alloc_dentry(nd.dentry, name);
+  ret = nd.dentry->d_inode->i_op->mknod(nd.dentry->d_inode, d_child, mode, dev);
+  // readdir of memory directories expects every child to have an inode
+  if (ret >= 0 && !d_child->d_inode)
+    ret = -EIO;
+  if (ret >= 0)
+    list_add_tail(&d_child->d_sibling, &nd.dentry->d_subdirs);
+  else
+    dput(d_child);
+
+  dput(nd.dentry);
   return ret;
 }
 
-int generic_memory_readdir(struct vfs_file *file, struct dirent *dirent, uint32_t count) {
-  struct vfs_dentry *dentry = file->f_dentry;
-  int entries_size = 0; // list_count(&dentry->d_subdirs);
+// record is appended to buf at *size, returns NULL if it doesn't fit into count
+struct dirent *dirent_emit(char *buf, uint32_t *size, uint32_t count, bool plus, ino_t ino, off_t next,
+                           mode_t type, const char *name, uint32_t name_len) {
+  uint32_t reclen = plus ? DIRENT_PLUS_RECLEN(name_len) : DIRENT_RECLEN(name_len);
+  if (*size + reclen > count)
+    return NULL;
+
+  struct dirent *dirent = plus ? &((struct dirent_plus *)(buf + *size))->d_ent : (struct dirent *)(buf + *size);
+  dirent->d_ino = ino;
+  dirent->d_off = next;
+  dirent->d_reclen = reclen;
+  dirent->d_type = type;
+  memcpy(dirent->d_name, name, name_len);
+  dirent->d_name[name_len] = 0;
+  *size += reclen;
+  return dirent;
+}
 
-  struct dirent *idrent = dirent;
+// f_pos is the index of the next child
+static int memory_readdir(struct vfs_file *file, char *buf, uint32_t count, bool plus) {
   struct vfs_dentry *iter;
-  int total_len = 0;
-  list_for_each_entry(iter, &dentry->d_subdirs, d_sibling) {
-    total_len = sizeof(struct dirent);
-    
-    if (entries_size + total_len > count)
-			break;
-
-    memcpy(idrent->d_name, iter->d_name, strlen(iter->d_name));
-    idrent->d_reclen = sizeof(struct dirent); // + len + 1;
-    idrent->d_ino = iter->d_inode->i_ino;
-    idrent->d_type = iter->d_inode->i_mode;
-    idrent = (struct dirent *)((char *)idrent + idrent->d_reclen);
-    entries_size += idrent->d_reclen;
+  uint32_t size = 0;
+  off_t pos = 0;
+  list_for_each_entry(iter, &file->f_dentry->d_subdirs, d_sibling) {
+    if (pos++ < file->f_pos)
+      continue;
+
+    struct vfs_inode *inode = iter->d_inode;
+    struct dirent *dirent = dirent_emit(buf, &size, count, plus, inode->i_ino, pos, inode->i_mode,
+                                        iter->d_name, strlen(iter->d_name));
+    if (!dirent)
+      return size ? size : -EINVAL;
+
+    if (plus)
+      generic_fillattr(inode, &container_of(dirent, struct dirent_plus, d_ent)->d_stat);
+    file->f_pos = pos;
   }
-  return entries_size;
+  return size;
+}
+
+int generic_memory_readdir(struct vfs_file *file, struct dirent *dirent, uint32_t count) {
+  return memory_readdir(file, (char *)dirent, count, false);
+}
+
+int generic_memory_readdirplus(struct vfs_file *file, struct dirent_plus *dirent, uint32_t count) {
+  return memory_readdir(file, (char *)dirent, count, true);
 }
 
 int32_t vfs_open(const char *path, int32_t flags, ...) {
-  int fd = find_unused_fd_slot(0);
   mode_t mode = 0;
 
   if (flags & O_CREAT) {
@@ -188,11 +241,18 @@ int32_t vfs_open(const char *path, int32_t flags, ...) {
     va_end(ap);
   }
 
+  return vfs_openat(AT_FDCWD, path, flags, mode);
+}
+
+int32_t vfs_openat(int dirfd, const char *path, int32_t flags, mode_t mode) {
+  int fd = find_unused_fd_slot(0);
+
   struct nameidata nd;
-  int ret = vfs_jmp(&nd, path, flags, mode);
+  int ret = vfs_jmpat(&nd, dirfd, path, flags, mode);
   if (ret < 0)
     return ret;
 
+  // reference of the walk is kept by the file
   struct vfs_file *file = alloc_vfs_file();
   file->f_dentry = nd.dentry;
   file->f_vfsmnt = nd.mnt;
@@ -208,6 +268,7 @@ int32_t vfs_open(const char *path, int32_t flags, ...) {
   if (file->f_op && file->f_op->open) {
     ret = file->f_op->open(nd.dentry->d_inode, file);
     if (ret < 0) {
+      dput(nd.dentry);
       kfree(file);
       return ret;
     }
@@ -7,6 +7,9 @@ int32_t do_pipe(int32_t *fd) {
   struct vfs_inode *inode = pipe_super_operations.alloc_inode(NULL);
   struct vfs_dentry *dentry = alloc_dentry(NULL, "pipe");
   dentry->d_inode = inode;
+  // not in the cache, freed with the last file
+  dentry->d_flags = DCACHE_UNLINKED;
+  dentry->d_count = 2;
 
   struct vfs_file *f1 = alloc_vfs_file();
 	f1->f_flags = O_RDONLY;
@@ -1,5 +1,6 @@
 #include "kernel/include/errno.h"
 #include "kernel/include/fcntl.h"
+#include "kernel/proc/elf.h"
 #include "kernel/proc/task.h"
 #include "kernel/util/debug.h"
 
@@ -131,6 +132,9 @@ uint32_t vfs_fwrite(int32_t fd, char* buf, int32_t count) {
 		ppos = file->f_dentry->d_inode->i_size;
   
   ret = file->f_op->write(file, buf, count, ppos);
+  // running processes keep the old text, next exec reads the file again
+  if (ret > 0)
+    elf_image_invalidate(file->f_dentry->d_inode);
   
   /*
 	if (file->f_mode & FMODE_CAN_WRITE)
@@ -0,0 +1,27 @@
+#include "kernel/proc/task.h"
+
+#include "kernel/fs/vfs.h"
+
+// metadata which operations only mark dirty is written every SYNC_INTERVAL ms,
+// sync_fs takes the locks of the filesystem itself
+extern struct list_head vfsmntlist;
+
+void vfs_sync() {
+  struct vfs_mount *iter;
+  list_for_each_entry(iter, &vfsmntlist, sibling) {
+    struct vfs_superblock *sb = iter->mnt_sb;
+    if (sb && sb->s_op && sb->s_op->sync_fs)
+      sb->s_op->sync_fs(sb);
+  }
+}
+
+static void kflushd() {
+  while (true) {
+    thread_sleep(SYNC_INTERVAL);
+    vfs_sync();
+  }
+}
+
+void vfs_sync_init() {
+  create_system_process((virtual_addr)kflushd, "kflushd");
+}
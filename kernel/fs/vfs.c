@@ -9,6 +9,7 @@
 #include "kernel/system/time.h"
 #include "kernel/util/debug.h"
 #include "kernel/include/errno.h"
+#include "kernel/include/err.h"
 #include "kernel/include/fcntl.h"
 #include "kernel/include/limits.h"
 #include "kernel/util/string/string.h"
@@ -31,82 +32,66 @@ char* months[12] = {
     "nov",
     "dec"};
 
+#define LS_BUFFER_SIZE 1024
+
+// attributes come with entries, listing doesn't read an inode per entry
 int32_t vfs_ls(const char* path) {
   int32_t fd = 0;
   if ((fd = vfs_open(path, 0)) < 0)
     return fd;
 
-  //  check if dir
-  /*
-  if (!S_ISDIR(nd.dentry->d_inode->i_mode)) {
+  struct vfs_file* file = get_current_process()->files->fd[fd];
+  if (!file->f_op->readdirplus) {
+    vfs_close(fd);
     return -ENOTDIR;
   }
-  */
-
-  struct vfs_file* file = get_current_process()->files->fd[fd];
-  int size = file->f_dentry->d_inode->i_size;
-  uint8_t* buf = kcalloc(size, sizeof(uint8_t));
-  uint32_t count = file->f_op->readdir(file, buf, size);
 
-  struct vfs_inode inode;
-
-  for (int i = 0; i < count;) {
-    
-    char name[12] = "           ";
-    struct dirent* iter = &buf[i];
-    i += iter->d_reclen;
-
-    inode.i_ino = iter->d_ino;
-    inode.i_sb = file->f_dentry->d_inode->i_sb;
-
-    if (file->f_dentry->d_inode->i_sb->s_op->read_inode && inode.i_ino != 0) {
-      file->f_dentry->d_inode->i_sb->s_op->read_inode(&inode);
-
-      memcpy(&name, iter->d_name, strlen(iter->d_name));
-      if (!S_ISDIR(iter->d_type)) {
-        bool is_char_dev = S_ISCHR(iter->d_type);
-        if (is_char_dev) {
-          kprintf(BLU"\n%s", name);
-        } else {
-          kprintf(RED"\n%s", name);
-        }
-        
-        if (!is_char_dev) {
-          struct time* created = get_time(inode.i_ctime.tv_sec);
-          
-          kprintf("   %d %s %d%d:%d%d",
-              created->day,
-              months[created->month - 1],
-              created->hour / 10, created->hour % 10,
-              created->minute / 10, created->minute % 10);
-
-        
-          kprintf("   %u bytes", inode.i_size);
-        
-          kfree(created);
-        }
-        kprintf(COLOR_RESET);
-      } else {
+  char* buf = kcalloc(LS_BUFFER_SIZE, sizeof(char));
+  int32_t total = 0;
+  int32_t count;
+  while ((count = file->f_op->readdirplus(file, (struct dirent_plus *)buf, LS_BUFFER_SIZE)) > 0) {
+    total += count;
+    for (int i = 0; i < count;) {
+      struct dirent_plus* iter = (struct dirent_plus *)(buf + i);
+      struct kstat* stat = &iter->d_stat;
+      i += iter->d_ent.d_reclen;
+
+      char name[12] = "           ";
+      memcpy(&name, iter->d_ent.d_name, min_t(uint32_t, strlen(iter->d_ent.d_name), sizeof(name) - 1));
+      if (S_ISDIR(stat->st_mode)) {
         kprintf("\n%s", name);
+        continue;
       }
-    } else {
-      memcpy(&name, iter->d_name, strlen(iter->d_name));
-      if (!S_ISDIR(iter->d_type)) {
-        kprintf("\n%s", name);
-      } else {
-        kprintf(RED"\n%s"COLOR_RESET, name);
+
+      if (S_ISCHR(stat->st_mode)) {
+        kprintf(BLU"\n%s"COLOR_RESET, name);
+        continue;
       }
+
+      struct time* created = get_time(stat->st_ctim.tv_sec);
+      kprintf(RED"\n%s", name);
+      kprintf("   %d %s %d%d:%d%d",
+          created->day,
+          months[created->month - 1],
+          created->hour / 10, created->hour % 10,
+          created->minute / 10, created->minute % 10);
+      kprintf("   %u bytes", stat->st_size);
+      kprintf(COLOR_RESET);
+      kfree(created);
     }
-    
   }
+
   kfree(buf);
-  return count;
+  vfs_close(fd);
+  return count < 0 ? count : total;
 }
 
 struct vfs_inode* init_inode() {
 	struct vfs_inode *i = kcalloc(1, sizeof(struct vfs_inode));
 	i->i_blocks = 0;
 	i->i_size = 0;
+	INIT_LIST_HEAD(&i->i_hash);
+	INIT_LIST_HEAD(&i->i_lru);
 	//semaphore_alloc(&i->i_sem, 1);
 	return i;
 }
@@ -119,10 +104,13 @@ int32_t vfs_cd(const char* path) {
   }
 
   if (!S_ISDIR(nd.dentry->d_inode->i_mode)) {
+    dput(nd.dentry);
     return -ENOTDIR;
   }
 
+  // reference of the walk is kept by working directory
   struct process* cur_proc = get_current_process();
+  dput(cur_proc->fs->d_root);
   cur_proc->fs->d_root = nd.dentry;
   cur_proc->fs->mnt_root = nd.mnt;
   return 0;
@@ -177,89 +165,130 @@ static void init_rootfs(struct vfs_file_system_type* fs_type, char* dev_name) {
 
   struct process* cur = get_current_process();
 
-  cur->fs->d_root = mnt->mnt_root;
+  cur->fs->d_root = dget(mnt->mnt_root);
   cur->fs->mnt_root = mnt;
 }
 
-int vfs_jmp(struct nameidata* nd, const char* path, int32_t flags, mode_t mode) {
-  char* simplified = NULL;
-  if (!simplify_path(path, &simplified)) {
-    return -EINVAL;
-  }
-
-  const char* cur = simplified;
+// only the first `len` characters are walked, so the parent of the last component is found
+// without copying the path. Components go to the filesystem only on dentry cache miss
+static int path_walk(struct nameidata* nd, struct vfs_dentry* base, const char* path, uint32_t len,
+                     int32_t flags, mode_t mode) {
+  const char* cur = path;
+  const char* end = path + len;
 
   struct process* cur_proc = get_current_process();
   nd->mnt = cur_proc->fs->mnt_root;
 
-  // check if root dir
-  if (simplified[0] == '\/') {
-    nd->dentry = cur_proc->fs->mnt_root->mnt_root;
-    while ((char)(*cur) == '\/') {
+  if (cur < end && *cur == '/') {
+    base = cur_proc->fs->mnt_root->mnt_root;
+    while (cur < end && *cur == '/')
       cur++;
-    }
-  } else {
-    nd->dentry = cur_proc->fs->d_root;
   }
+  nd->dentry = dget(base);
 
   int ret = 0;
-  
-
-  while (*cur) {
+  while (cur < end) {
     char name[NAME_MAX + 1];
     int32_t i = 0;
-    int32_t length = strlen(cur);
 
-    while (cur[i] != '\/' && cur[i] != '\0') {
-      name[i] = cur[i];
+    while (cur + i < end && cur[i] != '/')
       ++i;
+
+    if (i > NAME_MAX) {
+      ret = -ENAMETOOLONG;
+      goto clean;
     }
+    memcpy(name, cur, i);
+    name[i] = '\0';
+
+    cur += i;
+    while (cur < end && *cur == '/')
+      cur++;
+    bool last = cur == end;
 
-    name[i] = '\0';  // null terminate
+    if (!strcmp(name, ".") || !strcmp(name, "..")) {
+      if (name[1] && nd->dentry->d_parent) {
+        struct vfs_dentry* parent = dget(nd->dentry->d_parent);
+        dput(nd->dentry);
+        nd->dentry = parent;
+      }
+      if (last && flags & O_CREAT && flags & O_EXCL) {
+        ret = -EEXIST;
+        goto clean;
+      }
+      continue;
+    }
 
-    while (cur[i] == '\/') {
-      ++i;
+    if (!S_ISDIR(nd->dentry->d_inode->i_mode)) {
+      ret = -ENOTDIR;
+      goto clean;
     }
 
-    struct vfs_dentry* d_child = NULL;
+    struct vfs_dentry* d_child = vfs_cache_get(nd->dentry, name);
 
-    if ((d_child = vfs_search_virt_subdirs(nd->dentry, name)) != NULL) {
-      nd->dentry = d_child;
+    // mount points and device nodes are not hashed
+    if (!d_child || !d_child->d_inode) {
+      struct vfs_dentry* d_virt = vfs_search_virt_subdirs(nd->dentry, name);
+      if (d_virt) {
+        if (d_child)
+          dput(d_child);
+        d_child = dget(d_virt);
+      }
+    }
 
-      if (i == length && flags & O_CREAT && flags & O_EXCL) {
+    if (d_child && d_child->d_inode) {
+      if (last && flags & O_CREAT && flags & O_EXCL) {
+        dput(d_child);
         ret = -EEXIST;
         goto clean;
       }
-
+    } else if (d_child && !(last && flags & O_CREAT)) {
+      // negative dentry
+      dput(d_child);
+      ret = -ENOENT;
+      goto clean;
     } else {
+      if (d_child) {
+        vfs_cache_remove(d_child);
+        dput(d_child);
+      }
       d_child = alloc_dentry(nd->dentry, name);
 
       struct vfs_inode* inode = NULL;
-      if (inode = nd->dentry->d_inode->i_op->lookup) {
+      if (nd->dentry->d_inode->i_op->lookup) {
         inode = nd->dentry->d_inode->i_op->lookup(nd->dentry->d_inode, name);
       }
 
       if (inode == NULL) {
-        if (i == length && flags & O_CREAT) {
+        if (last && flags & O_CREAT) {
           inode = nd->dentry->d_inode->i_op->create(nd->dentry->d_inode, d_child, mode, 0);
+          // creation failed, nothing is known about the name so it isn't cached
+          if (IS_ERR(inode)) {
+            ret = PTR_ERR(inode);
+            dput(d_child);
+            goto clean;
+          }
         } else {
           ret = -ENOENT;
-          kfree(d_child);
+          // remember that it doesn't exist
+          vfs_cache(d_child);
+          dput(d_child);
           goto clean;
         }
-      } else if (i == length && flags & O_CREAT && flags & O_EXCL) {
+      } else if (last && flags & O_CREAT && flags & O_EXCL) {
         ret = -EEXIST;
-        kfree(d_child);
+        d_child->d_inode = inode;
+        vfs_cache(d_child);
+        dput(d_child);
         goto clean;
       }
 
       d_child->d_inode = inode;
-      list_add_tail(&d_child->d_sibling, &nd->dentry->d_subdirs);
-      nd->dentry = d_child;
       vfs_cache(d_child);
     }
 
-    cur = &cur[i];
+    dput(nd->dentry);
+    nd->dentry = d_child;
   }
 
   // find what mnt we are in
@@ -269,10 +298,37 @@ int vfs_jmp(struct nameidata* nd, const char* path, int32_t flags, mode_t mode)
   }
 
 clean:
-  kfree(simplified);
+  if (ret < 0)
+    dput(nd->dentry);
   return ret;
 }
 
+// returns dentry with a reference taken, caller releases it with dput
+int vfs_jmp(struct nameidata* nd, const char* path, int32_t flags, mode_t mode) {
+  return vfs_jmpat(nd, AT_FDCWD, path, flags, mode);
+}
+
+// relative path starts from the directory of dirfd instead of the working directory
+int vfs_jmpat(struct nameidata* nd, int dirfd, const char* path, int32_t flags, mode_t mode) {
+  return vfs_jmpat_len(nd, dirfd, path, path ? strlen(path) : 0, flags, mode);
+}
+
+int vfs_jmpat_len(struct nameidata* nd, int dirfd, const char* path, uint32_t len, int32_t flags, mode_t mode) {
+  struct process* cur_proc = get_current_process();
+  struct vfs_dentry* base = cur_proc->fs->d_root;
+
+  if (dirfd != AT_FDCWD && (!len || path[0] != '/')) {
+    struct vfs_file* dir = dirfd >= 0 && dirfd < MAX_FD ? cur_proc->files->fd[dirfd] : NULL;
+    if (!dir)
+      return -EBADF;
+    if (!S_ISDIR(dir->f_dentry->d_inode->i_mode))
+      return -ENOTDIR;
+    base = dir->f_dentry;
+  }
+
+  return path_walk(nd, base, path, len, flags, mode);
+}
+
 void init_special_inode(struct vfs_inode* inode, mode_t mode, int32_t dev) {
   inode->i_mode = mode;
   if (S_ISCHR(mode)) {
@@ -310,6 +366,10 @@ struct vfs_mount* do_mount(const char* fstype, int flags, const char* path) {
   list_for_each_entry_safe(iter, next, &nd.dentry->d_subdirs, d_sibling) {
     if (!strcmp(iter->d_name, name)) {
       // TODO: MQ 2020-10-24 Make sure path is empty folder
+      if (iter->d_flags & DCACHE_HASHED) {
+        vfs_cache_remove(iter);
+        continue;
+      }
       list_del(&iter->d_sibling);
       // TODO: SA 2023-12-22 kfree properies of the iter?
       kfree(iter);
@@ -324,35 +384,37 @@ struct vfs_mount* do_mount(const char* fstype, int flags, const char* path) {
   back->d_inode = nd.dentry->d_inode;
   list_add_tail(&back->d_sibling, &mnt->mnt_root->d_subdirs);
 
+  // negative dentry would hide the mount point
+  struct vfs_dentry* negative = vfs_cache_get(nd.dentry, name);
+  if (negative) {
+    vfs_cache_remove(negative);
+    dput(negative);
+  }
+
   mnt->mnt_mountpoint->d_parent = nd.dentry;
   list_add_tail(&mnt->mnt_mountpoint->d_sibling, &nd.dentry->d_subdirs);
   list_add_tail(&mnt->sibling, &vfsmntlist);
+  dput(nd.dentry);
 
   return mnt;
 }
 
 int32_t vfs_mkdir(const char* path, mode_t mode) {
-  int ret = -1;
-  int fd = vfs_open(path, O_RDONLY);
-  
-  if (fd < 0 && fd != -ENOENT) {
-    ret = fd;
-    goto close;
-  } else if (fd >= 0) {
-    ret = -EEXIST;
-    goto close;
-  }
+  return vfs_mkdirat(AT_FDCWD, path, mode);
+}
 
+int32_t vfs_mkdirat(int dirfd, const char* path, mode_t mode) {
   struct nameidata nd;
-  ret = vfs_jmp(&nd, path, O_CREAT, mode | S_IFDIR);
-close:
-  vfs_close(fd);
+  int ret = vfs_jmpat(&nd, dirfd, path, O_CREAT | O_EXCL, mode | S_IFDIR);
+  if (ret == 0)
+    dput(nd.dentry);
   return ret;
 }
 
 void vfs_init(struct vfs_file_system_type* fs, char* dev_name) {
   INIT_LIST_HEAD(&vfsmntlist);
   vfs_cache_init();
+  icache_init();
   
   init_rootfs(fs, dev_name);
 
@@ -40,14 +40,35 @@ typedef struct {
   sect_t dir_sector;
 } table_entry;
 
+#define DCACHE_HASH_SIZE 512
+#define DCACHE_MAX_UNUSED 1024
+#define DCACHE_SHRINK_BATCH 64
+
+#define DCACHE_HASHED 0x01
+#define DCACHE_UNLINKED 0x02
+
 struct vfs_dentry {
-	struct vfs_inode* d_inode;
+	struct vfs_inode* d_inode;  // NULL for negative dentry
 	struct vfs_dentry* d_parent;
 	char *d_name;
+	uint32_t d_hash_value;
 	struct vfs_superblock* d_sb;
 	struct list_head d_subdirs;
 	struct list_head d_sibling;
-  struct list_head d_cache_sibling; 
+	struct list_head d_hash;
+	struct list_head d_lru;
+	int32_t d_count;
+	uint32_t d_flags;
+};
+
+struct dcache_stats {
+	uint32_t entries;
+	uint32_t negative;
+	uint32_t unused;
+	uint32_t hits;
+	uint32_t negative_hits;
+	uint32_t misses;
+	uint32_t shrunk;
 };
 
 struct vfs_super_operations {
@@ -55,6 +76,8 @@ struct vfs_super_operations {
 	void (*read_inode)(struct vfs_inode *);
 	void (*write_inode)(struct vfs_inode *);
 	void (*write_super)(struct vfs_superblock *);
+	void (*destroy_inode)(struct vfs_inode *);
+	void (*sync_fs)(struct vfs_superblock *);
 };
 
 struct kstat  {
@@ -73,9 +96,10 @@ struct kstat  {
   blkcnt_t	st_blocks;
 };
 
-// SA TODO: 2023-12-21 s_dirt flag will be useful
+// s_dirt is set when on-disk superblock is out of date, it is written by sync_fs
 struct vfs_superblock {
 	unsigned long s_blocksize;
+	bool s_dirt;
 	//int32_t s_dev;
 	struct vfs_file_system_type* s_type;
 	struct vfs_super_operations* s_op;
@@ -85,10 +109,13 @@ struct vfs_superblock {
 	void* s_fs_info;
 };
 
+struct dirent_plus;
+
 struct vfs_file_operations {
 	int (*open)(struct vfs_inode *inode, struct vfs_file *file);
   int32_t (*read)(struct vfs_file* file, uint8_t* buffer, uint32_t length, off_t ppos);
   int (*readdir)(struct vfs_file *dir, struct dirent* dirent, uint32_t count);
+  int (*readdirplus)(struct vfs_file *dir, struct dirent_plus *dirent, uint32_t count);
   uint32_t (*write)(struct vfs_file *file, const char *buf, size_t count, off_t ppos);
   int32_t (*close)(struct vfs_file*);
   off_t (*llseek)(struct vfs_file* file, off_t ppos, int);
@@ -131,12 +158,31 @@ struct vfs_inode {
 	};
 
 	//struct address_space i_data;
+	struct list_head i_hash;
+	struct list_head i_lru;
+	uint32_t i_state;
 	struct vfs_inode_operations *i_op;
 	struct vfs_file_operations *i_fop;
 	struct vfs_superblock *i_sb;
 	void *i_fs_info;
 };
 
+#define ICACHE_HASH_SIZE 256
+#define ICACHE_MAX_UNUSED 256
+#define ICACHE_SHRINK_BATCH 32
+
+#define I_HASHED 0x01
+#define I_DIRTY 0x02
+
+struct icache_stats {
+	uint32_t entries;
+	uint32_t unused;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t writes;
+	uint32_t evicted;
+};
+
 struct nameidata {
 	struct vfs_dentry* dentry;
 	struct vfs_mount* mnt;
@@ -158,6 +204,7 @@ struct vfs_file_system_type {
 };
 
 struct vfs_inode_operations {
+	// returns ERR_PTR(-errno) when the inode can't be created
 	struct vfs_inode *(*create)(struct vfs_inode *dir, struct vfs_dentry *res, mode_t mode, int32_t dev);
 	struct vfs_inode *(*lookup)(struct vfs_inode *dir, char* name);
 	//int (*mkdir)(struct vfs_inode *, char *, int);
@@ -180,6 +227,16 @@ struct dirent {
 	char d_name[MAX_FILENAME_SIZE];			      /* Null-terminated filename */
 };
 
+// records are packed by the name length, d_off is the position of the next entry.
+// readdirplus record also carries attributes, d_ent.d_reclen is the length of the whole record
+struct dirent_plus {
+	struct kstat d_stat;
+	struct dirent d_ent;
+};
+
+#define DIRENT_RECLEN(name_len) ((offsetof(struct dirent, d_name) + (name_len) + 4) & ~3)
+#define DIRENT_PLUS_RECLEN(name_len) (offsetof(struct dirent_plus, d_ent) + DIRENT_RECLEN(name_len))
+
 struct vfs_file {
   char name[MAX_FILENAME_SIZE];
   unsigned int f_flags;
@@ -198,22 +255,31 @@ void vfs_init(struct vfs_file_system_type* fs, char* dev_name);
 void init_special_inode(struct vfs_inode* inode, mode_t mode, int32_t dev);
 struct vfs_inode *init_inode();
 int32_t vfs_mkdir(const char *path, mode_t mode);
+int32_t vfs_mkdirat(int dirfd, const char *path, mode_t mode);
 int32_t vfs_ls(const char* path);
 int32_t vfs_cd(const char* path);
 int register_filesystem(struct vfs_file_system_type *fs);
 int unregister_filesystem(struct vfs_file_system_type *fs);
 int vfs_jmp(struct nameidata* nd, const char* path, int32_t flags, mode_t mode);
+int vfs_jmpat(struct nameidata* nd, int dirfd, const char* path, int32_t flags, mode_t mode);
+int vfs_jmpat_len(struct nameidata* nd, int dirfd, const char* path, uint32_t len, int32_t flags, mode_t mode);
 
 // open.c
 int32_t vfs_close(int32_t fd);
 int32_t vfs_open(const char* fname, int32_t flags, ...);
+int32_t vfs_openat(int dirfd, const char* fname, int32_t flags, mode_t mode);
 int vfs_fstat(int32_t fd, struct kstat* stat);
 int vfs_stat(const char *path, struct kstat *stat);
 int32_t vfs_delete(const char* fname);
 struct vfs_dentry *alloc_dentry(struct vfs_dentry *parent, char *name);
 struct vfs_file *alloc_vfs_file();
 int generic_memory_readdir(struct vfs_file *file, struct dirent *dirent, uint32_t count);
+int generic_memory_readdirplus(struct vfs_file *file, struct dirent_plus *dirent, uint32_t count);
+struct dirent *dirent_emit(char *buf, uint32_t *size, uint32_t count, bool plus, ino_t ino, off_t next,
+                           mode_t type, const char *name, uint32_t name_len);
+void generic_fillattr(struct vfs_inode *inode, struct kstat *stat);
 int vfs_mknod(const char *path, int mode, int32_t dev);
+int vfs_mknodat(int dirfd, const char *path, int mode, int32_t dev);
 struct vfs_dentry *vfs_search_virt_subdirs(struct vfs_dentry *dir, const char *name);
 int32_t find_unused_fd_slot();
 
@@ -226,14 +292,37 @@ off_t vfs_generic_llseek(struct vfs_file *file, off_t offset, int whence);
 
 // namei.c
 int vfs_unlink(const char *path, int flag);
+int vfs_unlinkat(int dirfd, const char *path, int flag);
 void vfs_build_path_backward(struct vfs_dentry *dentry, char *path);
 
 //cache.c
-int vfs_cache(struct vfs_dentry* dentry);
-int vfs_cache_remove(struct vfs_dentry* dentry);
+uint32_t vfs_name_hash(const char *name);
+struct vfs_dentry *dget(struct vfs_dentry *dentry);
+void dput(struct vfs_dentry *dentry);
+void vfs_cache(struct vfs_dentry* dentry);
+void vfs_cache_remove(struct vfs_dentry* dentry);
 struct vfs_dentry* vfs_cache_get(struct vfs_dentry *parent, char *name);
+uint32_t vfs_cache_shrink(uint32_t count);
+struct dcache_stats *get_dcache_stats();
 void vfs_cache_init();
 
+// inode.c
+struct vfs_inode *iget(struct vfs_superblock *sb, ino_t ino);
+struct vfs_inode *ilookup(struct vfs_superblock *sb, ino_t ino);
+void iput(struct vfs_inode *inode);
+void insert_inode_hash(struct vfs_inode *inode);
+void mark_inode_dirty(struct vfs_inode *inode);
+void write_inode_now(struct vfs_inode *inode);
+void sync_inodes(struct vfs_superblock *sb);
+uint32_t icache_shrink(uint32_t count);
+struct icache_stats *get_icache_stats();
+void icache_init();
+
+// sync.c
+#define SYNC_INTERVAL 5000
+void vfs_sync();
+void vfs_sync_init();
+
 //fcntl.c
 int do_fcntl(int fd, int cmd, unsigned long arg);
 
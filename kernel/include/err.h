@@ -0,0 +1,11 @@
+#ifndef _KERNEL_INCLUDE_ERR_H
+#define _KERNEL_INCLUDE_ERR_H
+
+// the last page of address space is never mapped, pointers in it carry -errno
+#define MAX_ERRNO 4095
+
+#define ERR_PTR(err) ((void *)(long)(err))
+#define PTR_ERR(ptr) ((long)(ptr))
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+
+#endif
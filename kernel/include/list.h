@@ -112,6 +112,25 @@ static inline void list_del(struct list_head *entry) {
 	entry->prev = LIST_POISON2;
 }
 
+/**
+ * list_del_init - deletes entry from list and reinitialize it.
+ * @entry: the element to delete from the list.
+ */
+static inline void list_del_init(struct list_head *entry) {
+	__list_del_entry(entry);
+	INIT_LIST_HEAD(entry);
+}
+
+/**
+ * list_move_tail - delete from one list and add as another's tail
+ * @list: the entry to move
+ * @head: the head that will follow our entry
+ */
+static inline void list_move_tail(struct list_head *list, struct list_head *head) {
+	__list_del_entry(list);
+	list_add_tail(list, head);
+}
+
 /**
   * list_for_each        -       iterate over a list 
   * @pos:        the &struct list_head to use as a loop counter. 
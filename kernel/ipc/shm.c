@@ -0,0 +1,341 @@
+#include "kernel/fs/vfs.h"
+#include "kernel/cpu/hal.h"
+#include "kernel/include/errno.h"
+#include "kernel/include/fcntl.h"
+#include "kernel/include/limits.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/memory/pmm.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/string/string.h"
+
+#include "kernel/ipc/shm.h"
+
+// frames of an object are mapped with PTE_SHARED_MARK, so fork, exit and reclaim leave them alone.
+// They are freed when the name, the last file and the last mapping are gone
+static LIST_HEAD(shm_objects);
+static struct shm_stats shm_stats;
+
+static bool shm_valid_name(const char *name) {
+  if (!name || name[0] != '/' || !name[1])
+    return false;
+
+  uint32_t length = strlen(name);
+  if (length > NAME_MAX)
+    return false;
+
+  for (uint32_t i = 1; i < length; ++i) {
+    if (name[i] == '/')
+      return false;
+  }
+  return true;
+}
+
+static struct shm_object *shm_lookup(const char *name) {
+  struct shm_object *iter;
+  list_for_each_entry(iter, &shm_objects, sibling) {
+    if (strcmp(iter->name, name) == 0)
+      return iter;
+  }
+  return NULL;
+}
+
+static struct shm_object *shm_object_create(const char *name) {
+  struct shm_object *object = kcalloc(1, sizeof(struct shm_object));
+  if (!object)
+    return NULL;
+
+  object->refs = 1;
+  if (name) {
+    object->name = strdup(name);
+    list_add(&object->sibling, &shm_objects);
+  }
+  shm_stats.objects++;
+  return object;
+}
+
+static void shm_object_get(struct shm_object *object) {
+  uint32_t flags = irq_save();
+  object->refs++;
+  irq_restore(flags);
+}
+
+static void shm_object_put(struct shm_object *object) {
+  uint32_t flags = irq_save();
+  bool last = --object->refs == 0;
+  irq_restore(flags);
+
+  if (!last)
+    return;
+
+  for (uint32_t i = 0; i < object->nr_frames; ++i)
+    pmm_free_frame((void *)object->frames[i]);
+  shm_stats.frames -= object->nr_frames;
+  shm_stats.objects--;
+
+  kfree(object->frames);
+  kfree(object);
+}
+
+// frames are zero-filled, shrinking is only allowed when object is not mapped
+static int32_t shm_object_resize(struct shm_object *object, uint32_t size) {
+  uint32_t nr_frames = PAGE_ALIGN(size) / PMM_FRAME_SIZE;
+
+  if (nr_frames < object->nr_frames) {
+    if (object->mappings)
+      return -EBUSY;
+
+    for (uint32_t i = nr_frames; i < object->nr_frames; ++i)
+      pmm_free_frame((void *)object->frames[i]);
+    shm_stats.frames -= object->nr_frames - nr_frames;
+  } else if (nr_frames > object->nr_frames) {
+    physical_addr *frames = kcalloc(nr_frames, sizeof(physical_addr));
+    if (!frames)
+      return -ENOMEM;
+    memcpy(frames, object->frames, object->nr_frames * sizeof(physical_addr));
+
+    for (uint32_t i = object->nr_frames; i < nr_frames; ++i) {
+      frames[i] = (physical_addr)pmm_alloc_zeroed_frame();
+      if (!frames[i]) {
+        for (uint32_t j = object->nr_frames; j < i; ++j)
+          pmm_free_frame((void *)frames[j]);
+        kfree(frames);
+        return -ENOMEM;
+      }
+    }
+
+    shm_stats.frames += nr_frames - object->nr_frames;
+    kfree(object->frames);
+    object->frames = frames;
+  }
+
+  object->nr_frames = nr_frames;
+  object->size = size;
+  return 0;
+}
+
+// inode and dentry are freed by dput after release
+static int shm_release(struct vfs_inode *inode, struct vfs_file *file) {
+  shm_object_put(inode->i_fs_info);
+  return 0;
+}
+
+static struct vfs_file_operations shm_fops = {
+  .release = shm_release,
+};
+
+int32_t shm_open(const char *name, int32_t flags, mode_t mode) {
+  if (!shm_valid_name(name))
+    return -EINVAL;
+
+  struct process *current_process = get_current_process();
+  int32_t fd = find_unused_fd_slot();
+  if (fd < 0)
+    return -EMFILE;
+
+  uint32_t irq_flags = irq_save();
+  struct shm_object *object = shm_lookup(name);
+  if (object && (flags & O_CREAT) && (flags & O_EXCL)) {
+    irq_restore(irq_flags);
+    return -EEXIST;
+  } else if (!object && !(flags & O_CREAT)) {
+    irq_restore(irq_flags);
+    return -ENOENT;
+  } else if (!object && !(object = shm_object_create(name))) {
+    irq_restore(irq_flags);
+    return -ENOMEM;
+  }
+  object->refs++;
+  irq_restore(irq_flags);
+
+  if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY) {
+    int32_t ret = shm_object_resize(object, 0);
+    if (ret < 0) {
+      shm_object_put(object);
+      return ret;
+    }
+  }
+
+  struct vfs_inode *inode = init_inode();
+  inode->i_mode = S_IFREG | (mode & ~S_IFMT);
+  inode->i_size = object->size;
+  inode->i_fs_info = object;
+
+  struct vfs_dentry *dentry = alloc_dentry(NULL, (char *)name + 1);
+  dentry->d_inode = inode;
+  dentry->d_flags = DCACHE_UNLINKED;
+  dentry->d_count = 1;
+
+  struct vfs_file *file = alloc_vfs_file();
+  file->f_flags = flags;
+  file->f_op = &shm_fops;
+  file->f_dentry = dentry;
+
+  current_process->files->fd[fd] = file;
+  return fd;
+}
+
+int32_t shm_unlink(const char *name) {
+  if (!shm_valid_name(name))
+    return -EINVAL;
+
+  uint32_t flags = irq_save();
+  struct shm_object *object = shm_lookup(name);
+  if (!object) {
+    irq_restore(flags);
+    return -ENOENT;
+  }
+
+  list_del(&object->sibling);
+  kfree(object->name);
+  object->name = NULL;
+  irq_restore(flags);
+
+  shm_object_put(object);
+  return 0;
+}
+
+static struct shm_object *shm_get_file_object(int32_t fd) {
+  if (fd < 0 || fd >= MAX_FD)
+    return NULL;
+
+  struct vfs_file *file = get_current_process()->files->fd[fd];
+  if (!file || file->f_op != &shm_fops)
+    return NULL;
+
+  return file->f_dentry->d_inode->i_fs_info;
+}
+
+int32_t shm_ftruncate(int32_t fd, uint32_t length) {
+  struct shm_object *object = shm_get_file_object(fd);
+  if (!object)
+    return -EINVAL;
+
+  int32_t ret = shm_object_resize(object, length);
+  if (ret == 0)
+    get_current_process()->files->fd[fd]->f_dentry->d_inode->i_size = length;
+  return ret;
+}
+
+// first hole in shared memory area, each mapping is followed by a guard page
+static virtual_addr shm_find_area(mm_struct_mos *mm, uint32_t len) {
+  virtual_addr start = USER_SHM_START;
+
+  for (bool moved = true; moved;) {
+    moved = false;
+    for (uint32_t i = 0; i < mm->nr_shm; ++i) {
+      if (start < mm->shm[i].end + PMM_FRAME_SIZE && mm->shm[i].start < start + len + PMM_FRAME_SIZE) {
+        start = mm->shm[i].end + PMM_FRAME_SIZE;
+        moved = true;
+      }
+    }
+  }
+
+  return start + len <= USER_SHM_END ? start : 0;
+}
+
+int32_t shm_mmap(struct mmap_arg_struct *args) {
+  mm_struct_mos *mm = get_current_process()->mm_mos;
+
+  // private and fixed mappings need vma, they are not supported
+  if (!(args->flags & MMAP_SHARED) || (args->flags & MMAP_PRIVATE) || (args->flags & MMAP_FIXED))
+    return -EINVAL;
+  if (!args->len || args->offset & ~PAGE_MASK)
+    return -EINVAL;
+  if (mm->nr_shm == MM_MAX_SHM)
+    return -ENOMEM;
+
+  uint32_t len = PAGE_ALIGN(args->len);
+  struct shm_object *object = NULL;
+  if (args->flags & MMAP_ANONYMOUS) {
+    // shared with children after fork
+    if (!(object = shm_object_create(NULL)))
+      return -ENOMEM;
+
+    int32_t ret = shm_object_resize(object, len);
+    if (ret < 0) {
+      shm_object_put(object);
+      return ret;
+    }
+  } else {
+    struct vfs_file *file = args->fd >= 0 && args->fd < MAX_FD ? get_current_process()->files->fd[args->fd] : NULL;
+    if (!file)
+      return -EBADF;
+    if ((args->prot & MMAP_PROT_WRITE) && (file->f_flags & O_ACCMODE) == O_RDONLY)
+      return -EACCES;
+    // regular files need page cache
+    if (!(object = shm_get_file_object(args->fd)))
+      return -ENODEV;
+    if (args->offset + len > object->nr_frames * PMM_FRAME_SIZE)
+      return -ENXIO;
+    shm_object_get(object);
+  }
+
+  virtual_addr start = shm_find_area(mm, len);
+  if (!start) {
+    shm_object_put(object);
+    return -ENOMEM;
+  }
+
+  uint32_t pte_flags = (args->prot & MMAP_PROT_WRITE) ? I86_PTE_WRITABLE : 0;
+  uint32_t first = args->offset / PMM_FRAME_SIZE;
+  for (uint32_t i = 0; i < len / PMM_FRAME_SIZE; ++i)
+    vmm_map_shared_page(start + i * PMM_FRAME_SIZE, object->frames[first + i], pte_flags);
+
+  struct mm_shm *shm = &mm->shm[mm->nr_shm++];
+  shm->object = object;
+  shm->start = start;
+  shm->end = start + len;
+  object->mappings++;
+  shm_stats.mappings++;
+
+  return start;
+}
+
+static void mm_shm_release(struct mm_shm *shm) {
+  shm->object->mappings--;
+  shm_stats.mappings--;
+  shm_object_put(shm->object);
+}
+
+// only a whole mapping can be unmapped
+int32_t shm_munmap(virtual_addr addr, uint32_t len) {
+  mm_struct_mos *mm = get_current_process()->mm_mos;
+
+  for (uint32_t i = 0; i < mm->nr_shm; ++i) {
+    struct mm_shm *shm = &mm->shm[i];
+    if (shm->start != addr || shm->end != PAGE_ALIGN(addr + len))
+      continue;
+
+    vmm_release_range(shm->start, shm->end);
+    mm_shm_release(shm);
+    mm->shm[i] = mm->shm[--mm->nr_shm];
+    return 0;
+  }
+
+  return -EINVAL;
+}
+
+void mm_get_shm(mm_struct_mos *mm) {
+  for (uint32_t i = 0; i < mm->nr_shm; ++i) {
+    shm_object_get(mm->shm[i].object);
+    mm->shm[i].object->mappings++;
+    shm_stats.mappings++;
+  }
+}
+
+// page tables are released together with the address space
+void mm_put_shm(mm_struct_mos *mm) {
+  for (uint32_t i = 0; i < mm->nr_shm; ++i)
+    mm_shm_release(&mm->shm[i]);
+  mm->nr_shm = 0;
+}
+
+void mm_unmap_shm(mm_struct_mos *mm) {
+  for (uint32_t i = 0; i < mm->nr_shm; ++i)
+    vmm_release_range(mm->shm[i].start, mm->shm[i].end);
+  mm_put_shm(mm);
+}
+
+struct shm_stats *get_shm_stats() {
+  return &shm_stats;
+}
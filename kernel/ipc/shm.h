@@ -0,0 +1,48 @@
+#ifndef KERNEL_IPC_SHM_H
+#define KERNEL_IPC_SHM_H
+
+#include <stdint.h>
+
+#include "kernel/include/list.h"
+#include "kernel/include/types.h"
+#include "kernel/memory/vmm.h"
+#include "kernel/proc/task.h"
+
+// same as old_mmap in linux, syscall has only 5 registers for parameters
+struct mmap_arg_struct {
+  uint32_t addr;
+  uint32_t len;
+  uint32_t prot;
+  uint32_t flags;
+  int32_t fd;
+  uint32_t offset;
+};
+
+struct shm_object {
+  char *name;  // NULL after unlink or for anonymous mapping
+  uint32_t size;
+  physical_addr *frames;
+  uint32_t nr_frames;
+  // name, opened files and mappings, frames are freed when the last one is gone
+  uint32_t refs;
+  uint32_t mappings;
+  struct list_head sibling;
+};
+
+struct shm_stats {
+  uint32_t objects;
+  uint32_t frames;
+  uint32_t mappings;
+};
+
+int32_t shm_open(const char *name, int32_t flags, mode_t mode);
+int32_t shm_unlink(const char *name);
+int32_t shm_ftruncate(int32_t fd, uint32_t length);
+int32_t shm_mmap(struct mmap_arg_struct *args);
+int32_t shm_munmap(virtual_addr addr, uint32_t len);
+void mm_get_shm(mm_struct_mos *mm);
+void mm_put_shm(mm_struct_mos *mm);
+void mm_unmap_shm(mm_struct_mos *mm);
+struct shm_stats *get_shm_stats();
+
+#endif
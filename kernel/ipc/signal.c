@@ -158,6 +158,9 @@ int do_signal(pid_t pid, int32_t signum) {
 
   if (pid > 0) {
     struct process *proc = find_process_by_pid(pid);
+    if (!proc)
+      return -ESRCH;
+
     struct thread *th = list_first_entry(&proc->threads, struct thread, child);
     
 
@@ -190,24 +193,21 @@ int do_signal(pid_t pid, int32_t signum) {
         thread_update(th, THREAD_READY);
     }
   } else if (pid == 0) {
-    struct process *proc;
-    process_for_each_entry(proc) {
-      if (proc->gid == current_process->gid)
-        do_signal(proc->gid, signum);
+    struct process *proc, *next;
+    pgrp_for_each_process(proc, next, current_process->gid) {
+      do_signal(proc->pid, signum);
     }
   } else if (pid == -1) {
     struct process *proc;
     process_for_each_entry(proc) {
       // TODO: MQ 2020-08-20 Make sure calling process has permission to send signals
       if (proc->pid > 1)
-        do_signal(proc->gid, signum);
+        do_signal(proc->pid, signum);
     }
   } else {
-    struct process *proc;
-    
-    process_for_each_entry(proc) {
-      if (proc->gid == -pid)
-        do_signal(proc->gid, signum);
+    struct process *proc, *next;
+    pgrp_for_each_process(proc, next, -pid) {
+      do_signal(proc->pid, signum);
     }
   }
 
@@ -6,6 +6,7 @@
 #include "kernel/devices/kybrd.h"
 #include "kernel/devices/pata.h"
 #include "kernel/devices/terminal.h"
+#include "kernel/devices/zram.h"
 #include "kernel/fs/char_dev.h"
 #include "kernel/fs/ext2/ext2.h"
 #include "kernel/fs/fat32/fat32.h"
@@ -16,10 +17,13 @@
 #include "kernel/memory/pmm.h"
 #include "kernel/memory/vmm.h"
 #include "kernel/proc/elf.h"
+#include "kernel/ipc/shm.h"
 #include "kernel/proc/task.h"
+#include "kernel/system/softirq.h"
 #include "kernel/system/sysapi.h"
 #include "kernel/system/time.h"
 #include "kernel/system/timer.h"
+#include "kernel/system/workqueue.h"
 #include "kernel/include/ctype.h"
 #include "kernel/util/debug.h"
 #include "kernel/include/errno.h"
@@ -133,6 +137,11 @@ void ps(char **argv) {
   kprintformat("SID", 5, NULL);
   kprintformat("PARENT", 8, NULL);
   kprintformat("USER", 7, NULL);
+  // kilobytes
+  kprintformat("RSS", 7, NULL);
+  kprintformat("SHR", 7, NULL);
+  kprintformat("SWAP", 7, NULL);
+  kprintformat("PT", 5, NULL);
   kprintformat("THREADS", 10, NULL);
 
 
@@ -145,6 +154,19 @@ void ps(char **argv) {
     kprintformat("%d", 8, CYN, proc->parent ? proc->parent->pid : -1);
     kprintformat("%c", 7, CYN, vmm_is_kernel_directory(proc->va_dir)? '-' : '+');
 
+    struct mm_rss *rss = proc->mm_mos ? &proc->mm_mos->rss : NULL;
+    if (rss) {
+      kprintformat("%d", 7, NULL, rss->resident * PMM_FRAME_SIZE / 1024);
+      kprintformat("%d", 7, NULL, rss->shared * PMM_FRAME_SIZE / 1024);
+      kprintformat("%d", 7, NULL, rss->swapped * PMM_FRAME_SIZE / 1024);
+      kprintformat("%d", 5, NULL, rss->page_tables * PMM_FRAME_SIZE / 1024);
+    } else {
+      kprintformat("%c", 7, NULL, '-');
+      kprintformat("%c", 7, NULL, '-');
+      kprintformat("%c", 7, NULL, '-');
+      kprintformat("%c", 5, NULL, '-');
+    }
+
     if ((proc->state & (EXIT_ZOMBIE)) == 0) {
       kprintf("[");
       list_for_each_entry(th, &proc->threads, child) {
@@ -187,7 +209,8 @@ void cd(char **argv) {
   }
 
   struct process *cur = get_current_process();
-  cur->parent->fs->d_root = cur->fs->d_root;
+  dput(cur->parent->fs->d_root);
+  cur->parent->fs->d_root = dget(cur->fs->d_root);
   cur->parent->fs->mnt_root = cur->fs->mnt_root;
 }
 
@@ -203,6 +226,73 @@ void info(char **argv) {
     kprintf("Kernel end: %X\n", KERNEL_END);
   } else if (strcmp(argv[0], "memory") == 0) {
     PMM_DEBUG();
+    struct zero_pool_stats *zstats = get_zero_pool_stats();
+    kprintf("Zeroed pool: %u frames (hits: %u, misses: %u, refills: %u, drained: %u)\n",
+            zstats->count, zstats->hits, zstats->misses, zstats->refills, zstats->drained);
+    struct reclaim_stats *rstats = get_reclaim_stats();
+    kprintf("LRU pages: %u, swap used: %u (out: %u, in: %u)\n",
+            rstats->lru_pages, rstats->swap_used, rstats->swapped_out, rstats->swapped_in);
+    struct elf_image_stats *estats = get_elf_image_stats();
+    kprintf("Exec images: %u, shared frames: %u (hits: %u, misses: %u)\n",
+            estats->images, estats->shared_frames, estats->hits, estats->misses);
+    struct shm_stats *sstats = get_shm_stats();
+    kprintf("Shared memory objects: %u, frames: %u, mappings: %u\n",
+            sstats->objects, sstats->frames, sstats->mappings);
+  } else if (strcmp(argv[0], "dcache") == 0) {
+    struct dcache_stats *dstats = get_dcache_stats();
+    kprintf("Dentries: %u (negative: %u, unused: %u)\n", dstats->entries, dstats->negative, dstats->unused);
+    kprintf("Hits: %u, negative hits: %u, misses: %u, shrunk: %u\n",
+            dstats->hits, dstats->negative_hits, dstats->misses, dstats->shrunk);
+    struct icache_stats *istats = get_icache_stats();
+    kprintf("Inodes: %u (unused: %u), hits: %u, misses: %u, writes: %u, evicted: %u\n",
+            istats->entries, istats->unused, istats->hits, istats->misses, istats->writes, istats->evicted);
+  } else if (strcmp(argv[0], "tlb") == 0) {
+    struct tlb_stats *stats = get_tlb_stats();
+    kprintf("Switches: %u\n", stats->switches);
+    kprintf("TLB flushes: %u\n", stats->flushes);
+    kprintf("Avoided (kernel thread): %u\n", stats->lazy_switches);
+    kprintf("Avoided (same space): %u\n", stats->same_space);
+  } else if (strcmp(argv[0], "zram") == 0) {
+    struct zram_stats *zstats = get_zram_stats();
+    kprintf("Reads: %u (hits: %u), writes: %u (failed: %u)\n",
+            zstats->num_reads, zstats->read_hits, zstats->num_writes, zstats->failed_writes);
+    kprintf("Pages: %u stored, %u zero-filled\n", zstats->stored_pages, zstats->zero_pages);
+    if (zstats->compr_data_size)
+      kprintf("Compression: %uKB -> %uKB (ratio %u.%02u)\n",
+              zstats->orig_data_size / 1024, zstats->compr_data_size / 1024,
+              zstats->orig_data_size / zstats->compr_data_size,
+              zstats->orig_data_size % zstats->compr_data_size * 100 / zstats->compr_data_size);
+  } else if (strcmp(argv[0], "kstack") == 0) {
+    struct kstack_stats *kstats = get_kstack_stats();
+    kprintf("Kernel stacks: %u used, %u mapped (cached: %u, hits: %u)\n",
+            kstats->used, kstats->mapped, kstats->cached, kstats->cache_hits);
+    if (KSTACK_WATERMARK) {
+      kprintf("Deepest released stack: %u of %u bytes\n", kstats->max_peak, KERNEL_STACK_SIZE);
+
+      lock_scheduler();
+      struct process *proc;
+      struct thread *th;
+      list_for_each_entry(proc, get_proc_list(), sibling) {
+        list_for_each_entry(th, &proc->threads, child) {
+          kprintf("tid %d (%s): %u bytes\n", th->tid, proc->name, kstack_peak_usage(th->kernel_esp));
+        }
+      }
+      unlock_scheduler();
+    }
+  } else if (strcmp(argv[0], "kmalloc") == 0) {
+    // info kmalloc [snapshot|diff]
+    int32_t cmd = KMALLOC_REPORT;
+    if (argv[1] && strcmp(argv[1], "snapshot") == 0)
+      cmd = KMALLOC_SNAPSHOT;
+    else if (argv[1] && strcmp(argv[1], "diff") == 0)
+      cmd = KMALLOC_DIFF;
+    if (kmalloc_track_report(cmd) < 0)
+      kprintf("Kernel heap tracking is disabled (KMALLOC_TRACKING)\n");
+  } else if (strcmp(argv[0], "latency") == 0) {
+    struct preempt_trace *trace = get_preempt_trace();
+    kprintf("Longest non-preemptible section: %u cycles\n", (uint32_t)trace->max_cycles);
+    kprintf("Started at: %X (tid: %d)\n", trace->max_ip, trace->max_tid);
+    reset_preempt_trace();
   } else {
     kprintf("Invalid param: %s", argv[0]);
   }
@@ -646,7 +736,11 @@ void init_process() {
     idle_task();  // 2
   }
 
+  workqueue_init();
+  kswapd_init();
+
   vfs_init(&ext2_fs_type, "/dev/hda");
+  vfs_sync_init();
   chrdev_init();
 
   kkybrd_install(IRQ1);
@@ -659,7 +753,7 @@ void init_process() {
   if ((id = process_spawn(parent)) == 0) {
     struct process *cur_proc = get_current_process();
     setpgid(0, 0);
-    cur_proc->sid = cur_proc->pid;
+    process_set_sid(cur_proc, cur_proc->pid);
     cur_proc->name = strdup("term");
     assert(cur_proc->sid == cur_proc->gid && cur_proc->gid == cur_proc->pid);
     terminal_run();
@@ -692,8 +786,10 @@ void kernel_main(multiboot_info_t *mbd, uint32_t magic) {
 
   exception_init();
   hal_initialize();
+  softirq_init();
 
   pata_init();
+  zram_init();
   syscall_init();
 
   timer_init();
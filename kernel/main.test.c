@@ -24,6 +24,9 @@ SUITE_EXTERN(SUITE_PMM);
 SUITE_EXTERN(SUITE_MALLOC);
 SUITE_EXTERN(SUITE_LIST);
 SUITE_EXTERN(SUITE_PATH);
+SUITE_EXTERN(SUITE_LZF);
+SUITE_EXTERN(SUITE_EXT2_BALLOC);
+SUITE_EXTERN(SUITE_EXT2_HASH);
 
 //! sleeps a little bit. This uses the HALs get_tick_count() which in turn uses the PIT
 void sleep(uint32_t ms) {
@@ -51,6 +54,9 @@ void kernel_main(multiboot_info_t* mbd, uint32_t magic) {
   vmm_init();
   RUN_SUITE(SUITE_MALLOC);
   RUN_SUITE(SUITE_PATH);
+  RUN_SUITE(SUITE_LZF);
+  RUN_SUITE(SUITE_EXT2_BALLOC);
+  RUN_SUITE(SUITE_EXT2_HASH);
   
   
   GREATEST_MAIN_END();
@@ -0,0 +1,161 @@
+#include "kernel/memory/malloc.h"
+
+#if KMALLOC_TRACKING
+
+#include "kernel/cpu/hal.h"
+#include "kernel/include/errno.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/stdio.h"
+
+// tracker can't use kmalloc itself, live blocks are chained from a static pool by pointer
+// and sites are never removed
+#define KMALLOC_TRACK_BUCKETS 1024
+#define TRACK_NONE -1
+
+struct kmalloc_block {
+  void *ptr;
+  uint32_t size;
+  int16_t site;
+  int16_t next;
+};
+
+static struct kmalloc_block track_blocks[KMALLOC_TRACK_BLOCKS];
+static int16_t track_buckets[KMALLOC_TRACK_BUCKETS];
+static int16_t track_free_list = TRACK_NONE;
+static bool track_initialized = false;
+static struct kmalloc_site track_sites[KMALLOC_TRACK_SITES];
+static struct kmalloc_stats kmalloc_stats;
+
+static uint32_t hash_addr(uint32_t addr, uint32_t size) {
+  // multiplicative hashing, low bits of block and return addresses are aligned
+  return ((addr >> 2) * 2654435761u) % size;
+}
+
+static void track_init() {
+  for (uint32_t i = 0; i < KMALLOC_TRACK_BUCKETS; ++i)
+    track_buckets[i] = TRACK_NONE;
+  for (uint32_t i = 0; i < KMALLOC_TRACK_BLOCKS; ++i)
+    track_blocks[i].next = i + 1 < KMALLOC_TRACK_BLOCKS ? i + 1 : TRACK_NONE;
+  track_free_list = 0;
+  track_initialized = true;
+}
+
+static int16_t track_find_site(uint32_t caller) {
+  uint32_t start = hash_addr(caller, KMALLOC_TRACK_SITES);
+
+  for (uint32_t i = 0; i < KMALLOC_TRACK_SITES; ++i) {
+    uint32_t index = (start + i) % KMALLOC_TRACK_SITES;
+    if (track_sites[index].caller == caller)
+      return index;
+    if (!track_sites[index].caller) {
+      track_sites[index].caller = caller;
+      return index;
+    }
+  }
+  return TRACK_NONE;
+}
+
+void kmalloc_track_alloc(void *ptr, size_t size, void *caller) {
+  if (!ptr)
+    return;
+
+  uint32_t flags = irq_save();
+  if (!track_initialized)
+    track_init();
+
+  kmalloc_stats.live_bytes += size;
+  kmalloc_stats.live_blocks++;
+  if (kmalloc_stats.live_bytes > kmalloc_stats.peak_bytes)
+    kmalloc_stats.peak_bytes = kmalloc_stats.live_bytes;
+
+  int16_t site = track_find_site((uint32_t)caller);
+  if (site == TRACK_NONE || track_free_list == TRACK_NONE) {
+    kmalloc_stats.untracked++;
+    irq_restore(flags);
+    return;
+  }
+
+  int16_t index = track_free_list;
+  struct kmalloc_block *block = &track_blocks[index];
+  track_free_list = block->next;
+
+  uint32_t bucket = hash_addr((uint32_t)ptr, KMALLOC_TRACK_BUCKETS);
+  block->ptr = ptr;
+  block->size = size;
+  block->site = site;
+  block->next = track_buckets[bucket];
+  track_buckets[bucket] = index;
+
+  track_sites[site].live_bytes += size;
+  track_sites[site].live_blocks++;
+  track_sites[site].total_blocks++;
+  irq_restore(flags);
+}
+
+// blocks which are not tracked (allocated before the table was full, heap padding) are skipped
+void kmalloc_track_free(void *ptr) {
+  uint32_t flags = irq_save();
+  if (!track_initialized) {
+    irq_restore(flags);
+    return;
+  }
+
+  uint32_t bucket = hash_addr((uint32_t)ptr, KMALLOC_TRACK_BUCKETS);
+  for (int16_t *link = &track_buckets[bucket]; *link != TRACK_NONE; link = &track_blocks[*link].next) {
+    struct kmalloc_block *block = &track_blocks[*link];
+    if (block->ptr != ptr)
+      continue;
+
+    track_sites[block->site].live_bytes -= block->size;
+    track_sites[block->site].live_blocks--;
+    kmalloc_stats.live_bytes -= block->size;
+    kmalloc_stats.live_blocks--;
+
+    int16_t index = *link;
+    *link = block->next;
+    block->ptr = NULL;
+    block->next = track_free_list;
+    track_free_list = index;
+    break;
+  }
+  irq_restore(flags);
+}
+
+// prints live memory per site, snapshot remembers it and diff prints sites which changed since then
+int32_t kmalloc_track_report(int32_t cmd) {
+  if (cmd != KMALLOC_REPORT && cmd != KMALLOC_SNAPSHOT && cmd != KMALLOC_DIFF)
+    return -EINVAL;
+
+  uint32_t flags = irq_save();
+  if (cmd == KMALLOC_REPORT || cmd == KMALLOC_DIFF)
+    kprintf("Kernel heap: %u bytes in %u blocks (peak: %u, untracked: %u)\n",
+            kmalloc_stats.live_bytes, kmalloc_stats.live_blocks,
+            kmalloc_stats.peak_bytes, kmalloc_stats.untracked);
+
+  for (uint32_t i = 0; i < KMALLOC_TRACK_SITES; ++i) {
+    struct kmalloc_site *site = &track_sites[i];
+    if (!site->caller)
+      continue;
+
+    if (cmd == KMALLOC_SNAPSHOT) {
+      site->snapshot_bytes = site->live_bytes;
+      site->snapshot_blocks = site->live_blocks;
+    } else if (cmd == KMALLOC_REPORT && site->live_blocks) {
+      kprintf("%X: %u bytes in %u blocks (total allocations: %u)\n",
+              site->caller, site->live_bytes, site->live_blocks, site->total_blocks);
+    } else if (cmd == KMALLOC_DIFF && site->live_bytes != site->snapshot_bytes) {
+      kprintf("%X: %d bytes, %d blocks\n", site->caller,
+              (int32_t)(site->live_bytes - site->snapshot_bytes),
+              (int32_t)(site->live_blocks - site->snapshot_blocks));
+    }
+  }
+  irq_restore(flags);
+
+  return 0;
+}
+
+struct kmalloc_stats *get_kmalloc_stats() {
+  return &kmalloc_stats;
+}
+
+#endif
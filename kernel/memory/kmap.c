@@ -0,0 +1,61 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/string/string.h"
+#include "kernel/memory/pmm.h"
+
+#include "kernel/memory/vmm.h"
+
+// slots at or after kmap_next are unused since the last TLB flush,
+// released slots are not invalidated one by one, TLB is flushed once when the window is full
+static uint32_t kmap_next = 0;
+
+static int32_t kmap_find_slot(pt_entry *table) {
+  for (uint32_t i = kmap_next; i < KMAP_SLOTS; ++i) {
+    if (!pt_entry_is_present(table[i]))
+      return i;
+  }
+  return -1;
+}
+
+void *kmap(physical_addr paddr) {
+  assert(paddr % PMM_FRAME_SIZE == 0, "0x%x is not frame aligned", paddr);
+
+  pt_entry *table = (pt_entry *)PAGE_TABLE_VIRT_ADDRESS(KMAP_BASE);
+  uint32_t flags = irq_save();
+
+  int32_t slot = kmap_find_slot(table);
+  if (slot < 0) {
+    vmm_flush_tlb_all();
+    kmap_next = 0;
+    slot = kmap_find_slot(table);
+  }
+  assert(slot >= 0, "kmap window is exhausted");
+
+  table[slot] = paddr | I86_PTE_PRESENT | I86_PTE_WRITABLE;
+  kmap_next = slot + 1;
+
+  irq_restore(flags);
+  return (void *)(KMAP_BASE + slot * PMM_FRAME_SIZE);
+}
+
+void kunmap(void *vaddr) {
+  assert((virtual_addr)vaddr >= KMAP_BASE && (virtual_addr)vaddr < KMAP_BASE + KMAP_SLOTS * PMM_FRAME_SIZE);
+
+  pt_entry *table = (pt_entry *)PAGE_TABLE_VIRT_ADDRESS(KMAP_BASE);
+  uint32_t slot = PAGE_TABLE_INDEX((virtual_addr)vaddr);
+  uint32_t flags = irq_save();
+
+  table[slot] = 0;
+  // slot was mapped before the last flush and is in the clean part now, usually stale
+  // translation stays cached until the next flush and slot is not reused before that
+  if (slot >= kmap_next)
+    vmm_flush_tlb_entry((virtual_addr)vaddr);
+
+  irq_restore(flags);
+}
+
+void kmap_init() {
+  // preallocated page tables are not cleared
+  memset((void *)PAGE_TABLE_VIRT_ADDRESS(KMAP_BASE), 0, sizeof(struct ptable));
+  kmap_next = 0;
+}
@@ -0,0 +1,154 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/string/string.h"
+#include "kernel/memory/pmm.h"
+
+#include "kernel/memory/vmm.h"
+
+// each slot is an unmapped guard page followed by the stack, overflow ends in the double fault task.
+// Stack of an exiting thread is released by the next call, once the thread is switched out
+#define KSTACK_SLOT_SIZE (KSTACK_GUARD_SIZE + KERNEL_STACK_SIZE)
+#define KSTACK_POISON 0x57ACC0DE
+
+static uint32_t kstack_map[KSTACK_SLOTS / 32];
+static uint32_t kstack_cache[KSTACK_CACHE_SIZE];
+static uint32_t kstack_cache_count = 0;
+static int32_t kstack_zombie = -1;
+static struct kstack_stats kstack_stats;
+
+static virtual_addr kstack_bottom(uint32_t slot) {
+  return KSTACK_AREA_START + slot * KSTACK_SLOT_SIZE + KSTACK_GUARD_SIZE;
+}
+
+static int32_t kstack_slot(virtual_addr top) {
+  return (top - KSTACK_AREA_START) / KSTACK_SLOT_SIZE - 1;
+}
+
+static void kstack_unmap(uint32_t slot) {
+  virtual_addr bottom = kstack_bottom(slot);
+
+  for (virtual_addr virt = bottom; virt < bottom + KERNEL_STACK_SIZE; virt += PMM_FRAME_SIZE) {
+    pt_entry pte = vmm_get_physical_address(virt, true);
+    vmm_unmap_address(virt);
+    pmm_free_frame((void *)pt_entry_pfn(pte));
+  }
+
+  kstack_map[slot / 32] &= ~(1 << (slot % 32));
+  kstack_stats.mapped--;
+}
+
+static void kstack_release(uint32_t slot) {
+  if (kstack_cache_count < KSTACK_CACHE_SIZE)
+    kstack_cache[kstack_cache_count++] = slot;
+  else
+    kstack_unmap(slot);
+}
+
+static void kstack_reap_zombie() {
+  if (kstack_zombie < 0)
+    return;
+
+  kstack_release(kstack_zombie);
+  kstack_zombie = -1;
+}
+
+static int32_t kstack_map_slot() {
+  uint32_t slot = 0;
+  while (slot < KSTACK_SLOTS && (kstack_map[slot / 32] & (1 << (slot % 32))))
+    slot++;
+  if (slot == KSTACK_SLOTS)
+    return -1;
+
+  virtual_addr bottom = kstack_bottom(slot);
+  for (virtual_addr virt = bottom; virt < bottom + KERNEL_STACK_SIZE; virt += PMM_FRAME_SIZE) {
+    physical_addr paddr = (physical_addr)reclaim_alloc_frame();
+    if (!paddr) {
+      for (; virt > bottom; virt -= PMM_FRAME_SIZE) {
+        pt_entry pte = vmm_get_physical_address(virt - PMM_FRAME_SIZE, true);
+        vmm_unmap_address(virt - PMM_FRAME_SIZE);
+        pmm_free_frame((void *)pt_entry_pfn(pte));
+      }
+      return -1;
+    }
+    vmm_map_address(virt, paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
+  }
+
+  kstack_map[slot / 32] |= 1 << (slot % 32);
+  kstack_stats.mapped++;
+  return slot;
+}
+
+// returns top of the stack, 0 if there is no slot or memory left
+virtual_addr kstack_alloc() {
+  uint32_t flags = irq_save();
+  kstack_reap_zombie();
+
+  int32_t slot;
+  if (kstack_cache_count > 0) {
+    slot = kstack_cache[--kstack_cache_count];
+    kstack_stats.cache_hits++;
+  } else if ((slot = kstack_map_slot()) < 0) {
+    irq_restore(flags);
+    return 0;
+  }
+  kstack_stats.used++;
+  irq_restore(flags);
+
+  virtual_addr bottom = kstack_bottom(slot);
+#if KSTACK_WATERMARK
+  uint32_t *words = (uint32_t *)bottom;
+  for (uint32_t i = 0; i < KERNEL_STACK_SIZE / sizeof(uint32_t); ++i)
+    words[i] = KSTACK_POISON;
+#endif
+  return bottom + KERNEL_STACK_SIZE;
+}
+
+void kstack_free(virtual_addr top) {
+  int32_t slot = kstack_slot(top);
+  assert(slot >= 0 && slot < KSTACK_SLOTS && kstack_bottom(slot) + KERNEL_STACK_SIZE == top,
+         "0x%x is not a kernel stack", top);
+
+#if KSTACK_WATERMARK
+  uint32_t peak = kstack_peak_usage(top);
+  if (peak > kstack_stats.max_peak)
+    kstack_stats.max_peak = peak;
+#endif
+
+  uint32_t flags = irq_save();
+  kstack_reap_zombie();
+  kstack_stats.used--;
+
+  virtual_addr esp;
+  __asm__ __volatile__("mov %%esp, %0" : "=r"(esp));
+
+  if (top - KERNEL_STACK_SIZE <= esp && esp < top)
+    kstack_zombie = slot;
+  else
+    kstack_release(slot);
+  irq_restore(flags);
+}
+
+// stack fault below the stack pointer lands on the guard page of the slot
+bool kstack_is_guard(virtual_addr addr) {
+  if (addr < KSTACK_AREA_START || addr >= KSTACK_AREA_START + KSTACK_SLOTS * KSTACK_SLOT_SIZE)
+    return false;
+  return (addr - KSTACK_AREA_START) % KSTACK_SLOT_SIZE < KSTACK_GUARD_SIZE;
+}
+
+// deepest use of the stack, the untouched part still has poison written in kstack_alloc
+uint32_t kstack_peak_usage(virtual_addr top) {
+#if KSTACK_WATERMARK
+  uint32_t *words = (uint32_t *)(top - KERNEL_STACK_SIZE);
+  uint32_t i = 0;
+  while (i < KERNEL_STACK_SIZE / sizeof(uint32_t) && words[i] == KSTACK_POISON)
+    i++;
+  return KERNEL_STACK_SIZE - i * sizeof(uint32_t);
+#else
+  return 0;
+#endif
+}
+
+struct kstack_stats *get_kstack_stats() {
+  kstack_stats.cached = kstack_cache_count;
+  return &kstack_stats;
+}
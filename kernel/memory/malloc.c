@@ -3,6 +3,7 @@
 
 #include "kernel/util/math.h"
 #include "kernel/util/debug.h"
+#include "kernel/include/errno.h"
 #include "malloc.h"
 
 #define BLOCK_MAGIC 0x464E
@@ -113,13 +114,14 @@ void kfree(void *ptr) {
   
   struct block_meta *block = get_block_ptr(ptr);
   assert_kblock_valid(block);
+  kmalloc_track_free(ptr);
   block->free = true;
   //log("free: 0x%x", ptr);
 }
 
 // TODO: make it more efficient, try to find an appropriate block among
 // kblocklist blocks first
-void* kmalloc_aligned(size_t size, uint32_t alignment) {
+static void *do_kmalloc_aligned(size_t size, uint32_t alignment) {
   void* aligned = kalign_heap(alignment, true);
 
   uint32_t heap_addr = (uint32_t)sbrk(0, NULL);
@@ -139,10 +141,17 @@ void* kmalloc_aligned(size_t size, uint32_t alignment) {
   return block? block + 1 : NULL;
 }
 
+void *kmalloc_aligned(size_t size, uint32_t alignment) {
+  void *block = do_kmalloc_aligned(size, alignment);
+  kmalloc_track_alloc(block, size, __builtin_return_address(0));
+  return block;
+}
+
 void* kcalloc_aligned(size_t n, size_t size, uint32_t alignment) {
-  void *block = kmalloc_aligned(n * size, alignment);
+  void *block = do_kmalloc_aligned(n * size, alignment);
   if (block)
     memset(block, 0, n * size);
+  kmalloc_track_alloc(block, n * size, __builtin_return_address(0));
 
   assert((uint32_t)block % alignment == 0);
   assert(block != NULL);
@@ -150,7 +159,7 @@ void* kcalloc_aligned(size_t n, size_t size, uint32_t alignment) {
 }
 
 // malloc for kernel
-void *kmalloc(size_t size) {
+static void *do_kmalloc(size_t size) {
   if (size >= 0x2000000) {
     err("Allocating too much: %d", size);
   }
@@ -181,13 +190,25 @@ void *kmalloc(size_t size) {
   return block ? block + 1 : NULL;
 }
 
-void *kcalloc(size_t n, size_t size) {
-  void *block = kmalloc(n * size);
+void *kmalloc(size_t size) {
+  void *block = do_kmalloc(size);
+  kmalloc_track_alloc(block, size, __builtin_return_address(0));
+  return block;
+}
+
+static void *do_kcalloc(size_t n, size_t size) {
+  void *block = do_kmalloc(n * size);
   if (block)
     memset(block, 0, n * size);
   return block;
 }
 
+void *kcalloc(size_t n, size_t size) {
+  void *block = do_kcalloc(n, size);
+  kmalloc_track_alloc(block, n * size, __builtin_return_address(0));
+  return block;
+}
+
 void *krealloc(void *ptr, size_t size)
 {
 	if (!ptr && size == 0)
@@ -195,10 +216,10 @@ void *krealloc(void *ptr, size_t size)
 		kfree(ptr);
 		return NULL;
 	}
-	else if (!ptr)
-		return kcalloc(size, sizeof(char));
 
-	void *newptr = kcalloc(size, sizeof(char));
-	memcpy(newptr, ptr, size);
+	void *newptr = do_kcalloc(size, sizeof(char));
+	if (ptr)
+		memcpy(newptr, ptr, size);
+	kmalloc_track_alloc(newptr, size, __builtin_return_address(0));
 	return newptr;
 }
\ No newline at end of file
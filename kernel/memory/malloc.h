@@ -29,4 +29,41 @@ void* kcalloc_aligned(size_t n, size_t size, uint32_t alignment);
 void* kmalloc_aligned(size_t size, uint32_t alignment);
 void *kalign_heap(size_t size, bool with_meta);
 
+// live blocks are recorded with the caller of kmalloc, compiled out when KMALLOC_TRACKING is 0
+#define KMALLOC_TRACKING 0
+#define KMALLOC_TRACK_BLOCKS 8192
+#define KMALLOC_TRACK_SITES 256
+
+#define KMALLOC_REPORT 0
+#define KMALLOC_SNAPSHOT 1
+#define KMALLOC_DIFF 2
+
+struct kmalloc_site {
+  uint32_t caller;
+  uint32_t live_bytes;
+  uint32_t live_blocks;
+  uint32_t total_blocks;
+  uint32_t snapshot_bytes;
+  uint32_t snapshot_blocks;
+};
+
+struct kmalloc_stats {
+  uint32_t live_bytes;
+  uint32_t live_blocks;
+  uint32_t peak_bytes;
+  uint32_t untracked;  // table is full
+};
+
+#if KMALLOC_TRACKING
+/* kmalloc_track.c */
+void kmalloc_track_alloc(void *ptr, size_t size, void *caller);
+void kmalloc_track_free(void *ptr);
+int32_t kmalloc_track_report(int32_t cmd);
+struct kmalloc_stats *get_kmalloc_stats();
+#else
+#define kmalloc_track_alloc(ptr, size, caller) ((void)0)
+#define kmalloc_track_free(ptr) ((void)0)
+#define kmalloc_track_report(cmd) (-ENOSYS)
+#endif
+
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include <stdbool.h>
 
 
+#include "kernel/cpu/hal.h"
 #include "kernel/memory/pmm.h"
 #include "kernel/util/string/string.h"
 #include "kernel/util/math.h"
@@ -165,22 +166,22 @@ void pmm_deinit_region(physical_addr base, uint32_t size) {
   }
 }
 
+// kernel is preemptible, finding a free bit and setting it must not be interleaved
+// with another allocation (idle thread refilling zero pool vs syscall)
 void* pmm_alloc_frame() {
-  if (pmm_get_free_frame_count() <= 0)
-    return 0;  // out of memory
-
-  int32_t frame = memory_bitmap_first_free();
-
-  
-  if (frame == -1)
-    return 0;  // out of memory
+  uint32_t flags = irq_save();
+  int32_t frame = pmm_get_free_frame_count() > 0 ? memory_bitmap_first_free() : -1;
+  if (frame == -1) {
+    irq_restore(flags);
+    // frames kept zeroed ahead of time are given back before the allocation fails
+    return pmm_zero_pool_drain() ? pmm_alloc_frame() : 0;  // out of memory
+  }
 
   memory_bitmap_set(frame);
-
-  physical_addr addr = frame * PMM_FRAME_SIZE;
   _used_frames++;
+  irq_restore(flags);
 
-  return (void*)addr;
+  return (void*)(frame * PMM_FRAME_SIZE);
 }
 
 void pmm_paging_enable(bool b) {
@@ -218,21 +219,19 @@ physical_addr pmm_get_PDBR() {
 }
 
 void* pmm_alloc_frames(uint32_t size) {
-  if (pmm_get_free_frame_count() < size)
-    return 0;  // not enough space
-
-  int32_t frame = memory_bitmap_first_free_s(size);
-
-  if (frame == -1)
-    return 0;  // not enough space
+  uint32_t flags = irq_save();
+  int32_t frame = pmm_get_free_frame_count() >= size ? memory_bitmap_first_free_s(size) : -1;
+  if (frame == -1) {
+    irq_restore(flags);
+    return pmm_zero_pool_drain() ? pmm_alloc_frames(size) : 0;  // not enough space
+  }
 
   for (uint32_t i = 0; i < size; i++)
     memory_bitmap_set(frame + i);
-
-  physical_addr addr = frame * PMM_FRAME_SIZE;
   _used_frames += size;
+  irq_restore(flags);
 
-  return (void*)addr;
+  return (void*)(frame * PMM_FRAME_SIZE);
 }
 
 void pmm_free_frame(void* p) {
@@ -244,9 +243,10 @@ void pmm_free_frame(void* p) {
   physical_addr addr = (physical_addr)p;
   uint32_t frame = addr / PMM_FRAME_SIZE;
 
+  uint32_t flags = irq_save();
   memory_bitmap_unset(frame);
-
   _used_frames--;
+  irq_restore(flags);
 }
 
 void pmm_free_frames(void* p, uint32_t size) {
@@ -20,6 +20,11 @@
 // it is 32bit system, so the maximum MEMORY_BITMAP size is 128Kbyte
 // for simplicity we reserve it statically 
 
+//! zeroed frames which are prepared in idle time (1mb)
+#define ZERO_POOL_SIZE 256
+//! pool is not refilled if there are less free frames (4mb)
+#define ZERO_POOL_RESERVE 1024
+
 //! physical address
 typedef uint32_t physical_addr;
 
@@ -42,4 +47,18 @@ uint32_t pmm_get_use_frame_count();
 uint32_t pmm_get_free_frame_count();
 uint32_t pmm_get_frame_size();
 
+struct zero_pool_stats {
+  uint32_t count;
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t refills;
+  uint32_t drained;
+};
+
+/* zero_pool.c */
+void* pmm_alloc_zeroed_frame();
+bool pmm_zero_pool_refill();
+uint32_t pmm_zero_pool_drain();
+struct zero_pool_stats *get_zero_pool_stats();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "kernel/fs/vfs.h"
+#include "kernel/include/errno.h"
+#include "kernel/include/list.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/memory/kernel_info.h"
+#include "kernel/proc/task.h"
+#include "kernel/util/debug.h"
+
+#include "kernel/memory/vmm.h"
+
+// user pages are kept in lru list with the page table that maps them, so they are swapped out
+// without switching address space. Accessed bit gives a page the second chance.
+// While a victim is written, it stays in writeback list and faults find its frame by slot
+#define LRU_HASH_SIZE 256
+#define lru_hash_slot(paddr) (((paddr) / PMM_FRAME_SIZE) % LRU_HASH_SIZE)
+
+// page is mapped again by a fault while it's being written
+#define ANON_PAGE_REMAPPED 0x01
+// swap entry or the mapped page is released while the page is being written
+#define ANON_PAGE_RELEASED 0x02
+
+struct anon_page {
+  physical_addr paddr;
+  physical_addr pa_dir;
+  physical_addr pt_paddr;
+  virtual_addr vaddr;
+  mm_struct_mos *mm;
+  uint32_t slot;
+  uint32_t flags;
+  struct list_head lru_sibling;
+  struct list_head hash_sibling;
+};
+
+static struct list_head lru_list;
+static struct list_head writeback_list;
+static struct list_head lru_hash[LRU_HASH_SIZE];
+static struct reclaim_stats reclaim_stats;
+
+void lru_add_page(mm_struct_mos *mm, physical_addr pa_dir, physical_addr pt_paddr, virtual_addr vaddr, physical_addr paddr) {
+  struct anon_page *page = kcalloc(1, sizeof(struct anon_page));
+  page->paddr = paddr;
+  page->pa_dir = pa_dir;
+  page->pt_paddr = pt_paddr;
+  page->vaddr = vaddr;
+  page->mm = mm;
+
+  uint32_t flags = irq_save();
+  list_add_tail(&page->lru_sibling, &lru_list);
+  list_add(&page->hash_sibling, &lru_hash[lru_hash_slot(paddr)]);
+  reclaim_stats.lru_pages++;
+  irq_restore(flags);
+}
+
+// page which is mapped at vaddr in the current address space
+void lru_add_current_page(virtual_addr vaddr) {
+  struct pdirectory *va_dir = PAGE_DIRECTORY_BASE;
+  physical_addr pt_paddr = pd_entry_pfn(&va_dir->m_entries[PAGE_DIRECTORY_INDEX(vaddr)]);
+  physical_addr paddr = pt_entry_pfn(vmm_get_physical_address(vaddr, true));
+
+  lru_add_page(get_current_process()->mm_mos, pmm_get_PDBR(), pt_paddr, vaddr & PAGE_MASK, paddr);
+}
+
+static void lru_release_page(struct anon_page *page) {
+  list_del(&page->lru_sibling);
+  list_del(&page->hash_sibling);
+  reclaim_stats.lru_pages--;
+  kfree(page);
+}
+
+static struct anon_page *find_writeback_page(uint32_t slot) {
+  struct anon_page *iter;
+  list_for_each_entry(iter, &writeback_list, lru_sibling) {
+    if (iter->slot == slot && !(iter->flags & ANON_PAGE_REMAPPED))
+      return iter;
+  }
+  return NULL;
+}
+
+void lru_del_page(physical_addr paddr) {
+  uint32_t flags = irq_save();
+
+  struct anon_page *iter;
+  list_for_each_entry(iter, &lru_hash[lru_hash_slot(paddr)], hash_sibling) {
+    if (iter->paddr != paddr)
+      continue;
+
+    // frame is released by the caller, the writer only frees the slot
+    if (iter->flags & ANON_PAGE_REMAPPED)
+      iter->flags |= ANON_PAGE_RELEASED;
+    else
+      lru_release_page(iter);
+    break;
+  }
+
+  irq_restore(flags);
+}
+
+// mm is released while its pages are still mapped by other threads
+void lru_forget_mm(mm_struct_mos *mm) {
+  uint32_t flags = irq_save();
+
+  struct anon_page *iter;
+  list_for_each_entry(iter, &lru_list, lru_sibling) {
+    if (iter->mm == mm)
+      iter->mm = NULL;
+  }
+  list_for_each_entry(iter, &writeback_list, lru_sibling) {
+    if (iter->mm == mm)
+      iter->mm = NULL;
+  }
+
+  irq_restore(flags);
+}
+
+// swap entry is released, the slot of a page which is being written is freed by the writer
+void swap_drop_slot(uint32_t slot) {
+  uint32_t flags = irq_save();
+  struct anon_page *page = find_writeback_page(slot);
+  if (page)
+    page->flags |= ANON_PAGE_RELEASED;
+  else
+    swap_free_slot(slot);
+  irq_restore(flags);
+}
+
+// reads content of the swap entry, page which is being written is copied from its frame
+int32_t swap_copy_slot(uint32_t slot, physical_addr paddr) {
+  uint32_t flags = irq_save();
+  struct anon_page *page = find_writeback_page(slot);
+  if (page) {
+    void *src = kmap(page->paddr);
+    void *dst = kmap(paddr);
+    memcpy(dst, src, PMM_FRAME_SIZE);
+    kunmap(dst);
+    kunmap(src);
+  }
+  irq_restore(flags);
+
+  return page ? 0 : swap_read_frame(slot, paddr);
+}
+
+static void invalidate_page(struct anon_page *page) {
+  // other address spaces are flushed when cr3 is switched to them
+  if (page->pa_dir == pmm_get_PDBR())
+    vmm_flush_tlb_entry(page->vaddr);
+}
+
+/*
+  returns 1 and the victim (unmapped and moved to writeback list), 0 if page got the second
+  chance and < 0 on error. Called under scheduler lock
+*/
+static int32_t reclaim_scan_one(struct anon_page **victim) {
+  struct anon_page *page = list_first_entry(&lru_list, struct anon_page, lru_sibling);
+  pt_entry *table = kmap(page->pt_paddr);
+  pt_entry *pte = &table[PAGE_TABLE_INDEX(page->vaddr)];
+
+  // page was released without telling us
+  if (!pt_entry_is_present(*pte) || pt_entry_pfn(*pte) != page->paddr) {
+    kunmap(table);
+    lru_release_page(page);
+    return 0;
+  }
+
+  if (*pte & I86_PTE_ACCESSED) {
+    *pte &= ~I86_PTE_ACCESSED;
+    invalidate_page(page);
+    kunmap(table);
+    list_move_tail(&page->lru_sibling, &lru_list);
+    return 0;
+  }
+
+  int32_t slot = swap_alloc_slot();
+  if (slot < 0) {
+    kunmap(table);
+    return slot;
+  }
+
+  mm_rss_add(page->mm, page->vaddr, *pte, -1);
+  *pte = swap_pte(slot) | (*pte & (I86_PTE_WRITABLE | I86_PTE_USER));
+  mm_rss_add(page->mm, page->vaddr, *pte, 1);
+  invalidate_page(page);
+  kunmap(table);
+
+  page->slot = slot;
+  page->flags = 0;
+  list_move_tail(&page->lru_sibling, &writeback_list);
+  *victim = page;
+  return 1;
+}
+
+// returns 1 if the frame of the written page is released. Called under scheduler lock
+static int32_t reclaim_finish_one(struct anon_page *page, int32_t write_ret) {
+  if (page->flags & ANON_PAGE_RELEASED) {
+    swap_free_slot(page->slot);
+    // remapped frame is freed by whoever unmapped it
+    bool freed = !(page->flags & ANON_PAGE_REMAPPED);
+    if (freed)
+      pmm_free_frame((void *)page->paddr);
+    lru_release_page(page);
+    return freed;
+  }
+
+  if (!(page->flags & ANON_PAGE_REMAPPED) && write_ret >= 0) {
+    pmm_free_frame((void *)page->paddr);
+    lru_release_page(page);
+    reclaim_stats.swapped_out++;
+    return 1;
+  }
+
+  // page couldn't be written, it's mapped back and gets another round in lru
+  if (!(page->flags & ANON_PAGE_REMAPPED)) {
+    pt_entry *table = kmap(page->pt_paddr);
+    pt_entry *pte = &table[PAGE_TABLE_INDEX(page->vaddr)];
+    mm_rss_add(page->mm, page->vaddr, *pte, -1);
+    *pte = page->paddr | (*pte & (I86_PTE_WRITABLE | I86_PTE_USER)) | I86_PTE_PRESENT;
+    mm_rss_add(page->mm, page->vaddr, *pte, 1);
+    invalidate_page(page);
+    kunmap(table);
+  }
+  swap_free_slot(page->slot);
+  page->flags = 0;
+  list_move_tail(&page->lru_sibling, &lru_list);
+  return 0;
+}
+
+uint32_t reclaim_pages(uint32_t nr_pages) {
+  // zeroed pool is the cheapest memory to get back
+  uint32_t reclaimed = pmm_zero_pool_drain();
+  if (!swap_enabled())
+    return reclaimed;
+
+  // every page is visited at most twice, the second time its accessed bit is cleared
+  lock_scheduler();
+  uint32_t budget = reclaim_stats.lru_pages * 2;
+  while (reclaimed < nr_pages && budget-- > 0 && !list_empty(&lru_list)) {
+    struct anon_page *victim = NULL;
+    int32_t ret = reclaim_scan_one(&victim);
+    if (ret < 0)
+      break;
+    if (!victim)
+      continue;
+
+    // disk or zram is written with interrupts enabled
+    unlock_scheduler();
+    int32_t write_ret = swap_write_frame(victim->slot, victim->paddr);
+    lock_scheduler();
+
+    reclaimed += reclaim_finish_one(victim, write_ret);
+    if (write_ret < 0)
+      break;
+  }
+  unlock_scheduler();
+
+  return reclaimed;
+}
+
+// allocates a frame, if memory is exhausted pages are swapped out first
+void *reclaim_alloc_frame() {
+  void *frame = pmm_alloc_frame();
+  if (!frame && reclaim_pages(RECLAIM_BATCH) > 0)
+    frame = pmm_alloc_frame();
+  return frame;
+}
+
+static pt_entry *current_pte(virtual_addr vaddr) {
+  return &((struct ptable *)PAGE_TABLE_VIRT_ADDRESS(vaddr))->m_entries[PAGE_TABLE_INDEX(vaddr)];
+}
+
+static void map_swapped_page(virtual_addr vaddr, pt_entry *pte, physical_addr paddr) {
+  mm_struct_mos *mm = get_current_process()->mm_mos;
+  mm_rss_add(mm, vaddr, *pte, -1);
+  *pte = paddr | (*pte & (I86_PTE_WRITABLE | I86_PTE_USER)) | I86_PTE_PRESENT;
+  mm_rss_add(mm, vaddr, *pte, 1);
+  mm->rss.maj_flt++;
+  vmm_flush_tlb_entry(vaddr & PAGE_MASK);
+  reclaim_stats.swapped_in++;
+}
+
+int32_t swap_in_page(virtual_addr vaddr) {
+  struct pdirectory *va_dir = PAGE_DIRECTORY_BASE;
+  if (!pd_entry_is_present(va_dir->m_entries[PAGE_DIRECTORY_INDEX(vaddr)]))
+    return -EFAULT;
+
+  lock_scheduler();
+
+  pt_entry *pte = current_pte(vaddr);
+  pt_entry swapped = *pte;
+  if (!pte_is_swapped(swapped)) {
+    unlock_scheduler();
+    return -EFAULT;
+  }
+
+  // page is still being written, its frame is mapped back and the writer frees the slot
+  uint32_t slot = pte_swap_slot(swapped);
+  struct anon_page *page = find_writeback_page(slot);
+  if (page) {
+    page->flags |= ANON_PAGE_REMAPPED;
+    map_swapped_page(vaddr, pte, page->paddr);
+    unlock_scheduler();
+    return 0;
+  }
+  unlock_scheduler();
+
+  physical_addr paddr = (physical_addr)reclaim_alloc_frame();
+  if (!paddr)
+    return -ENOMEM;
+  int32_t ret = swap_read_frame(slot, paddr);
+
+  lock_scheduler();
+  // another thread of the process got the page in or released it meanwhile, access is retried
+  if (*pte != swapped) {
+    unlock_scheduler();
+    pmm_free_frame((void *)paddr);
+    return 0;
+  }
+  if (ret < 0) {
+    unlock_scheduler();
+    pmm_free_frame((void *)paddr);
+    return -EIO;
+  }
+
+  swap_free_slot(slot);
+  map_swapped_page(vaddr, pte, paddr);
+  lru_add_current_page(vaddr);
+  unlock_scheduler();
+  return 0;
+}
+
+static void kswapd() {
+  while (true) {
+    if (pmm_get_free_frame_count() < RECLAIM_LOW_WATERMARK) {
+      reclaim_stats.kswapd_runs++;
+      vfs_cache_shrink(DCACHE_SHRINK_BATCH);
+      icache_shrink(ICACHE_SHRINK_BATCH);
+      reclaim_pages(RECLAIM_HIGH_WATERMARK - pmm_get_free_frame_count());
+    }
+
+    thread_sleep(RECLAIM_INTERVAL);
+  }
+}
+
+struct reclaim_stats *get_reclaim_stats() {
+  reclaim_stats.swap_used = swap_get_used_slots();
+  return &reclaim_stats;
+}
+
+void reclaim_init() {
+  INIT_LIST_HEAD(&lru_list);
+  INIT_LIST_HEAD(&writeback_list);
+  for (int i = 0; i < LRU_HASH_SIZE; ++i)
+    INIT_LIST_HEAD(&lru_hash[i]);
+}
+
+void kswapd_init() {
+  swap_init();
+
+  if (swap_enabled())
+    create_system_process((virtual_addr)kswapd, "kswapd");
+}
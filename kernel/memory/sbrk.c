@@ -23,6 +23,16 @@ void* sbrk(size_t n, mm_struct_mos* mm) {
   if (n == 0)
     return (char *)(*kernel_heap_current);
 
+  // user heap is only reserved, pages are populated on the first touch
+  if (mm) {
+    if (mm->brk + n > mm->heap_end)
+      return 0;
+
+    char *brk = (char *)mm->brk;
+    mm->brk += n;
+    return brk;
+  }
+
   char *heap_base = (char *)(*kernel_heap_current);
 
   if (n <= *kernel_remaining_from_last_used) {
@@ -0,0 +1,100 @@
+#include "kernel/devices/pata.h"
+#include "kernel/devices/zram.h"
+#include "kernel/fs/vfs.h"
+#include "kernel/include/errno.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/math.h"
+#include "kernel/util/string/string.h"
+
+#include "kernel/memory/vmm.h"
+
+// disk has mkswap (version 2) layout, slot n is stored in page n after the header,
+// zram is preferred and has no header
+#define SWAP_DEVICE "/dev/hdb"
+#define SWAP_MAGIC "SWAPSPACE2"
+#define SWAP_MAGIC_LENGTH 10
+#define SWAP_LAST_PAGE_OFFSET 1028
+#define SWAP_MAX_SLOTS 32768
+#define SECTORS_PER_SLOT (PMM_FRAME_SIZE / BYTES_PER_SECTOR)
+
+static pata_device *swap_device = NULL;
+static uint32_t *swap_map = NULL;
+static uint32_t swap_slots = 0;
+static uint32_t swap_used = 0;
+
+bool swap_enabled() {
+  return swap_device != NULL;
+}
+
+int32_t swap_alloc_slot() {
+  // slot 0 is the header
+  for (uint32_t slot = 1; slot < swap_slots; ++slot) {
+    if (!(swap_map[slot / 32] & (1 << (slot % 32)))) {
+      swap_map[slot / 32] |= 1 << (slot % 32);
+      swap_used++;
+      return slot;
+    }
+  }
+  return -ENOSPC;
+}
+
+void swap_free_slot(uint32_t slot) {
+  assert(slot > 0 && slot < swap_slots, "invalid swap slot %d", slot);
+  assert(swap_map[slot / 32] & (1 << (slot % 32)), "swap slot %d is not used", slot);
+
+  swap_map[slot / 32] &= ~(1 << (slot % 32));
+  swap_used--;
+}
+
+int32_t swap_write_frame(uint32_t slot, physical_addr paddr) {
+  void *page = kmap(paddr);
+  int32_t ret = pata_write(swap_device, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, page);
+  kunmap(page);
+  return ret;
+}
+
+int32_t swap_read_frame(uint32_t slot, physical_addr paddr) {
+  void *page = kmap(paddr);
+  int32_t ret = pata_read(swap_device, slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT, page);
+  kunmap(page);
+  return ret;
+}
+
+uint32_t swap_get_used_slots() {
+  return swap_used;
+}
+
+static void swap_enable(pata_device *device, uint32_t slots) {
+  swap_slots = min(slots, SWAP_MAX_SLOTS);
+  swap_map = kcalloc(div_ceil(swap_slots, 32), sizeof(uint32_t));
+  swap_used = 0;
+  swap_device = device;
+
+  log("Swap: %d slots on %s", swap_slots - 1, device->dev_name);
+}
+
+void swap_init() {
+  pata_device *device = get_pata_device(ZRAM_DEVICE);
+  if (device) {
+    swap_enable(device, device->sectors / SECTORS_PER_SLOT);
+    return;
+  }
+
+  device = get_pata_device(SWAP_DEVICE);
+  if (!device)
+    return;
+
+  char *header = kcalloc(PMM_FRAME_SIZE, sizeof(char));
+  if (pata_read(device, 0, SECTORS_PER_SLOT, (uint16_t *)header) < 0 ||
+      memcmp(header + PMM_FRAME_SIZE - SWAP_MAGIC_LENGTH, SWAP_MAGIC, SWAP_MAGIC_LENGTH) != 0) {
+    log("Swap: %s has no swap signature", SWAP_DEVICE);
+    kfree(header);
+    return;
+  }
+
+  uint32_t last_page = *(uint32_t *)(header + SWAP_LAST_PAGE_OFFSET);
+  kfree(header);
+
+  swap_enable(device, last_page + 1);
+}
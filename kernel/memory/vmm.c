@@ -97,6 +97,11 @@ int32_t vmm_unmap_address(virtual_addr virt) {
     return -EINVAL;
   }
 
+  if (pd_entry_is_4mb(va_dir->m_entries[PAGE_DIRECTORY_INDEX(virt)])) {
+    assert_not_reached("0x%x is mapped by 4mb page", virt);
+    return -EINVAL;
+  }
+
 	struct ptable *pt = (struct ptable *)(PAGE_TABLE_VIRT_ADDRESS(virt));
   uint32_t pte = PAGE_TABLE_INDEX(virt);
 
@@ -154,72 +159,129 @@ void vmm_flush_tlb_entry(virtual_addr addr) {
   */
 }
 
-struct pdirectory *vmm_fork(struct pdirectory *va_dir) {
-  lock_scheduler(); 
+void vmm_flush_tlb_all() {
+  // global entries (kernel) are kept
+  pmm_load_PDBR(pmm_get_PDBR());
+}
 
-  struct pdirectory *forked_dir = vmm_create_address_space();
-  void *aligned = kalign_heap(PMM_FRAME_ALIGN, false);
+// another directory is put into the second recursive slot, so its tables are reachable at
+// PAGE_TABLE_FOREIGN_BASE without switching cr3. The slot belongs to the loaded directory,
+// thread isn't preempted until vmm_detach_foreign
+struct pdirectory *vmm_attach_foreign(physical_addr pa_dir) {
+  assert(pa_dir % PAGE_SIZE == 0);
+  preempt_disable();
+
+  struct pdirectory* va_dir = PAGE_DIRECTORY_BASE;
+  pd_entry* entry = &va_dir->m_entries[PAGE_DIRECTORY_FOREIGN_INDEX];
+  assert(!pd_entry_is_present(*entry), "foreign directory is already attached");
+
+  pd_entry_set_frame(entry, pa_dir);
+  pd_entry_add_attrib(entry, I86_PDE_PRESENT | I86_PDE_WRITABLE);
+  vmm_flush_tlb_all();
+
+  return (struct pdirectory *)PAGE_DIRECTORY_FOREIGN_BASE;
+}
+
+void vmm_detach_foreign() {
+  struct pdirectory* va_dir = PAGE_DIRECTORY_BASE;
+  va_dir->m_entries[PAGE_DIRECTORY_FOREIGN_INDEX] = 0;
 
-  uint32_t start_heap = (uint32_t)sbrk(0, NULL);
+  preempt_enable();
+}
 
-  // NOTE: make sure we are not exceeding the boundaries of the kernel heap
-  assert(
-    ALIGN_UP(start_heap + sizeof(struct ptable) + PMM_FRAME_SIZE, PMM_FRAME_SIZE) <= KERNEL_HEAP_TOP
-  );
+// page table comes already cleared, there is no way to report the failure to callers of vmm_map_address
+static physical_addr alloc_page_table_frame() {
+  physical_addr paddr = (physical_addr)pmm_alloc_zeroed_frame();
+  if (!paddr && reclaim_pages(RECLAIM_BATCH) > 0)
+    paddr = (physical_addr)pmm_alloc_zeroed_frame();
+  assert(paddr, "out of memory for a page table");
+  return paddr;
+}
 
-  assert(start_heap % PMM_FRAME_ALIGN == 0);
+struct pdirectory *vmm_fork(struct pdirectory *va_dir, struct _mm_struct_mos *mm) {
+  lock_scheduler(); 
+
+  struct pdirectory *forked_dir = vmm_create_address_space();
+  physical_addr forked_pa_dir = vmm_get_physical_address((virtual_addr)forked_dir, false);
+  struct pdirectory *foreign_dir = vmm_attach_foreign(forked_pa_dir);
 
-  for (int ipd = 0; ipd < 768; ++ipd) {
+  for (int ipd = 0; ipd < PAGE_DIRECTORY_INDEX(KERNEL_HIGHER_HALF); ++ipd) {
     if (pd_entry_is_present(va_dir->m_entries[ipd])) {
-      struct ptable *forked_pt = (struct ptable *)start_heap;
-      uint32_t heap_current = start_heap;
-      void* forked_pt_paddr = pmm_alloc_frame();
-      vmm_map_address((uint32_t)forked_pt, forked_pt_paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
-			memset((void*)forked_pt, 0, sizeof(struct ptable));
-      heap_current += sizeof(struct ptable);
-  
-      struct ptable *pt = PAGE_TABLE_BASE + ipd * PMM_FRAME_SIZE;
+      physical_addr forked_pt_paddr = alloc_page_table_frame();
+      foreign_dir->m_entries[ipd] = forked_pt_paddr | I86_PDE_PRESENT | I86_PDE_WRITABLE | I86_PDE_USER;
+
+      // page table is reachable through foreign slot as soon as directory entry is set
+      struct ptable *forked_pt = (struct ptable *)(PAGE_TABLE_FOREIGN_BASE + ipd * PMM_FRAME_SIZE);
+
+      struct ptable *pt = (struct ptable *)(PAGE_TABLE_BASE + ipd * PMM_FRAME_SIZE);
 
       for (int ipt = 0; ipt < PAGES_PER_TABLE; ++ipt) {
-        if (pt_entry_is_present(pt->m_entries[ipt])) {
-          if (ipt == 4 && ipd == 1) {
-            int asdf = 1;
-          }
-          uint8_t *pte = (ipd << 10 | (0b1111111111 & ipt)) << 12;  // NOTE: lowest virtual address assigned to ipd and ipt
-					uint8_t *forked_pte = heap_current;
-					void* forked_pte_paddr = pmm_alloc_frame();
-          //6766592
-          vmm_map_address((uint32_t)forked_pte, forked_pte_paddr, I86_PTE_PRESENT | I86_PTE_WRITABLE);
-          //memset(forked_pte, 0, PMM_FRAME_SIZE);
-          memcpy((void*)forked_pte, (void*)pte, PMM_FRAME_SIZE);
-          vmm_unmap_address((uint32_t)forked_pte);
-
-          forked_pt->m_entries[ipt] = (uint32_t)forked_pte_paddr | I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER;
-          ////ffff030000000f4cc281e7ffffff89
-          /*
+        uint8_t *pte = (ipd << 10 | (0b1111111111 & ipt)) << 12;  // NOTE: lowest virtual address assigned to ipd and ipt
+
+        if (pte_is_shared(pt->m_entries[ipt])) {
+          // image or shared memory frame, reference is taken when mm is cloned
           forked_pt->m_entries[ipt] = pt->m_entries[ipt];
-          pt_entry_set_frame(&forked_pt->m_entries[ipt], forked_pte_paddr);
-          */
+        } else if (pt_entry_is_present(pt->m_entries[ipt])) {
+          physical_addr forked_pte_paddr = (physical_addr)reclaim_alloc_frame();
+
+          uint8_t *forked_pte = kmap(forked_pte_paddr);
+          memcpy(forked_pte, pte, PMM_FRAME_SIZE);
+          kunmap(forked_pte);
+
+          forked_pt->m_entries[ipt] = forked_pte_paddr | I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER;
+          lru_add_page(mm, forked_pa_dir, forked_pt_paddr, (virtual_addr)pte, forked_pte_paddr);
+        } else if (pte_is_swapped(pt->m_entries[ipt])) {
+          // parent's page stays in swap, child gets its own copy in memory
+          physical_addr forked_pte_paddr = (physical_addr)reclaim_alloc_frame();
+          swap_copy_slot(pte_swap_slot(pt->m_entries[ipt]), forked_pte_paddr);
+
+          forked_pt->m_entries[ipt] = forked_pte_paddr | I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER;
+          lru_add_page(mm, forked_pa_dir, forked_pt_paddr, (virtual_addr)pte, forked_pte_paddr);
         }
       }
-      //6746215
-      vmm_unmap_address((uint32_t)forked_pt);
-      forked_dir->m_entries[ipd] = (uint32_t)forked_pt_paddr | I86_PDE_PRESENT | I86_PDE_WRITABLE | I86_PDE_USER;
-      /*
-      forked_dir->m_entries[ipd] = va_dir->m_entries[ipd];
-      pd_entry_set_frame(&forked_dir->m_entries[ipd], forked_pt_paddr);
-      */
     }
   }
 
-  if (aligned) {
-    kfree(aligned);
-  }
-
+  vmm_detach_foreign();
   unlock_scheduler();
   return forked_dir;
 }
 
+// frees user pages and page tables of an address space, shared kernel tables are kept
+void vmm_release_user_space(physical_addr pa_dir) {
+  struct pdirectory *foreign_dir = vmm_attach_foreign(pa_dir);
+
+  for (int ipd = 0; ipd < PAGE_DIRECTORY_INDEX(KERNEL_HIGHER_HALF); ++ipd) {
+    pd_entry* pde = &foreign_dir->m_entries[ipd];
+
+    // identity mapped first mb is shared with kernel directory unless the address space is forked
+    if (!pd_entry_is_present(*pde) || pd_entry_pfn(pde) == pd_entry_pfn(&_kernel_dir->m_entries[ipd]))
+      continue;
+
+    struct ptable *pt = (struct ptable *)(PAGE_TABLE_FOREIGN_BASE + ipd * PMM_FRAME_SIZE);
+    for (int ipt = 0; ipt < PAGES_PER_TABLE; ++ipt) {
+      pt_entry pte = pt->m_entries[ipt];
+
+      if (pte_is_shared(pte))
+        continue;
+      else if (pt_entry_is_present(pte)) {
+        lru_del_page(pt_entry_pfn(pte));
+        pmm_free_frame((void *)pt_entry_pfn(pte));
+      } else if (pte_is_swapped(pte))
+        swap_drop_slot(pte_swap_slot(pte));
+    }
+
+    pmm_free_frame((void *)pd_entry_pfn(pde));
+    *pde = 0;
+  }
+
+  vmm_detach_foreign();
+
+  // translations of released pages are still cached if the address space is the current one
+  if (pa_dir == pmm_get_PDBR())
+    vmm_flush_tlb_all();
+}
+
 void vmm_init_and_map(struct pdirectory* va_dir, uint32_t vaddr, uint32_t paddr, uint32_t num_of_pages) {
   uint32_t pa_table = (uint32_t)pmm_alloc_frame();
   struct ptable* va_table = (struct ptable*)(pa_table + KERNEL_HIGHER_HALF);
@@ -241,6 +303,22 @@ void vmm_init_and_map(struct pdirectory* va_dir, uint32_t vaddr, uint32_t paddr,
 }
 
 
+// maps range with 4mb pages (PSE), vaddr and paddr have to be 4mb aligned
+static void vmm_init_and_map_large(struct pdirectory* va_dir, uint32_t vaddr, uint32_t paddr, uint32_t num_of_tables) {
+  assert(vaddr % PTABLE_ADDR_SPACE_SIZE == 0 && paddr % PTABLE_ADDR_SPACE_SIZE == 0);
+
+  for (uint32_t i = 0; i < num_of_tables; ++i) {
+    pd_entry* entry = &va_dir->m_entries[PAGE_DIRECTORY_INDEX(vaddr) + i];
+    *entry = 0;
+    pd_entry_set_frame(entry, paddr + i * PTABLE_ADDR_SPACE_SIZE);
+    pd_entry_add_attrib(entry, I86_PDE_PRESENT | I86_PDE_WRITABLE | I86_PDE_4MB);
+    pd_entry_enable_global(entry);
+  }
+
+  for (uint32_t iframe = paddr; iframe < paddr + num_of_tables * PTABLE_ADDR_SPACE_SIZE; iframe += PMM_FRAME_SIZE)
+    pmm_mark_used_addr(iframe);
+}
+
 // TODO: dereferencing zero address should though a page fault!!!
 void vmm_init() {
   uint32_t pa_dir = (uint32_t)pmm_alloc_frame();
@@ -249,10 +327,14 @@ void vmm_init() {
 
   //make identity map of first MB and mark it used 
   vmm_init_and_map(va_dir, 0x00000000, 0x00000000, PAGES_PER_TABLE >> 2); // 1mb
-  vmm_init_and_map(va_dir, KERNEL_HIGHER_HALF, 0x00000000, PAGES_PER_TABLE); // 4mb
+
+  // kernel image and bitmap are mapped with 4mb global pages, so they don't need page walks
+  // and are not evicted from TLB on context switch
+  uint32_t kernel_tables = div_ceil(KERNEL_AND_BITMAP_END - KERNEL_HIGHER_HALF, PTABLE_ADDR_SPACE_SIZE);
+  vmm_init_and_map_large(va_dir, KERNEL_HIGHER_HALF, 0x00000000, kernel_tables);
 
   // NOTE: MQ 2019-11-21 Preallocate ptable for higher halkernel
-  for (int i = PAGE_DIRECTORY_INDEX(KERNEL_HIGHER_HALF) + 1; i < TABLES_PER_DIR; ++i)
+  for (int i = PAGE_DIRECTORY_INDEX(KERNEL_HIGHER_HALF) + kernel_tables; i < PAGE_DIRECTORY_FOREIGN_INDEX; ++i)
     vmm_alloc_ptable(va_dir, i, I86_PTE_WRITABLE);
   
   // NOTE: MQ 2019-05-08 Using the recursive page directory trick when paging (map last entry to directory)
@@ -262,23 +344,12 @@ void vmm_init() {
   pd_entry_set_frame(entry, pa_dir);
   pd_entry_add_attrib(entry, I86_PDE_PRESENT | I86_PDE_WRITABLE);
 
-  // for editing userspace tables
-  memcpy(
-    &va_dir->m_entries[TABLES_PER_DIR - 2], 
-    &va_dir->m_entries[TABLES_PER_DIR - 1], 
-    sizeof(pd_entry)
-  );
+  // foreign slot is empty until another address space is attached (vmm_attach_foreign)
+  va_dir->m_entries[PAGE_DIRECTORY_FOREIGN_INDEX] = 0;
   
   vmm_paging(va_dir, pa_dir);
-}
-
-
-void vmm_load_usertable(physical_addr p_dir) {
-  struct pdirectory* va_dir = PAGE_DIRECTORY_BASE;
-  pd_entry* entry = &va_dir->m_entries[TABLES_PER_DIR - 2];
-  assert(p_dir % PAGE_SIZE == 0);
-  pd_entry_set_frame(entry, p_dir);
-  vmm_flush_tlb_entry(va_dir);
+  kmap_init();
+  reclaim_init();
 }
 
 void vmm_alloc_ptable(struct pdirectory* va_dir, uint32_t index, uint32_t flags) {
@@ -305,7 +376,7 @@ void vmm_paging(struct pdirectory* va_dir, uint32_t pa_dir) {
   __asm__ __volatile__(
       "mov %0, %%cr3           \n"
       "mov %%cr4, %%ecx        \n"
-      "or $0x00000010, %%ecx   \n"  // i don't know why but "and $~0x00000010, %%ecx doesnt work (QEMU)
+      "or $0x00000090, %%ecx   \n"  // PSE and PGE. i don't know why but "and $~0x00000010, %%ecx doesnt work (QEMU)
       "mov %%ecx, %%cr4        \n"
       "mov %%cr0, %%ecx        \n"
       "or $0x80000000, %%ecx   \n"
@@ -320,6 +391,15 @@ physical_addr vmm_get_physical_address(
   virtual_addr vaddr, 
   bool is_page
 ) {
+  struct pdirectory* va_dir = PAGE_DIRECTORY_BASE;
+  pd_entry pde = va_dir->m_entries[PAGE_DIRECTORY_INDEX(vaddr)];
+
+  // there is no page table behind 4mb page
+  if (pd_entry_is_present(pde) && pd_entry_is_4mb(pde)) {
+    physical_addr paddr = (pde & ~(PTABLE_ADDR_SPACE_SIZE - 1)) | (vaddr & (PTABLE_ADDR_SPACE_SIZE - 1));
+    return is_page ? (paddr & ~0xfff) | (pde & 0xfff & ~I86_PDE_4MB) : paddr;
+  }
+
   uint32_t* table = PAGE_TABLE_VIRT_ADDRESS(vaddr);
   uint32_t tindex = PAGE_TABLE_INDEX(vaddr);
   uint32_t paddr = table[tindex];
@@ -336,6 +416,11 @@ void vmm_map_address(uint32_t virt, uint32_t phys, uint32_t flags) {
   if (!pd_entry_is_present(va_dir->m_entries[PAGE_DIRECTORY_INDEX(virt)]))
     vmm_create_page_table(va_dir, virt, flags);
 
+  assert(!pd_entry_is_4mb(va_dir->m_entries[PAGE_DIRECTORY_INDEX(virt)]), "0x%x is mapped by 4mb page", virt);
+
+  if (virt >= KERNEL_HIGHER_HALF && virt < KERNEL_GLOBAL_END)
+    flags |= I86_PTE_CPU_GLOBAL;
+
   struct ptable* table = (struct ptable*)(PAGE_TABLE_VIRT_ADDRESS(virt));
   uint32_t tindex = PAGE_TABLE_INDEX(virt);
 
@@ -346,23 +431,102 @@ void vmm_map_address(uint32_t virt, uint32_t phys, uint32_t flags) {
   vmm_flush_tlb_entry(virt);
 }
 
+// counts (delta 1) or uncounts (-1) pte of a user page in mm statistics
+void mm_rss_add(struct _mm_struct_mos *mm, virtual_addr vaddr, pt_entry pte, int32_t delta) {
+  if (!mm)
+    return;
+
+  struct mm_rss *rss = &mm->rss;
+  if (pte_is_shared(pte)) {
+    rss->resident += delta;
+    rss->shared += delta;
+  } else if (pt_entry_is_present(pte) || pte_is_swapped(pte)) {
+    if (pt_entry_is_present(pte))
+      rss->resident += delta;
+    else
+      rss->swapped += delta;
+
+    if (mm->heap_start <= vaddr && vaddr < mm->heap_end)
+      rss->heap += delta;
+    else if (mm->start_stack - USER_STACK_SIZE <= vaddr && vaddr < mm->start_stack)
+      rss->stack += delta;
+  }
+
+  if (rss->resident > rss->hiwater_rss)
+    rss->hiwater_rss = rss->resident;
+}
+
+// mm of the current user process, kernel threads are not accounted
+static struct _mm_struct_mos *current_user_mm() {
+  struct process *proc = get_current_process();
+  if (!proc || vmm_is_kernel_directory(proc->va_dir))
+    return NULL;
+  return proc->mm_mos;
+}
+
+// maps a zeroed frame from the pool
+bool vmm_map_zeroed_page(virtual_addr vaddr, uint32_t flags) {
+  physical_addr paddr = (physical_addr)pmm_alloc_zeroed_frame();
+  // swap out something and try once more
+  if (!paddr && reclaim_pages(RECLAIM_BATCH) > 0)
+    paddr = (physical_addr)pmm_alloc_zeroed_frame();
+  if (!paddr)
+    return false;
+
+  vmm_map_address(vaddr, paddr, flags);
+  mm_rss_add(current_user_mm(), vaddr, paddr | flags, 1);
+  return true;
+}
+
+// maps a frame shared with other address spaces, it's read-only unless flags has I86_PTE_WRITABLE
+void vmm_map_shared_page(virtual_addr vaddr, physical_addr paddr, uint32_t flags) {
+  // page table is shared with writable pages of the same 4mb
+  vmm_create_page_table(PAGE_DIRECTORY_BASE, vaddr, I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
+  vmm_map_address(vaddr, paddr, I86_PTE_PRESENT | I86_PTE_USER | PTE_SHARED_MARK | flags);
+  mm_rss_add(current_user_mm(), vaddr, paddr | I86_PTE_PRESENT | PTE_SHARED_MARK, 1);
+}
+
+// unmaps and frees populated pages of the range, pages which were never touched are skipped
+void vmm_release_range(virtual_addr vm_start, virtual_addr vm_end) {
+  struct pdirectory* va_dir = PAGE_DIRECTORY_BASE;
+  struct _mm_struct_mos *mm = current_user_mm();
+  assert(PAGE_ALIGN(vm_start) == vm_start);
+
+  for (virtual_addr virt = vm_start; virt < vm_end; virt += PMM_FRAME_SIZE) {
+    if (!pd_entry_is_present(va_dir->m_entries[PAGE_DIRECTORY_INDEX(virt)]))
+      continue;
+
+    // pte is not changed by swapping in the middle
+    uint32_t flags = irq_save();
+    pt_entry pte = vmm_get_physical_address(virt, true);
+    mm_rss_add(mm, virt, pte, -1);
+    if (pte_is_swapped(pte)) {
+      swap_drop_slot(pte_swap_slot(pte));
+      ((struct ptable *)PAGE_TABLE_VIRT_ADDRESS(virt))->m_entries[PAGE_TABLE_INDEX(virt)] = 0;
+    } else if (pt_entry_is_present(pte)) {
+      vmm_unmap_address(virt);
+      if (!pte_is_shared(pte)) {
+        lru_del_page(pt_entry_pfn(pte));
+        pmm_free_frame((void *)pt_entry_pfn(pte));
+      }
+    }
+    irq_restore(flags);
+  }
+}
+
 void vmm_create_page_table(struct pdirectory* va_dir, uint32_t virt, uint32_t flags) {
   if (pd_entry_is_present(va_dir->m_entries[PAGE_DIRECTORY_INDEX(virt)]))
     return;
 
-  physical_addr pa_table = (uint32_t)pmm_alloc_frame();
+  physical_addr pa_table = alloc_page_table_frame();
+  struct _mm_struct_mos *mm = current_user_mm();
+  if (mm && (virtual_addr)va_dir == PAGE_DIRECTORY_BASE && virt < KERNEL_HIGHER_HALF)
+    mm->rss.page_tables++;
 
   pd_entry* entry = &va_dir->m_entries[PAGE_DIRECTORY_INDEX(virt)];
   pd_entry_add_attrib(entry, flags);
   pd_entry_set_frame(entry, pa_table);
   vmm_flush_tlb_entry(virt);
-  virtual_addr va_table = PAGE_TABLE_VIRT_ADDRESS(virt);
-
-  // we can't access directly, 
-  // because the directory maybe is not set to cr3 yet
-  // but we can always have a recursive table hack
-  memset(va_table, 0, sizeof(struct ptable));
-  //return va_table;
 }
 
 
@@ -407,6 +571,7 @@ void vmm_clone_kernel_space(struct pdirectory* dir) {
       kernel, 
       (TABLES_PER_DIR - kernel_dir_index) * sizeof(pd_entry)
     );
-    
+    dir->m_entries[PAGE_DIRECTORY_FOREIGN_INDEX] = 0;
+
   }
 }
\ No newline at end of file
@@ -16,6 +16,10 @@ struct _mm_struct_mos;
   +-------------------------+ 0xFFFFFFFF
   | Page table mapping      |
   |_________________________| 0xFFC00000
+  | Foreign page tables     |
+  |_________________________| 0xFF800000
+  | Kmap window             |
+  |_________________________| 0xFF400000
   |                         |
   |-------------------------| 0xF0000000
   |                         |
@@ -74,18 +78,57 @@ typedef uint32_t virtual_addr;
 #define PAGE_TABLE_BASE 0xFFC00000
 #define PAGE_TABLE_VIRT_ADDRESS(virt) (PAGE_TABLE_BASE + (PAGE_DIRECTORY_INDEX(virt) * PMM_FRAME_SIZE))
 
+// second recursive slot, page directory of another address space is attached here
+#define PAGE_DIRECTORY_FOREIGN_INDEX (TABLES_PER_DIR - 2)
+#define PAGE_DIRECTORY_FOREIGN_BASE 0xFFBFF000
+#define PAGE_TABLE_FOREIGN_BASE 0xFF800000
+#define PAGE_TABLE_FOREIGN_VIRT_ADDRESS(virt) (PAGE_TABLE_FOREIGN_BASE + (PAGE_DIRECTORY_INDEX(virt) * PMM_FRAME_SIZE))
+
+// not present pte of a swapped out page keeps swap slot in frame bits
+#define PTE_SWAP_MARK 0x400
+#define pte_is_swapped(e) (!((e) & I86_PTE_PRESENT) && ((e) & PTE_SWAP_MARK))
+#define pte_swap_slot(e) ((e) >> 12)
+#define swap_pte(slot) (((slot) << 12) | PTE_SWAP_MARK)
+
+// present pte of a frame owned by exec image cache (proc/elf.c) or shared memory object (ipc/shm.c),
+// it's never freed or swapped with the address space
+#define PTE_SHARED_MARK 0x200
+#define pte_is_shared(e) (((e) & I86_PTE_PRESENT) && ((e) & PTE_SHARED_MARK))
+
+// one page table of slots to temporary map frames into the kernel
+#define KMAP_BASE 0xFF400000
+#define KMAP_SLOTS PAGES_PER_TABLE
 
 //! page table represents 4mb address space
 #define PTABLE_ADDR_SPACE_SIZE 0x400000
 
+// kernel mappings below kmap window are the same in all address spaces,
+// so they are marked as global and survive cr3 reload (CR4.PGE)
+#define KERNEL_GLOBAL_END KMAP_BASE
+
 //! directory table represents 4gb address space
 #define DTABLE_ADDR_SPACE_SIZE 0x100000000
 
 // different from KERNEL_STACK_SIZE defined in ld file
 // should not be equal
 #define KERNEL_STACK_SIZE (0x4000)  
-#define USER_STACK_SIZE 0x1000
+// kernel stacks of threads (kstack.c), each one is below an unmapped guard page
+#define KSTACK_AREA_START 0xE0000000
+#define KSTACK_GUARD_SIZE 0x1000
+#define KSTACK_SLOTS 256
+#define KSTACK_CACHE_SIZE 8
+// fills new stacks with a pattern to find the deepest use, 0 disables it
+#define KSTACK_WATERMARK 0
+// user stack and heap are reserved, pages are populated on first touch (thread_page_fault)
+#define USER_STACK_SIZE 0x100000
+// unmapped gap between heap and stack, touching it kills the process
+#define USER_STACK_GUARD_SIZE 0x1000
 #define USER_HEAP_SIZE 0xA00000 // 10mb TODO: increase it
+// dynamic loader and shared libraries are mapped from here, each is followed by a guard page
+#define USER_LIBRARY_START 0x30000000
+// shared memory mappings (mmap)
+#define USER_SHM_START 0x38000000
+#define USER_SHM_END 0xB0000000
 
 //! page sizes are 4k
 #define PAGE_SIZE 4096
@@ -94,6 +137,8 @@ typedef uint32_t virtual_addr;
 #define MMAP_PROT_READ	0x1		/* page can be read */
 #define MMAP_PROT_WRITE	0x2		/* page can be written */
 
+#define MMAP_SHARED	0x01		/* Share changes */
+#define MMAP_PRIVATE	0x02		/* Changes are private */
 #define MMAP_FIXED	0x10		/* Interpret addr exactly */
 #define MMAP_ANONYMOUS	0x20		/* don't use a file */
 
@@ -132,6 +177,13 @@ struct pdirectory* vmm_get_directory();
 //! flushes a cached translation lookaside buffer (TLB) entry
 void vmm_flush_tlb_entry(virtual_addr addr);
 
+//! flushes all non-global TLB entries
+void vmm_flush_tlb_all();
+
+//! maps page directory of another address space into the foreign slot
+struct pdirectory *vmm_attach_foreign(physical_addr pa_dir);
+void vmm_detach_foreign();
+
 //! clears a page table
 void vmm_ptable_clear(struct ptable* p);
 
@@ -154,7 +206,72 @@ void vmm_map_address(uint32_t virt, uint32_t phys, uint32_t flags);
 //virtual_addr vmm_alloc_size(virtual_addr from, uint32_t size, uint32_t flags);
 int32_t vmm_unmap_address(virtual_addr virt);
 void vmm_unmap_range(virtual_addr vm_start, virtual_addr vm_end);
-struct pdirectory *vmm_fork(struct pdirectory* dir);
+struct pdirectory *vmm_fork(struct pdirectory* dir, struct _mm_struct_mos *mm);
+void vmm_release_user_space(physical_addr pa_dir);
+bool vmm_map_zeroed_page(virtual_addr vaddr, uint32_t flags);
+void vmm_map_shared_page(virtual_addr vaddr, physical_addr paddr, uint32_t flags);
+void vmm_release_range(virtual_addr vm_start, virtual_addr vm_end);
+void mm_rss_add(struct _mm_struct_mos *mm, virtual_addr vaddr, pt_entry pte, int32_t delta);
+
+/* swap.c */
+bool swap_enabled();
+int32_t swap_alloc_slot();
+void swap_free_slot(uint32_t slot);
+int32_t swap_write_frame(uint32_t slot, physical_addr paddr);
+int32_t swap_read_frame(uint32_t slot, physical_addr paddr);
+uint32_t swap_get_used_slots();
+void swap_init();
+
+/* reclaim.c */
+// kswapd is woken up every RECLAIM_INTERVAL ms and swaps out until free frames reach high watermark
+#define RECLAIM_LOW_WATERMARK 256
+#define RECLAIM_HIGH_WATERMARK 512
+#define RECLAIM_INTERVAL 100
+// frames which are reclaimed directly when allocation fails
+#define RECLAIM_BATCH 32
+
+struct reclaim_stats {
+  uint32_t lru_pages;
+  uint32_t swapped_out;
+  uint32_t swapped_in;
+  uint32_t kswapd_runs;
+  uint32_t swap_used;
+};
+
+void lru_add_page(struct _mm_struct_mos *mm, physical_addr pa_dir, physical_addr pt_paddr, virtual_addr vaddr, physical_addr paddr);
+void lru_add_current_page(virtual_addr vaddr);
+void lru_del_page(physical_addr paddr);
+void lru_forget_mm(struct _mm_struct_mos *mm);
+// swap entry of a pte, the page might still be in the middle of being written
+void swap_drop_slot(uint32_t slot);
+int32_t swap_copy_slot(uint32_t slot, physical_addr paddr);
+uint32_t reclaim_pages(uint32_t nr_pages);
+void *reclaim_alloc_frame();
+// -EFAULT if pte is not a swap entry, -ENOMEM/-EIO if page cannot be read back
+int32_t swap_in_page(virtual_addr vaddr);
+struct reclaim_stats *get_reclaim_stats();
+void reclaim_init();
+void kswapd_init();
+
+/* kstack.c */
+struct kstack_stats {
+  uint32_t used;
+  uint32_t mapped;
+  uint32_t cached;
+  uint32_t cache_hits;
+  uint32_t max_peak;  // of released stacks
+};
+
+virtual_addr kstack_alloc();
+void kstack_free(virtual_addr top);
+bool kstack_is_guard(virtual_addr addr);
+uint32_t kstack_peak_usage(virtual_addr top);
+struct kstack_stats *get_kstack_stats();
+
+/* kmap.c */
+void kmap_init();
+void *kmap(physical_addr paddr);
+void kunmap(void *vaddr);
 
 /* sbrk.c */
 void* sbrk(size_t n, struct _mm_struct_mos* mm);
@@ -32,8 +32,6 @@ bool pd_entry_is_4mb (pd_entry e) {
 	return e & I86_PDE_4MB;
 }
 
-/*
 void pd_entry_enable_global (pd_entry* e) {
-
+	*e |= I86_PDE_CPU_GLOBAL;
 }
-*/
@@ -0,0 +1,78 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/string/string.h"
+#include "kernel/memory/vmm.h"
+
+#include "kernel/memory/pmm.h"
+
+// frames are cleared ahead of time by the idle thread, pool frames count as used
+static physical_addr zero_pool[ZERO_POOL_SIZE];
+static volatile uint32_t zero_pool_count = 0;
+static struct zero_pool_stats zero_pool_stats;
+
+static void zero_frame(physical_addr paddr) {
+  void *page = kmap(paddr);
+  memset(page, 0, PMM_FRAME_SIZE);
+  kunmap(page);
+}
+
+void *pmm_alloc_zeroed_frame() {
+  uint32_t flags = irq_save();
+
+  if (zero_pool_count > 0) {
+    physical_addr paddr = zero_pool[--zero_pool_count];
+    zero_pool_stats.hits++;
+    irq_restore(flags);
+    return (void *)paddr;
+  }
+
+  zero_pool_stats.misses++;
+  irq_restore(flags);
+
+  physical_addr paddr = (physical_addr)pmm_alloc_frame();
+  if (paddr)
+    zero_frame(paddr);
+  return (void *)paddr;
+}
+
+// clears one frame and puts it into the pool, returns false if there is nothing to do
+bool pmm_zero_pool_refill() {
+  if (zero_pool_count >= ZERO_POOL_SIZE || pmm_get_free_frame_count() <= ZERO_POOL_RESERVE)
+    return false;
+
+  physical_addr paddr = (physical_addr)pmm_alloc_frame();
+  if (!paddr)
+    return false;
+
+  zero_frame(paddr);
+
+  uint32_t flags = irq_save();
+  if (zero_pool_count < ZERO_POOL_SIZE) {
+    zero_pool[zero_pool_count++] = paddr;
+    zero_pool_stats.refills++;
+    paddr = 0;
+  }
+  irq_restore(flags);
+
+  // pool is filled up by someone else in the meantime
+  if (paddr)
+    pmm_free_frame((void *)paddr);
+  return true;
+}
+
+// gives every frame of the pool back when memory is short, returns how many were freed
+uint32_t pmm_zero_pool_drain() {
+  uint32_t flags = irq_save();
+  uint32_t count = zero_pool_count;
+  for (uint32_t i = 0; i < count; ++i)
+    pmm_free_frame((void *)zero_pool[i]);
+  zero_pool_count = 0;
+  zero_pool_stats.drained += count;
+  irq_restore(flags);
+  return count;
+}
+
+struct zero_pool_stats *get_zero_pool_stats() {
+  zero_pool_stats.count = zero_pool_count;
+  return &zero_pool_stats;
+}
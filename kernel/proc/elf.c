@@ -4,9 +4,11 @@
 #include "kernel/memory/vmm.h"
 #include "kernel/memory/malloc.h"
 #include "kernel/include/errno.h"
+#include "kernel/include/list.h"
 #include "kernel/util/debug.h"
 #include "kernel/util/math.h"
 #include "kernel/proc/task.h"
+#include "kernel/ipc/shm.h"
 
 #include "elf.h"
 
@@ -56,27 +58,111 @@ static int elf_verify(struct Elf32_Ehdr *elf_header) {
   if (elf_header->e_machine != EM_386)
     return -ERR_NOT_SUPPORTED_PLATFORM;
 
-  if (elf_header->e_type != ET_EXEC)
+  // shared objects are mapped for the dynamic loader
+  if (elf_header->e_type != ET_EXEC && elf_header->e_type != ET_DYN)
     return -ERR_NOT_SUPPORTED_TYPE;
 
   return NO_ERROR;
 }
 
-int32_t elf_load(
-  char* app_path, 
-  struct ELF32_Layout* layout
-) {
-  
-  uint8_t* elf_file = NULL;
-  
-  int ret = 0;
-  if ((ret = vfs_read(app_path, &elf_file)) < 0)
-    return ret;
+// image is loaded once per inode and kept while a process runs it, text frames are shared
+// read-only. It's dropped when the inode changes, running processes keep the old image
+struct elf_segment {
+  uint32_t offset;  // from the image base
+  uint32_t memsz;
+  uint32_t filesz;
+  uint32_t flags;
+  uint32_t file_offset;
+  uint8_t *data;
+  physical_addr *frames;
+  uint32_t nr_frames;
+};
+
+struct elf_image {
+  struct vfs_superblock *sb;
+  unsigned long ino;
+  uint32_t size;
+  uint32_t mtime;
+  uint32_t users;
+  bool cached;
+
+  uint32_t image_size;
+  uint32_t entry;  // from the image base
+  uint16_t type;
+  char *interp;
+  uint32_t phdr;  // from the image base, 0 if program headers are not loaded
+  uint16_t phnum;
+  uint32_t nr_segments;
+  struct elf_segment *segments;
+  struct list_head sibling;
+};
+
+static LIST_HEAD(elf_images);
+static struct elf_image_stats elf_image_stats;
+
+static bool elf_segment_is_shareable(struct elf_image *image, struct elf_segment *segment) {
+  if (!(segment->flags & PF_X) || !(segment->flags & PF_R) || (segment->flags & PF_W))
+    return false;
 
-  struct process* parent = get_current_process();
+  // page which is shared with another segment has to be private
+  uint32_t start = segment->offset & PAGE_MASK;
+  uint32_t end = PAGE_ALIGN(segment->offset + segment->memsz);
+  for (uint32_t i = 0; i < image->nr_segments; ++i) {
+    struct elf_segment *other = &image->segments[i];
+    if (other != segment &&
+        (other->offset & PAGE_MASK) < end && PAGE_ALIGN(other->offset + other->memsz) > start)
+      return false;
+  }
+  return true;
+}
 
-  assert(!vmm_is_kernel_directory(parent->va_dir));
+static int32_t elf_segment_share(struct elf_segment *segment, uint8_t *src) {
+  uint32_t start = segment->offset & PAGE_MASK;
+  segment->nr_frames = (PAGE_ALIGN(segment->offset + segment->memsz) - start) / PMM_FRAME_SIZE;
+  segment->frames = kcalloc(segment->nr_frames, sizeof(physical_addr));
+
+  for (uint32_t i = 0; i < segment->nr_frames; ++i) {
+    physical_addr paddr = (physical_addr)reclaim_alloc_frame();
+    if (!paddr)
+      return -ENOMEM;
+    segment->frames[i] = paddr;
+
+    // part of the segment which is backed by the file, the rest of the page is zeroed
+    uint32_t page_start = start + i * PMM_FRAME_SIZE;
+    uint32_t from = max(page_start, segment->offset);
+    uint32_t to = min(page_start + PMM_FRAME_SIZE, segment->offset + segment->filesz);
+
+    uint8_t *page = kmap(paddr);
+    memset(page, 0, PMM_FRAME_SIZE);
+    if (from < to)
+      memcpy(page + from - page_start, src + from - segment->offset, to - from);
+    kunmap(page);
+  }
 
+  elf_image_stats.shared_frames += segment->nr_frames;
+  return 0;
+}
+
+static void elf_image_free(struct elf_image *image) {
+  for (uint32_t i = 0; i < image->nr_segments; ++i) {
+    struct elf_segment *segment = &image->segments[i];
+
+    for (uint32_t j = 0; j < segment->nr_frames; ++j) {
+      if (segment->frames[j]) {
+        pmm_free_frame((void *)segment->frames[j]);
+        elf_image_stats.shared_frames--;
+      }
+    }
+    kfree(segment->frames);
+    kfree(segment->data);
+  }
+
+  kfree(image->segments);
+  kfree(image->interp);
+  kfree(image);
+}
+
+static int32_t elf_image_create(uint8_t *elf_file, struct elf_image **res) {
   struct Elf32_Ehdr *elf_header = (struct Elf32_Ehdr *)elf_file;
 
   if (elf_verify(elf_header) != NO_ERROR || elf_header->e_phoff == 0)
@@ -91,53 +177,260 @@ int32_t elf_load(
     base = min(base, ph->p_vaddr);
   }
 
+  struct elf_image *image = kcalloc(1, sizeof(struct elf_image));
+  image->segments = kcalloc(elf_header->e_phnum, sizeof(struct elf_segment));
+  image->entry = elf_header->e_entry - base;
+  image->type = elf_header->e_type;
+  image->phnum = elf_header->e_phnum;
+
   // figuting out, how much memory to allocate
-  parent->image_size = 0;
   for (int i = 0; i < elf_header->e_phnum; ++i) {
     struct Elf32_Phdr *ph = elf_file + elf_header->e_phoff + elf_header->e_phentsize * i;
     uint32_t segment_end = ph->p_vaddr - (uint32_t)base + ph->p_memsz;
-    parent->image_size = max(parent->image_size, segment_end);
-  }
+    image->image_size = max(image->image_size, segment_end);
 
-  parent->image_base = USER_IMAGE_START; // for PIC (or malloc(image_size))
-  assert(USER_HEAP_SIZE % PMM_FRAME_SIZE == 0);
-  
-  mm_struct_mos* mm = parent->mm_mos;
-  mm->heap_start = parent->image_base;
-  mm->brk = mm->heap_start;
-  mm->heap_end = HEAP_END(mm->heap_start);
-  mm->remaning = 0;
+    if (ph->p_type == PT_INTERP && !image->interp) {
+      image->interp = kcalloc(ph->p_filesz + 1, sizeof(char));
+      memcpy(image->interp, elf_file + ph->p_offset, ph->p_filesz);
+    } else if (ph->p_type == PT_PHDR)
+      image->phdr = ph->p_vaddr - base;
+    else if (ph->p_type == PT_LOAD && !image->phdr &&
+             ph->p_offset <= elf_header->e_phoff && elf_header->e_phoff < ph->p_offset + ph->p_filesz)
+      image->phdr = ph->p_vaddr - base + elf_header->e_phoff - ph->p_offset;
 
-  virtual_addr* image = sbrk(
-    parent->image_size, 
-    mm
-  );
-  
-  for (int i = 0; i < elf_header->e_phnum; ++i) {
-    struct Elf32_Phdr *ph = elf_file + elf_header->e_phoff + elf_header->e_phentsize * i;
-    
     if (ph->p_type != PT_LOAD || ph->p_filesz == 0)
-			continue;
+      continue;
+
+    struct elf_segment *segment = &image->segments[image->nr_segments++];
+    segment->offset = ph->p_vaddr - base;
+    segment->memsz = ph->p_memsz;
+    segment->filesz = ph->p_filesz;
+    segment->flags = ph->p_flags;
+    segment->file_offset = ph->p_offset;
+  }
+
+  for (uint32_t i = 0; i < image->nr_segments; ++i) {
+    struct elf_segment *segment = &image->segments[i];
+
+    if (elf_segment_is_shareable(image, segment)) {
+      if (elf_segment_share(segment, elf_file + segment->file_offset) < 0) {
+        elf_image_free(image);
+        return -ENOMEM;
+      }
+    } else {
+      segment->data = kmalloc(segment->filesz);
+      memcpy(segment->data, elf_file + segment->file_offset, segment->filesz);
+    }
+  }
+
+  *res = image;
+  return 0;
+}
+
+static int32_t elf_image_lookup_inode(char *path, struct vfs_inode *inode, struct elf_image **res) {
+  int32_t ret;
+  struct elf_image *iter, *next;
+
+  uint32_t flags = irq_save();
+  list_for_each_entry_safe(iter, next, &elf_images, sibling) {
+    if (iter->sb != inode->i_sb || iter->ino != inode->i_ino)
+      continue;
+
+    if (iter->size == inode->i_size && iter->mtime == inode->i_mtime.tv_sec) {
+      iter->users++;
+      elf_image_stats.hits++;
+      irq_restore(flags);
+      *res = iter;
+      return 0;
+    }
+
+    list_del(&iter->sibling);
+    iter->cached = false;
+    elf_image_stats.images--;
+  }
+  irq_restore(flags);
+
+  uint8_t *elf_file = NULL;
+  if ((ret = vfs_read(path, &elf_file)) < 0)
+    return ret;
+
+  struct elf_image *image = NULL;
+  ret = elf_image_create(elf_file, &image);
+  kfree(elf_file);
+  if (ret < 0)
+    return ret;
+
+  image->sb = inode->i_sb;
+  image->ino = inode->i_ino;
+  image->size = inode->i_size;
+  image->mtime = inode->i_mtime.tv_sec;
+  image->users = 1;
+  image->cached = true;
+
+  flags = irq_save();
+  list_add(&image->sibling, &elf_images);
+  elf_image_stats.images++;
+  elf_image_stats.misses++;
+  irq_restore(flags);
+
+  *res = image;
+  return 0;
+}
+
+// returns image of the file with a reference taken, the file is read only if the image is not cached
+static int32_t elf_image_lookup(char *path, struct elf_image **res) {
+  struct nameidata nd;
+  int32_t ret = vfs_jmp(&nd, path, 0, S_IFREG);
+  if (ret < 0)
+    return ret;
+
+  ret = elf_image_lookup_inode(path, nd.dentry->d_inode, res);
+  dput(nd.dentry);
+  return ret;
+}
 
-    virtual_addr vaddr = parent->image_base + ph->p_vaddr - base;
+void elf_image_get(struct elf_image *image) {
+  uint32_t flags = irq_save();
+  image->users++;
+  irq_restore(flags);
+}
+
+void elf_image_put(struct elf_image *image) {
+  uint32_t flags = irq_save();
+  bool last = --image->users == 0;
+  if (last && image->cached) {
+    list_del(&image->sibling);
+    elf_image_stats.images--;
+  }
+  irq_restore(flags);
+
+  if (last)
+    elf_image_free(image);
+}
+
+// file is changed, running processes keep their image but the next exec loads it again
+void elf_image_invalidate(struct vfs_inode *inode) {
+  struct elf_image *iter, *next;
+
+  uint32_t flags = irq_save();
+  list_for_each_entry_safe(iter, next, &elf_images, sibling) {
+    if (iter->sb == inode->i_sb && iter->ino == inode->i_ino) {
+      list_del(&iter->sibling);
+      iter->cached = false;
+      elf_image_stats.images--;
+    }
+  }
+  irq_restore(flags);
+}
+
+void mm_get_images(mm_struct_mos *mm) {
+  if (mm->image)
+    elf_image_get(mm->image);
+  for (uint32_t i = 0; i < mm->nr_libraries; ++i)
+    elf_image_get(mm->libraries[i].image);
+}
+
+void mm_put_images(mm_struct_mos *mm) {
+  if (mm->image)
+    elf_image_put(mm->image);
+  for (uint32_t i = 0; i < mm->nr_libraries; ++i)
+    elf_image_put(mm->libraries[i].image);
+}
+
+struct elf_image_stats *get_elf_image_stats() {
+  return &elf_image_stats;
+}
+
+static void elf_map_image(struct elf_image *image, virtual_addr image_base, mm_struct_mos *mm) {
+  for (uint32_t i = 0; i < image->nr_segments; ++i) {
+    struct elf_segment *segment = &image->segments[i];
+    virtual_addr vaddr = image_base + segment->offset;
 
-    // text segment
-		if ((ph->p_flags & PF_X) != 0 && (ph->p_flags & PF_R) != 0) {
+    // text segment, code and data of shared objects are not tracked (mm is NULL)
+		if (!mm)
+			;
+		else if ((segment->flags & PF_X) != 0 && (segment->flags & PF_R) != 0) {
 			mm->start_code = vaddr;
-			mm->end_code = vaddr + ph->p_memsz;
+			mm->end_code = vaddr + segment->memsz;
 		}
 		// data segment
-		else if ((ph->p_flags & PF_W) != 0 && (ph->p_flags & PF_R) != 0) {
+		else if ((segment->flags & PF_W) != 0 && (segment->flags & PF_R) != 0) {
 			mm->start_data = vaddr;
-			mm->end_data = vaddr + ph->p_memsz;
+			mm->end_data = vaddr + segment->memsz;
 		}
 
+    if (segment->frames) {
+      for (uint32_t j = 0; j < segment->nr_frames; ++j)
+        vmm_map_shared_page((vaddr & PAGE_MASK) + j * PMM_FRAME_SIZE, segment->frames[j], 0);
+      continue;
+    }
+
     // the ELF specification states that you should zero the BSS area. In bochs, everything's zeroed by default, 
     // but on real computers and virtual machines it isnt.
-    memset(vaddr, 0, ph->p_memsz);
-    memcpy(vaddr, elf_file + ph->p_offset, ph->p_filesz);
+    memset(vaddr, 0, segment->memsz);
+    memcpy(vaddr, segment->data, segment->filesz);
+  }
+}
+
+// maps shared object above the stack, private pages are populated on demand like the heap
+int32_t elf_map_library(char *path, virtual_addr *base) {
+  mm_struct_mos *mm = get_current_process()->mm_mos;
+  if (mm->nr_libraries == MM_MAX_LIBRARIES)
+    return -ENOMEM;
+
+  struct elf_image *image = NULL;
+  int32_t ret = elf_image_lookup(path, &image);
+  if (ret < 0)
+    return ret;
+
+  if (image->type != ET_DYN) {
+    elf_image_put(image);
+    return -ENOEXEC;
   }
 
+  virtual_addr start = USER_LIBRARY_START;
+  if (mm->nr_libraries)
+    start = PAGE_ALIGN(mm->libraries[mm->nr_libraries - 1].end) + USER_STACK_GUARD_SIZE;
+
+  struct mm_library *library = &mm->libraries[mm->nr_libraries++];
+  library->image = image;
+  library->start = start;
+  library->end = PAGE_ALIGN(start + image->image_size);
+
+  elf_map_image(image, start, NULL);
+
+  *base = start;
+  return 0;
+}
+
+int32_t elf_load(
+  char* app_path, 
+  struct ELF32_Layout* layout
+) {
+  struct process* parent = get_current_process();
+
+  assert(!vmm_is_kernel_directory(parent->va_dir));
+
+  struct elf_image *image = NULL;
+  int ret = 0;
+  if ((ret = elf_image_lookup(app_path, &image)) < 0)
+    return ret;
+
+  parent->image_size = image->image_size;
+  parent->image_base = USER_IMAGE_START; // for PIC (or malloc(image_size))
+  assert(USER_HEAP_SIZE % PMM_FRAME_SIZE == 0);
+  
+  mm_struct_mos* mm = parent->mm_mos;
+  mm->heap_start = parent->image_base;
+  mm->brk = mm->heap_start;
+  mm->heap_end = HEAP_END(mm->heap_start);
+  mm->remaning = 0;
+  mm->image = image;
+
+  sbrk(parent->image_size, mm);
+
+  elf_map_image(image, parent->image_base, mm);
+
   if (!create_user_stack(
     parent->va_dir, 
     &layout->stack_bottom,
@@ -146,11 +439,22 @@ int32_t elf_load(
     return false;
   }
 
-  layout->entry = parent->image_base + elf_header->e_entry - base;
+  mm->start_stack = layout->stack_bottom;
+  layout->entry = parent->image_base + image->entry;
   layout->heap_start = mm->heap_start;
   layout->heap_current = sbrk(0, mm);
+
+  // dynamically linked program is started by its interpreter, which gets program headers in auxv
+  layout->exec_entry = layout->entry;
+  layout->phdr = image->phdr ? parent->image_base + image->phdr : 0;
+  layout->phnum = image->phnum;
+  layout->interp_base = 0;
+  if (image->interp) {
+    if ((ret = elf_map_library(image->interp, &layout->interp_base)) < 0)
+      return ret;
+    layout->entry = layout->interp_base + mm->libraries[mm->nr_libraries - 1].image->entry;
+  }
   
-  kfree(elf_file);
   return 0;
 }
 
@@ -165,23 +469,18 @@ int32_t elf_unload(struct process* _proc) {
     
   virtual_addr end = sbrk(0, proc->mm_mos);
 
-  assert(start % PMM_FRAME_SIZE == 0);
-
-  for (virtual_addr virt = start; virt < end; virt+= PMM_FRAME_SIZE) {
-    physical_addr phys = vmm_get_physical_address(virt, false);
-    vmm_unmap_address(virt);
-    pmm_free_frame(phys);
-  }
-
-  start = proc->mm_mos->heap_end;
-  end = start + USER_STACK_SIZE;
-  
-  for (virtual_addr virt = start; virt < end; virt+= PMM_FRAME_SIZE) {
-    physical_addr phys = vmm_get_physical_address(virt, false);
-    vmm_unmap_address(virt);
-    pmm_free_frame(phys);
+  vmm_release_range(start, PAGE_ALIGN(end));
+  vmm_release_range(proc->mm_mos->start_stack - USER_STACK_SIZE, proc->mm_mos->start_stack);
+  for (uint32_t i = 0; i < proc->mm_mos->nr_libraries; ++i) {
+    struct mm_library *library = &proc->mm_mos->libraries[i];
+    vmm_release_range(library->start, library->end);
   }
+  mm_put_images(proc->mm_mos);
+  mm_unmap_shm(proc->mm_mos);
 
+  // page tables are kept for the next image, counters outlive exec
+  struct mm_rss rss = proc->mm_mos->rss;
   memset(proc->mm_mos, 0, sizeof(mm_struct_mos));
+  proc->mm_mos->rss = rss;
   return 0;
 }
\ No newline at end of file
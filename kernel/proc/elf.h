@@ -165,11 +165,31 @@ struct Elf32_Phdr
 	Elf32_Word p_align;
 };
 
+// auxiliary vector passed to the dynamic loader
+#define AT_NULL 0
+#define AT_PHDR 3
+#define AT_PHENT 4
+#define AT_PHNUM 5
+#define AT_PAGESZ 6
+#define AT_BASE 7
+#define AT_ENTRY 9
+
 struct ELF32_Layout {
 	virtual_addr stack_bottom;
   virtual_addr heap_start;
   virtual_addr heap_current;
 	virtual_addr entry;
+  virtual_addr exec_entry;
+  virtual_addr phdr;
+  uint32_t phnum;
+  virtual_addr interp_base;
+};
+
+struct elf_image_stats {
+  uint32_t images;
+  uint32_t shared_frames;
+  uint32_t hits;
+  uint32_t misses;
 };
 
 int32_t elf_load(
@@ -177,4 +197,11 @@ int32_t elf_load(
   struct ELF32_Layout* layout
 );
 int32_t elf_unload(struct process* _proc);
+int32_t elf_map_library(char *path, virtual_addr *base);
+void elf_image_get(struct elf_image *image);
+void elf_image_put(struct elf_image *image);
+void elf_image_invalidate(struct vfs_inode *inode);
+void mm_get_images(mm_struct_mos *mm);
+void mm_put_images(mm_struct_mos *mm);
+struct elf_image_stats *get_elf_image_stats();
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "kernel/memory/vmm.h"
 #include "kernel/proc/task.h"
 #include "kernel/proc/elf.h"
+#include "kernel/ipc/shm.h"
 #include "kernel/include/list.h"
 #include "kernel/include/errno.h"
 #include "kernel/util/debug.h"
@@ -10,21 +11,20 @@
 #include "kernel/include/types.h"
 
 static void exit_mm(struct process *proc) {
-  mm_struct_mos *iter, *next;
+  mm_struct_mos *mm = proc->mm_mos;
+  proc->mm_mos = NULL;
+
+  // other threads of the process still run in this address space
+  if (!vmm_is_kernel_directory(proc->va_dir) && atomic_read(&proc->thread_count) == 1) {
+    vmm_release_user_space(proc->pa_dir);
+    if (mm) {
+      mm_put_images(mm);
+      mm_put_shm(mm);
+    }
+  } else if (mm)
+    lru_forget_mm(mm);
 
-  if (proc->mm_mos) {
-    // bad, but works for now
-    /*
-    pmm_load_PDBR(proc->pa_dir); 
-    
-    if (elf_unload(proc) < 0)
-      assert_not_reached("unable to unload elf");
-    
-    pmm_load_PDBR(get_current_process()->pa_dir);
-    */
-    kfree(proc->mm_mos);
-    proc->mm_mos = NULL;
-  }
+  kfree(mm);
 }
 
 static void exit_files(struct process *proc) {
@@ -35,6 +35,7 @@ static void exit_files(struct process *proc) {
       if (file->f_op->release) {
         file->f_op->release(file->f_dentry->d_inode, file);
       }
+      dput(file->f_dentry);
 
       kfree(file);
       proc->files->fd[i] = 0;
@@ -115,20 +116,14 @@ int exit_thread(struct thread *th) {
 
   bool is_user = !vmm_is_kernel_directory(parent->va_dir);
 
-  // to be able to deduct physical address from a virtual one
-  // we need to switch to a different address space
-  // propably it's better to make recursive trick for 1022 index
-  // of a page directory
-  /*
-  if (is_user) {
-    pmm_load_PDBR(parent->pa_dir);
-  }
-  */
+  // user address space is released in exit_mm through the foreign slot, without switching cr3
 
   //thread_update(th, THREAD_TERMINATED);
   del_timer(&th->s_timer);
 
-  kfree(th->kernel_esp - KERNEL_STACK_SIZE);
+  if (KSTACK_WATERMARK)
+    log("Thread tid: %d used %d bytes of kernel stack", th->tid, kstack_peak_usage(th->kernel_esp));
+  kstack_free(th->kernel_esp);
   atomic_dec(&parent->thread_count);
   
 
@@ -140,6 +135,7 @@ int exit_thread(struct thread *th) {
   list_del(&th->child);
   list_del(&th->sibling);
   list_del(&th->sched_sibling);
+  detach_tid(th);
   kfree(th);
 
 
@@ -184,12 +180,7 @@ void do_exit(int code) {
   // NOTE: little hack, if the process is the leader and it's not the last in th group,
   // then just ignore it
   if (proc->pid == proc->gid) {
-    int count = 0;
-    struct process *iter;
-    process_for_each_entry(iter) {
-      if (iter->gid == proc->gid)
-        ++count;
-    }
+    int count = list_count(&proc->pid_link->pgrp_members);
 
     if (count > 1) {
       log("gid: %d has %d members, cant remove leader", proc->gid, count);
@@ -201,6 +192,7 @@ void do_exit(int code) {
   exit_notify(proc);
   exit_mm(proc);
   exit_files(proc);
+  dput(proc->fs->d_root);
   kfree(proc->fs);
   proc->fs = NULL;
 
@@ -216,6 +208,12 @@ void do_exit(int code) {
   schedule();
 }
 
+static bool wait_child_ready(struct process *child, int options) {
+  return (options & WEXITED && (child->flags & SIGNAL_TERMINATED || child->flags & EXIT_TERMINATED)) ||
+         (options & WUNTRACED && (child->flags & SIGNAL_STOPED || child->flags & SIGNAL_TERMINATED || child->flags & EXIT_TERMINATED)) ||
+         (options & WCONTINUED && child->flags & SIGNAL_CONTINUED);
+}
+
 /*
  * Return:
  * - 1 if found a child process which status is available
@@ -237,23 +235,31 @@ int32_t do_wait(id_type_t idtype, id_t id, struct infop *infop, int options) {
     // NOTE: careful, other routine can change current_process->childrens
     // maybe it makes sense to disable schedule
     lock_scheduler();
-    list_for_each_entry_safe(iter, tmp, &current_process->childrens, child) {
-      log("JUST WAIT");
-      if (!(
-        (idtype == P_PID && iter->pid == id) ||
-        (idtype == P_PGID && iter->gid == id) ||
-        (idtype == P_ALL))
-      ) {
-        continue;
+    if (idtype == P_PID) {
+      iter = find_process_by_pid(id);
+      if (iter && iter->parent == current_process) {
+        child_exist = true;
+        if (wait_child_ready(iter, options))
+          pchild = iter;
+      }
+    } else if (idtype == P_PGID) {
+      pgrp_for_each_process(iter, tmp, id) {
+        if (iter->parent != current_process)
+          continue;
+
+        child_exist = true;
+        if (wait_child_ready(iter, options)) {
+          pchild = iter;
+          break;
+        }
       }
-        
-      child_exist = true;
-      if (
-          (options & WEXITED && (iter->flags & SIGNAL_TERMINATED || iter->flags & EXIT_TERMINATED)) ||
-          (options & WUNTRACED && (iter->flags & SIGNAL_STOPED || iter->flags & SIGNAL_TERMINATED || iter->flags & EXIT_TERMINATED)) ||
-          (options & WCONTINUED && iter->flags & SIGNAL_CONTINUED)) {
-        pchild = iter;
-        break;
+    } else {
+      list_for_each_entry_safe(iter, tmp, &current_process->childrens, child) {
+        child_exist = true;
+        if (wait_child_ready(iter, options)) {
+          pchild = iter;
+          break;
+        }
       }
     }
     unlock_scheduler();
@@ -288,6 +294,7 @@ int32_t do_wait(id_type_t idtype, id_t id, struct infop *infop, int options) {
 		// the next waiting time, we don't find the same one again
     list_del(&pchild->sibling);
     list_del(&pchild->child);
+    detach_pid(pchild);
     kfree(pchild); // delete zombie process descriptor
     
 		ret = 1;
@@ -0,0 +1,206 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/include/errno.h"
+#include "kernel/memory/malloc.h"
+#include "kernel/proc/task.h"
+#include "kernel/util/debug.h"
+#include "kernel/util/string/string.h"
+
+#define pid_hashfn(nr) ((uint32_t)(nr) & (PID_HASH_SIZE - 1))
+
+static uint32_t pid_bitmap[PID_MAX / 32];
+static pid_t last_pid = -1;
+static struct list_head pid_hash[PID_HASH_SIZE];
+static struct list_head tid_hash[PID_HASH_SIZE];
+
+void pid_init() {
+  memset(pid_bitmap, 0, sizeof(pid_bitmap));
+  for (int i = 0; i < PID_HASH_SIZE; ++i) {
+    INIT_LIST_HEAD(&pid_hash[i]);
+    INIT_LIST_HEAD(&tid_hash[i]);
+  }
+}
+
+// search starts after the last allocated pid and wraps around, pid 0 is never released
+static pid_t alloc_pid() {
+  pid_t nr = last_pid + 1;
+
+  for (int32_t scanned = 0; scanned < PID_MAX; ++scanned, ++nr) {
+    if (nr >= PID_MAX)
+      nr = 1;
+
+    uint32_t word = pid_bitmap[nr / 32];
+    if (word == 0xffffffff) {
+      scanned += 31 - nr % 32;
+      nr |= 31;
+      continue;
+    }
+
+    if (!(word & (1 << (nr % 32)))) {
+      pid_bitmap[nr / 32] |= 1 << (nr % 32);
+      last_pid = nr;
+      return nr;
+    }
+  }
+
+  return -EAGAIN;
+}
+
+static void free_pid(pid_t nr) {
+  pid_bitmap[nr / 32] &= ~(1 << (nr % 32));
+}
+
+static struct pid *__find_pid(pid_t nr) {
+  struct pid *iter;
+  list_for_each_entry(iter, &pid_hash[pid_hashfn(nr)], hash_sibling) {
+    if (iter->nr == nr)
+      return iter;
+  }
+  return NULL;
+}
+
+struct pid *find_pid(pid_t nr) {
+  if (nr < 0 || nr >= PID_MAX)
+    return NULL;
+
+  uint32_t flags = irq_save();
+  struct pid *pid = __find_pid(nr);
+  irq_restore(flags);
+  return pid;
+}
+
+struct process *find_process_by_pid(pid_t nr) {
+  struct pid *pid = find_pid(nr);
+  return pid ? pid->proc : NULL;
+}
+
+static void get_pid(struct pid *pid) {
+  atomic_inc(&pid->count);
+}
+
+static void put_pid(struct pid *pid) {
+  atomic_dec(&pid->count);
+  if (atomic_read(&pid->count) > 0)
+    return;
+
+  list_del(&pid->hash_sibling);
+  free_pid(pid->nr);
+  kfree(pid);
+}
+
+int32_t attach_pid(struct process *proc) {
+  uint32_t flags = irq_save();
+
+  pid_t nr = alloc_pid();
+  if (nr < 0) {
+    irq_restore(flags);
+    return nr;
+  }
+
+  struct pid *pid = kcalloc(1, sizeof(struct pid));
+  pid->nr = nr;
+  pid->proc = proc;
+  atomic_set(&pid->count, 1);
+  INIT_LIST_HEAD(&pid->pgrp_members);
+  INIT_LIST_HEAD(&pid->session_members);
+  list_add(&pid->hash_sibling, &pid_hash[pid_hashfn(nr)]);
+
+  proc->pid = nr;
+  proc->pid_link = pid;
+  INIT_LIST_HEAD(&proc->pgrp_sibling);
+  INIT_LIST_HEAD(&proc->session_sibling);
+
+  irq_restore(flags);
+  return 0;
+}
+
+// called when process descriptor is released (zombie is reaped)
+void detach_pid(struct process *proc) {
+  uint32_t flags = irq_save();
+
+  if (!list_empty(&proc->pgrp_sibling)) {
+    list_del(&proc->pgrp_sibling);
+    put_pid(__find_pid(proc->gid));
+  }
+
+  if (!list_empty(&proc->session_sibling)) {
+    list_del(&proc->session_sibling);
+    put_pid(__find_pid(proc->sid));
+  }
+
+  proc->pid_link->proc = NULL;
+  put_pid(proc->pid_link);
+  proc->pid_link = NULL;
+
+  irq_restore(flags);
+}
+
+int32_t process_set_pgid(struct process *proc, pid_t pgid) {
+  uint32_t flags = irq_save();
+
+  struct pid *pgrp = pgid >= 0 && pgid < PID_MAX ? __find_pid(pgid) : NULL;
+  if (!pgrp) {
+    irq_restore(flags);
+    return -ESRCH;
+  }
+
+  get_pid(pgrp);
+  if (!list_empty(&proc->pgrp_sibling)) {
+    list_del(&proc->pgrp_sibling);
+    put_pid(__find_pid(proc->gid));
+  }
+
+  proc->gid = pgid;
+  list_add_tail(&proc->pgrp_sibling, &pgrp->pgrp_members);
+
+  irq_restore(flags);
+  return 0;
+}
+
+int32_t process_set_sid(struct process *proc, pid_t sid) {
+  uint32_t flags = irq_save();
+
+  struct pid *session = sid >= 0 && sid < PID_MAX ? __find_pid(sid) : NULL;
+  if (!session) {
+    irq_restore(flags);
+    return -ESRCH;
+  }
+
+  get_pid(session);
+  if (!list_empty(&proc->session_sibling)) {
+    list_del(&proc->session_sibling);
+    put_pid(__find_pid(proc->sid));
+  }
+
+  proc->sid = sid;
+  list_add_tail(&proc->session_sibling, &session->session_members);
+
+  irq_restore(flags);
+  return 0;
+}
+
+void attach_tid(struct thread *th) {
+  uint32_t flags = irq_save();
+  list_add(&th->tid_sibling, &tid_hash[pid_hashfn(th->tid)]);
+  irq_restore(flags);
+}
+
+void detach_tid(struct thread *th) {
+  uint32_t flags = irq_save();
+  list_del(&th->tid_sibling);
+  irq_restore(flags);
+}
+
+struct thread *find_thread_by_tid(uint32_t tid) {
+  struct thread *iter, *th = NULL;
+  uint32_t flags = irq_save();
+
+  list_for_each_entry(iter, &tid_hash[pid_hashfn(tid)], tid_sibling) {
+    if (iter->tid == tid) {
+      th = iter;
+      break;
+    }
+  }
+
+  irq_restore(flags);
+  return th;
+}
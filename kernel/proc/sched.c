@@ -9,6 +9,7 @@
 #include "kernel/util/debug.h"
 #include "kernel/include/list.h"
 #include "kernel/util/math.h"
+#include "kernel/util/string/string.h"
 
 struct list_head process_list;
 
@@ -21,22 +22,111 @@ struct list_head ready_threads;
 // TODO: put it in th kernel stack, it's is more efficient
 struct thread* _current_thread = NULL;
 
-extern void switch_to_thread(struct thread* next_task);
+extern void switch_to_thread(struct thread* next_task, physical_addr pa_dir);
 extern void scheduler_tick();
 
 static int32_t scheduler_lock_counter = 0;
+static volatile bool sched_voluntary = false;
+static struct preempt_trace preempt_trace;
+static struct tlb_stats tlb_stats;
+
+static void preempt_trace_start(struct thread *th, virtual_addr ip) {
+  th->preempt_start = rdtsc();
+  th->preempt_start_ip = ip;
+}
+
+static void preempt_trace_stop(struct thread *th) {
+  uint64_t cycles = rdtsc() - th->preempt_start;
+
+  if (cycles > preempt_trace.max_cycles) {
+    preempt_trace.max_cycles = cycles;
+    preempt_trace.max_ip = th->preempt_start_ip;
+    preempt_trace.max_tid = th->tid;
+  }
+}
+
+struct tlb_stats *get_tlb_stats() {
+  return &tlb_stats;
+}
+
+// kernel threads keep the previous address space, its kernel half is shared so TLB isn't flushed
+static physical_addr sched_next_address_space(struct thread* th) {
+  physical_addr cur_pa_dir = pmm_get_PDBR();
+  tlb_stats.switches++;
+
+  if (vmm_is_kernel_directory(th->proc->va_dir)) {
+    tlb_stats.lazy_switches++;
+    return cur_pa_dir;
+  }
+
+  if (th->proc->pa_dir == cur_pa_dir) {
+    tlb_stats.same_space++;
+    return cur_pa_dir;
+  }
+
+  tlb_stats.flushes++;
+  return th->proc->pa_dir;
+}
+
+struct preempt_trace *get_preempt_trace() {
+  return &preempt_trace;
+}
+
+void reset_preempt_trace() {
+  memset(&preempt_trace, 0, sizeof(struct preempt_trace));
+}
+
+void preempt_disable() {
+  if (!_current_thread)
+    return;
+
+  if (_current_thread->preempt_count++ == 0)
+    preempt_trace_start(_current_thread, (virtual_addr)__builtin_return_address(0));
+}
+
+void preempt_enable_no_resched() {
+  if (!_current_thread)
+    return;
+
+  assert(_current_thread->preempt_count > 0, "preempt count cannt be < 0");
+  if (--_current_thread->preempt_count == 0)
+    preempt_trace_stop(_current_thread);
+}
+
+static bool preemptible() {
+  return _current_thread && _current_thread->preempt_count == 0 && interrupts_enabled();
+}
+
+void preempt_enable() {
+  preempt_enable_no_resched();
+
+  if (preemptible() && _current_thread->need_resched)
+    schedule();
+}
+
+// called on irq return after softirqs, interrupts are still disabled so preemptible() doesn't fit
+void preempt_schedule_irq() {
+  if (_current_thread && _current_thread->need_resched && !_current_thread->preempt_count)
+    make_schedule();
+}
 
 void lock_scheduler() {
   disable_interrupts();
   scheduler_lock_counter++;
+  preempt_disable();
 }
 
 void unlock_scheduler() {
   assert(scheduler_lock_counter > 0, "scheduler lock cannt be < 0");
 
   scheduler_lock_counter--;
-  if (scheduler_lock_counter == 0)
+  preempt_enable_no_resched();
+  if (scheduler_lock_counter == 0) {
     enable_interrupts();
+
+    if (preemptible() && _current_thread->need_resched)
+      schedule();
+  }
 }
 
 static struct list_head* sched_get_list(enum thread_state state) {
@@ -100,6 +190,15 @@ struct list_head* get_waiting_threads() {
 */
 
 void scheduler_tick() {
+  bool voluntary = sched_voluntary;
+  sched_voluntary = false;
+
+  // thread is in non-preemptible section, it will be rescheduled as soon as it leaves it
+  if (!voluntary && _current_thread && _current_thread->preempt_count > 0) {
+    _current_thread->need_resched = true;
+    return;
+  }
+
   make_schedule();
 }
 
@@ -109,7 +208,10 @@ void thread_remove_state(struct thread* t, enum thread_state state) {
 
 /* schedule new task to run. */
 void schedule() {
+  uint32_t flags = irq_save();
+  sched_voluntary = true;
   __asm volatile("int $32");
+  irq_restore(flags);
 }
 
 void thread_set_state(struct thread* t, enum thread_state state) {
@@ -153,22 +255,12 @@ void thread_wait(struct thread* th) {
 }
 
 bool thread_signal(uint32_t tid, int32_t signum) {
-  struct thread* th = NULL;
-  list_for_each_entry(th, sched_get_list(THREAD_READY), sched_sibling) {
-    if (tid == th->tid) {
-      th->pending |= sigmask(signum);
-      return true;
-    }
-  }
+  struct thread* th = find_thread_by_tid(tid);
+  if (!th)
+    return false;
 
-  list_for_each_entry(th, sched_get_list(THREAD_WAITING), sched_sibling) {
-    if (tid == th->tid) {
-      th->pending |= sigmask(signum);
-      return true;
-    }
-  }
-
-  return false;
+  th->pending |= sigmask(signum);
+  return true;
 }
 
 /*
@@ -199,6 +291,9 @@ void thread_mark_dead(struct thread* th) {
 }
 
 void make_schedule() {
+  if (_current_thread)
+    _current_thread->need_resched = false;
+
 next_thread:
   struct thread* th = pop_next_thread_to_run();
   
@@ -212,7 +307,11 @@ do_switch:
   // INFO: SA switch to trhead invokes tss_set_stack implicitly
   // tss_set_stack(KERNEL_DATA, th->kernel_esp);
   // log("sched: tid: %d, name: %s", th->tid, th->proc->name);
-  switch_to_thread(th);
+  switch_to_thread(th, sched_next_address_space(th));
+
+  // time spent in sleeping is not accounted as non-preemptible
+  if (_current_thread->preempt_count > 0)
+    _current_thread->preempt_start = rdtsc();
   
   // if thread has acuired some resources, it needs to release it first
   if (siginmask(_current_thread->pending, SIG_KERNEL_ONLY_MASK)) {
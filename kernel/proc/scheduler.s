@@ -61,7 +61,7 @@ chain_interrupt:
   ret
 
 # C declaration:
-#   void switch_to_thread(thread_control_block *next_thread)#
+#   void switch_to_thread(thread_control_block *next_thread, physical_addr pa_dir)#
 #
 # WARNING: Caller is expected to disable IRQs before calling, and enable IRQs again after function returns
 .global switch_to_thread
@@ -89,6 +89,8 @@ switch_to_thread:
   mov $(4 + 1), %eax
   mov (%esp, %eax, 4), %esi        # esi = address of the next task's "struct thread control block" (parameter passed on stack)
   mov %esi, [_current_thread]        # Current task's TCB is the next task TCB
+  mov $(4 + 2), %eax
+  mov (%esp, %eax, 4), %edi        # edi = address of page directory (phys) chosen by scheduler (kernel threads keep the previous one)
 
   mov $4, %eax
   mov (%esi, %eax, 4), %esp        # Load ESP for next task's kernel stack from the struct thread's TCB
@@ -99,10 +101,7 @@ switch_to_thread:
   call tss_set_stack
   add $8, %esp                     # remove params from the stack
   mov %cr3, %ecx                   # ecx = previous task's virtual address space
-  
-  mov $4, %eax
-  mov 4(%esi, %eax, 4), %esi       
-  mov 4(%esi, %eax, 2), %eax        # eax = address of page directory (phys) for next task
+  mov %edi, %eax                   # eax = address of page directory (phys) for next task
 
   #push $0
   #push %eax
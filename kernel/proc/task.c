@@ -6,6 +6,7 @@
 #include "kernel/memory/malloc.h"
 #include "kernel/memory/vmm.h"
 #include "kernel/proc/elf.h"
+#include "kernel/ipc/shm.h"
 #include "kernel/util/debug.h"
 #include "kernel/include/errno.h"
 #include "kernel/include/list.h"
@@ -30,9 +31,7 @@ struct list_head *get_proc_list() {
 
 void start_kernel_task(struct thread *th);
 
-static uint32_t next_pid = 0;
 static uint32_t next_tid = 0;
-static uint32_t next_sid = 0;
 
 void scheduler_isr();
 void (*old_pic_isr)();
@@ -40,32 +39,12 @@ void idle_task();
 
 /* create a new kernel space stack. */
 bool create_kernel_stack(virtual_addr *kernel_stack) {
-  void *ret;
-
-  /* allocate a 4k frame for the stack. */
   // https://forum.osdev.org/viewtopic.php?f=1&t=22014
-  // stack is better to be aligned 16byte
-  log("allocating kernel stack");
-  *kernel_stack = kcalloc_aligned(KERNEL_STACK_SIZE, sizeof(char), 16);
-  log("allocated kernel stack");
-  
-  /*
-  virtual_addr aligned = kalign_heap(16);
-        *kernel_stack = kcalloc(KERNEL_STACK_SIZE, sizeof(char));
-  if (aligned) {
-    kfree(aligned);
-  }
-  */
-
-  if (!(*kernel_stack)) {
-    return false;
-  }
+  // stack is better to be aligned 16byte, slots of stack area are page aligned
+  *kernel_stack = kstack_alloc();
 
-  /* moving pointer to the top of the stack */
-  *kernel_stack += KERNEL_STACK_SIZE;
-
-  
-  return true;
+  /* pointer is at the top of the stack */
+  return *kernel_stack != 0;
 }
 
 /* creates user stack for main struct thread. */
@@ -73,9 +52,6 @@ bool create_user_stack(
     struct pdirectory *space,
     virtual_addr *user_esp,
     virtual_addr addr) {
-  /* this will call our address space allocator
-  to reserve area in user space. Until then,
-  return error. */
   if (USER_STACK_SIZE % PMM_FRAME_SIZE != 0) {
     assert_not_reached("User stack size is not %d aligned", PMM_FRAME_SIZE);
   }
@@ -84,17 +60,8 @@ bool create_user_stack(
     assert_not_reached("User stack address is not %d aligned", PMM_FRAME_SIZE);
   }
 
-  uint32_t frames_count = USER_STACK_SIZE / PMM_FRAME_SIZE;
-  physical_addr user_stack = pmm_alloc_frames(frames_count);
-
-  for (int i = 0; i < frames_count; ++i) {
-    vmm_map_address(
-        addr + PMM_FRAME_SIZE * i,
-        user_stack + PMM_FRAME_SIZE * i,
-        I86_PTE_PRESENT | I86_PTE_WRITABLE | I86_PTE_USER);
-  }
-
-  *user_esp = addr + USER_STACK_SIZE;
+  // stack is only reserved above the guard gap, pages are populated on page faults
+  *user_esp = addr + USER_STACK_GUARD_SIZE + USER_STACK_SIZE;
 
   return true;
 }
@@ -117,17 +84,6 @@ static void thread_wakeup_timer(struct sleep_timer *timer) {
   }
 }
 
-struct process *find_process_by_pid(pid_t pid) {
-  disable_interrupts();
-  struct process *iter;
-  process_for_each_entry(iter) {
-    if (iter->pid == pid)
-      return iter;
-  }
-  enable_interrupts();
-  return NULL;
-}
-
 static struct thread *thread_create(
     struct process *parent,
     virtual_addr eip,
@@ -144,6 +100,7 @@ static struct thread *thread_create(
 
   th->proc = parent;
   th->tid = ++next_tid;
+  attach_tid(th);
   th->state = THREAD_READY;
   th->kernel_esp = kernel_stack;
   th->user_esp = NULL;
@@ -174,7 +131,7 @@ static struct thread *thread_create(
   return th;
 }
 
-static int32_t empack_params(char **_argv, char **_envp) {
+static int32_t empack_params(char **_argv, char **_envp, struct ELF32_Layout *layout) {
   struct thread *th = get_current_thread();
   struct process *parent = th->proc;
   char *path = parent->name;
@@ -213,11 +170,25 @@ static int32_t empack_params(char **_argv, char **_envp) {
   }
   envp[envp_count] = 0;
 
-  uint32_t params[4] = {
+  // only the dynamic loader reads it, crt0 ignores it
+  uint32_t auxv_entries[] = {
+    AT_PHDR, layout->phdr,
+    AT_PHENT, sizeof(struct Elf32_Phdr),
+    AT_PHNUM, layout->phnum,
+    AT_PAGESZ, PMM_FRAME_SIZE,
+    AT_BASE, layout->interp_base,
+    AT_ENTRY, layout->exec_entry,
+    AT_NULL, 0,
+  };
+  uint32_t *auxv = sbrk(sizeof(auxv_entries), parent->mm_mos);
+  memcpy(auxv, auxv_entries, sizeof(auxv_entries));
+
+  uint32_t params[5] = {
     PROCESS_TRAPPED_PAGE_FAULT,
     argc,
     argv,
-    envp
+    envp,
+    auxv
   };
   int len = sizeof(params);
   memcpy(th->user_esp - len, params, len);
@@ -277,7 +248,7 @@ static void user_thread_elf_entry(struct thread *th, virtual_addr eip, char **ar
   th->user_ss = USER_DATA;
   th->user_esp = layout.stack_bottom;
 
-  if (empack_params(argv, NULL) < 0) {
+  if (empack_params(argv, NULL, &layout) < 0) {
     assert_not_reached("Cannot empack params");
   }
 
@@ -319,10 +290,12 @@ static struct process *create_process(struct process *parent, char *name, struct
   lock_scheduler();
   struct process *proc = kcalloc(1, sizeof(struct process));
 
+  if (attach_pid(proc) < 0) {
+    kfree(proc);
+    unlock_scheduler();
+    return NULL;
+  }
   list_add(&proc->sibling, get_proc_list());
-  proc->pid = next_pid++;
-
-  proc->gid = proc->pid;
 
   atomic_set(&proc->thread_count, 0);
   proc->files = create_files_descriptors();
@@ -345,11 +318,15 @@ static struct process *create_process(struct process *parent, char *name, struct
 
   proc->fs = kcalloc(1, sizeof(fs_struct));
   if (parent) {
-    proc->gid = parent->gid;
-    proc->sid = parent->sid;
+    process_set_pgid(proc, parent->gid);
+    process_set_sid(proc, parent->sid);
 
     memcpy(proc->fs, parent->fs, sizeof(fs_struct));
+    dget(proc->fs->d_root);
     list_add_tail(&proc->child, &parent->childrens);
+  } else {
+    process_set_pgid(proc, proc->pid);
+    process_set_sid(proc, proc->pid);
   }
 
   log("Creating process pid: %d", proc->pid);
@@ -360,7 +337,9 @@ static struct process *create_process(struct process *parent, char *name, struct
 
 void idle_task() {
   while (1) {
-    __asm volatile("pause" ::: "memory");
+    // idle time is used to clear frames for page faults and page tables
+    if (!pmm_zero_pool_refill())
+      __asm volatile("pause" ::: "memory");
   }
 }
 
@@ -457,6 +436,14 @@ struct process *get_current_process() {
 static mm_struct_mos *clone_mm_struct(mm_struct_mos *mm_parent) {
   mm_struct_mos *mm = kcalloc(1, sizeof(mm_struct_mos));
   memcpy(mm, mm_parent, sizeof(mm_struct_mos));
+  mm_get_images(mm);
+  mm_get_shm(mm);
+
+  // vmm_fork copies every page, swapped ones are read back into memory for the child
+  mm->rss.resident += mm->rss.swapped;
+  mm->rss.swapped = 0;
+  mm->rss.hiwater_rss = mm->rss.resident;
+  mm->rss.min_flt = mm->rss.maj_flt = 0;
   return mm;
 }
 
@@ -536,9 +523,13 @@ pid_t process_spawn(struct process *parent) {
   load_trap_frame(&stf);
 
   struct process *proc = kcalloc(1, sizeof(struct process));
-  proc->pid = next_pid++;
-  proc->gid = parent->gid;
-  proc->sid = parent->sid;
+  if (attach_pid(proc) < 0) {
+    kfree(proc);
+    unlock_scheduler();
+    return -EAGAIN;
+  }
+  process_set_pgid(proc, parent->gid);
+  process_set_sid(proc, parent->sid);
   proc->parent = parent;
   proc->tty = parent->tty;
   proc->name = strdup(parent->name);
@@ -554,6 +545,7 @@ pid_t process_spawn(struct process *parent) {
 
   proc->fs = kcalloc(1, sizeof(fs_struct));
   memcpy(proc->fs, parent->fs, sizeof(fs_struct));
+  dget(proc->fs->d_root);
 
   proc->files = clone_file_descriptor_table(parent->files);
   proc->va_dir = parent->va_dir;
@@ -605,9 +597,13 @@ pid_t process_fork(struct process *parent) {
   assert(!is_kernel);
 
   struct process *proc = kcalloc(1, sizeof(struct process));
-  proc->pid = next_pid++;
-  proc->gid = parent->gid;
-  proc->sid = parent->sid;
+  if (attach_pid(proc) < 0) {
+    kfree(proc);
+    unlock_scheduler();
+    return -EAGAIN;
+  }
+  process_set_pgid(proc, parent->gid);
+  process_set_sid(proc, parent->sid);
   proc->parent = parent;
   proc->tty = parent->tty;
   proc->name = strdup(parent->name);
@@ -623,9 +619,10 @@ pid_t process_fork(struct process *parent) {
 
   proc->fs = kcalloc(1, sizeof(fs_struct));
   memcpy(proc->fs, parent->fs, sizeof(fs_struct));
+  dget(proc->fs->d_root);
 
   proc->files = clone_file_descriptor_table(parent->files);
-  proc->va_dir = vmm_fork(parent->va_dir);
+  proc->va_dir = vmm_fork(parent->va_dir, proc->mm_mos);
   proc->pa_dir = vmm_get_physical_address(proc->va_dir, false);
 
   struct thread *parent_thread = get_current_thread();
@@ -674,21 +671,25 @@ void leave_critical_section() {
 int32_t setpgid(pid_t pid, pid_t pgid) {
   struct process *current_process = get_current_process();
   struct process *p = !pid ? current_process : find_process_by_pid(pid);
-  struct process *l = !pgid ? p : find_process_by_pid(pgid);
+  if (!p)
+    return -ESRCH;
+
+  pid_t gid = !pgid ? p->pid : pgid;
+  struct pid *pgrp = find_pid(gid);
+
+  // group can outlive its leader, in that case any member tells the session
+  struct process *l = NULL;
+  if (pgrp && pgrp->proc)
+    l = pgrp->proc;
+  else if (pgrp && !list_empty(&pgrp->pgrp_members))
+    l = list_first_entry(&pgrp->pgrp_members, struct process, pgrp_sibling);
 
-  // TODO: rewrite this hack
-  // case when group leader is dead needs to be handled properly
   if (!l || l->sid != p->sid) {
-    log("pid: %d sid :%d is different from pid: %d sid: %d", l->pid, l->sid, p->pid, p->sid);
-    //p->gid = pgid;
-    return -1;
-    
-    log("Unable to find process groupd: %d", pgid);
+    log("Unable to find process group: %d in session: %d", gid, p->sid);
     return -1;
   }
 
-  p->gid = l->pid;
-  return 0;
+  return process_set_pgid(p, gid);
 }
 
 int count_array_of_pointers(void *arr) {
@@ -746,7 +747,7 @@ int32_t process_execve(const char *path, char *const argv[], char *const envp[])
   th->user_ss = USER_DATA;
   th->user_esp = layout.stack_bottom;
 
-  if (empack_params(kernel_argv, kernel_envp) < 0) {
+  if (empack_params(kernel_argv, kernel_envp, &layout) < 0) {
     assert_not_reached("Cannot empack params");
   }
 
@@ -759,6 +760,7 @@ int32_t process_execve(const char *path, char *const argv[], char *const envp[])
 
 bool initialise_multitasking(virtual_addr entry) {
   INIT_LIST_HEAD(&all_threads);
+  pid_init();
 
   sched_init();
 
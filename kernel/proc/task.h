@@ -53,6 +53,62 @@ enum thread_state {
 };
 
 struct _process;
+struct elf_image;
+struct shm_object;
+
+// shared object (dynamic loader or library) mapped above user stack
+#define MM_MAX_LIBRARIES 16
+struct mm_library {
+  struct elf_image *image;
+  uint32_t start;
+  uint32_t end;
+};
+
+// shared memory object (ipc/shm.c) mapped with mmap
+#define MM_MAX_SHM 16
+struct mm_shm {
+  struct shm_object *object;
+  uint32_t start;
+  uint32_t end;
+};
+
+// pages of address space (vmm.c, reclaim.c), heap and stack are counted in or out of swap
+struct mm_rss {
+  uint32_t resident;
+  uint32_t shared;  // exec image and shared memory frames, part of resident
+  uint32_t swapped;
+  uint32_t heap;
+  uint32_t stack;
+  uint32_t page_tables;
+  uint32_t hiwater_rss;
+  uint32_t min_flt;  // zero-filled on demand
+  uint32_t maj_flt;  // read back from swap
+};
+
+#define RUSAGE_SELF 0
+
+// same layout as linux, sizes are in kilobytes
+struct rusage {
+  struct {
+    int32_t tv_sec;
+    int32_t tv_usec;
+  } ru_utime, ru_stime;  // not tracked
+  int32_t ru_maxrss;
+  int32_t ru_ixrss;  // shared
+  int32_t ru_idrss;  // heap
+  int32_t ru_isrss;  // stack
+  int32_t ru_minflt;
+  int32_t ru_majflt;
+  int32_t ru_nswap;  // pages in swap
+  int32_t ru_inblock;
+  int32_t ru_oublock;
+  int32_t ru_msgsnd;
+  int32_t ru_msgrcv;
+  int32_t ru_nsignals;
+  int32_t ru_nvcsw;
+  int32_t ru_nivcsw;
+};
+
 typedef unsigned int ktime_t;
 
 typedef struct _thread_info {
@@ -80,12 +136,21 @@ typedef struct _mm_struct_mos {
 	// NOTE: MQ 2020-01-30
 	// end_brk is marked as the end of heap section, brk is end but in range start_brk<->end_brk and expand later
 	// better way is only mapping start_brk->brk and handling page fault brk->end_brk
-  uint32_t start_brk, brk, end_brk, start_stack; // not used now
+  uint32_t start_brk, brk, end_brk; // not used now
+  // top of user stack, stack is reserved down to start_stack - USER_STACK_SIZE
+  uint32_t start_stack;
 
   virtual_addr heap_start;
   //virtual_addr brk;  // current pointer
   uint32_t remaning;
   virtual_addr heap_end;
+  // loaded executable, its text frames are shared with other processes
+  struct elf_image *image;
+  struct mm_library libraries[MM_MAX_LIBRARIES];
+  uint32_t nr_libraries;
+  struct mm_shm shm[MM_MAX_SHM];
+  uint32_t nr_shm;
+  struct mm_rss rss;
 } mm_struct_mos;
 
 typedef struct process;
@@ -114,6 +179,28 @@ struct thread {
   struct sleep_timer s_timer;
   atomic_t lock_counter;
   bool dead_mark;
+
+  // kernel preemption, thread is preempted only when preempt_count is 0
+  int32_t preempt_count;
+  volatile bool need_resched;
+  uint64_t preempt_start;
+  virtual_addr preempt_start_ip;
+
+  struct list_head tid_sibling;  // used by tid hash table
+};
+
+struct tlb_stats {
+  uint32_t switches;
+  uint32_t flushes;
+  uint32_t lazy_switches;  // kernel thread kept the previous address space
+  uint32_t same_space;     // next thread shares the address space
+};
+
+// longest section in which kernel was not preemptible
+struct preempt_trace {
+  uint64_t max_cycles;
+  virtual_addr max_ip;
+  uint32_t max_tid;
 };
 
 typedef struct _files_struct {
@@ -173,6 +260,24 @@ struct process {
   struct process *parent;
   struct list_head childrens;
   struct list_head child; // used for a list of childs
+
+  struct pid *pid_link;
+  struct list_head pgrp_sibling;     // used for a list of process group members
+  struct list_head session_sibling;  // used for a list of session members
+};
+
+#define PID_MAX 32768
+#define PID_HASH_BITS 8
+#define PID_HASH_SIZE (1 << PID_HASH_BITS)
+
+// number is allocated while a process, process group or session refers to it
+struct pid {
+  pid_t nr;
+  atomic_t count;
+  struct process *proc;  // NULL if process is already reaped
+  struct list_head pgrp_members;
+  struct list_head session_members;
+  struct list_head hash_sibling;
 };
 
 // task.c
@@ -188,7 +293,6 @@ pid_t process_fork(struct process* parent);
 pid_t process_spawn(struct process *parent);
 int32_t dup2(int oldfd, int newfd);
 int32_t dswap(int fd1, int fd2);
-struct process *find_process_by_pid(pid_t pid);
 int32_t setpgid(pid_t pid, pid_t pgid);
 struct process *get_init_proc();
 int32_t dup(int oldfd);
@@ -206,9 +310,36 @@ bool create_user_stack(
   struct process *next; \
   list_for_each_entry_safe(iter, next, get_proc_list(), sibling)
 
+#define pgrp_for_each_process(iter, next, pgid)                   \
+  for (struct pid *__pgrp = find_pid(pgid); __pgrp; __pgrp = NULL) \
+    list_for_each_entry_safe(iter, next, &__pgrp->pgrp_members, pgrp_sibling)
+
+#define session_for_each_process(iter, next, sid)                       \
+  for (struct pid *__session = find_pid(sid); __session; __session = NULL) \
+    list_for_each_entry_safe(iter, next, &__session->session_members, session_sibling)
+
+// pid.c
+void pid_init();
+int32_t attach_pid(struct process *proc);
+void detach_pid(struct process *proc);
+struct pid *find_pid(pid_t nr);
+struct process *find_process_by_pid(pid_t pid);
+int32_t process_set_pgid(struct process *proc, pid_t pgid);
+int32_t process_set_sid(struct process *proc, pid_t sid);
+void attach_tid(struct thread *th);
+void detach_tid(struct thread *th);
+struct thread *find_thread_by_tid(uint32_t tid);
+
 // sched.c
 void lock_scheduler();
 void unlock_scheduler();
+void preempt_disable();
+void preempt_enable();
+void preempt_enable_no_resched();
+void preempt_schedule_irq();
+struct preempt_trace *get_preempt_trace();
+struct tlb_stats *get_tlb_stats();
+void reset_preempt_trace();
 void make_schedule();
 void sched_init();
 void schedule();
@@ -0,0 +1,102 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/proc/task.h"
+#include "kernel/util/debug.h"
+
+#include "kernel/system/softirq.h"
+
+// keeps irq exit bounded, softirqs raised meanwhile wait for the next irq exit
+#define MAX_SOFTIRQ_RESTART 10
+
+static softirq_action softirq_vec[NR_SOFTIRQS];
+static volatile uint32_t softirq_pending = 0;
+static volatile bool softirq_running = false;
+static struct list_head tasklet_list;
+
+void open_softirq(enum softirq_vector nr, softirq_action action) {
+  assert(nr < NR_SOFTIRQS, "invalid softirq %d", nr);
+  softirq_vec[nr] = action;
+}
+
+void raise_softirq(enum softirq_vector nr) {
+  uint32_t flags = irq_save();
+  softirq_pending |= 1 << nr;
+  irq_restore(flags);
+}
+
+bool in_softirq() {
+  return softirq_running;
+}
+
+/*
+  called from irq_handler after EOI with interrupts disabled, softirq handlers run with
+  interrupts enabled on the stack of the interrupted thread. Softirqs are not re-entered,
+  nested irqs only mark vectors as pending.
+*/
+void do_softirq() {
+  if (softirq_running || !softirq_pending)
+    return;
+
+  softirq_running = true;
+  // thread is not preempted while running softirqs, tick only marks it with need_resched
+  preempt_disable();
+
+  uint32_t pending;
+  int32_t restart = MAX_SOFTIRQ_RESTART;
+  while ((pending = softirq_pending) && restart-- > 0) {
+    softirq_pending = 0;
+    enable_interrupts();
+
+    for (int32_t nr = 0; pending; ++nr, pending >>= 1) {
+      if (pending & 1 && softirq_vec[nr])
+        softirq_vec[nr]();
+    }
+
+    disable_interrupts();
+  }
+
+  preempt_enable_no_resched();
+  softirq_running = false;
+}
+
+void tasklet_init(struct tasklet_struct *t, void (*func)(uint32_t), uint32_t data) {
+  t->func = func;
+  t->data = data;
+  t->state = 0;
+  INIT_LIST_HEAD(&t->sibling);
+}
+
+void tasklet_schedule(struct tasklet_struct *t) {
+  uint32_t flags = irq_save();
+
+  // tasklet is run once even if it was scheduled a few times before running
+  if (!(t->state & TASKLET_STATE_SCHED)) {
+    t->state |= TASKLET_STATE_SCHED;
+    list_add_tail(&t->sibling, &tasklet_list);
+    softirq_pending |= 1 << TASKLET_SOFTIRQ;
+  }
+
+  irq_restore(flags);
+}
+
+static void tasklet_action() {
+  while (true) {
+    disable_interrupts();
+    if (list_empty(&tasklet_list)) {
+      enable_interrupts();
+      break;
+    }
+
+    struct tasklet_struct *t = list_first_entry(&tasklet_list, struct tasklet_struct, sibling);
+    list_del(&t->sibling);
+    // cleared before running, so tasklet can re-schedule itself
+    t->state &= ~TASKLET_STATE_SCHED;
+    enable_interrupts();
+
+    t->func(t->data);
+  }
+}
+
+void softirq_init() {
+  INIT_LIST_HEAD(&tasklet_list);
+  open_softirq(TASKLET_SOFTIRQ, tasklet_action);
+}
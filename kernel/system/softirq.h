@@ -0,0 +1,49 @@
+#ifndef KERNEL_SYSTEM_SOFTIRQ_H
+#define KERNEL_SYSTEM_SOFTIRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "kernel/include/list.h"
+
+/*
+  NOTE: bottom halves
+  irq handlers only acknowledge the device and raise a softirq (or schedule a tasklet),
+  the rest of the work is done on irq exit with interrupts enabled.
+  Work which might sleep has to be moved to a workqueue (system/workqueue.h)
+*/
+
+enum softirq_vector {
+  TIMER_SOFTIRQ,
+  TASKLET_SOFTIRQ,
+  NR_SOFTIRQS
+};
+
+typedef void (*softirq_action)();
+
+#define TASKLET_STATE_SCHED 0x01
+
+struct tasklet_struct {
+  void (*func)(uint32_t);
+  uint32_t data;
+  volatile uint32_t state;
+  struct list_head sibling;
+};
+
+#define DECLARE_TASKLET(name, _func, _data)    \
+  struct tasklet_struct name = {               \
+    .func = (_func),                           \
+    .data = (_data),                           \
+    .state = 0,                                \
+    .sibling = LIST_HEAD_INIT((name).sibling), \
+  }
+
+void open_softirq(enum softirq_vector nr, softirq_action action);
+void raise_softirq(enum softirq_vector nr);
+bool in_softirq();
+void do_softirq();
+void tasklet_init(struct tasklet_struct *t, void (*func)(uint32_t), uint32_t data);
+void tasklet_schedule(struct tasklet_struct *t);
+void softirq_init();
+
+#endif
@@ -13,6 +13,8 @@
 #include "kernel/cpu/hal.h"
 #include "kernel/ipc/signal.h"
 #include "kernel/fs/poll.h"
+#include "kernel/proc/elf.h"
+#include "kernel/ipc/shm.h"
 
 #define sysapi_log(param) log param
 
@@ -58,6 +60,11 @@
 #define __NR_setsid 66
 #define __NR_sigaction 67
 #define __NR_sigsuspend 72
+#define __NR_getrusage 77
+#define __NR_uselib 86
+#define __NR_mmap 90
+#define __NR_munmap 91
+#define __NR_ftruncate 93
 #define __NR_sigreturn 103
 #define __NR_stat 106
 #define __NR_fstat 108
@@ -70,12 +77,19 @@
 #define __NR_poll 168
 #define __NR_getcwd 183
 #define __NR_waitid 284
+#define __NR_openat 295
 #define __NR_mkdirat 296
 #define __NR_mknodat 297
 #define __NR_unlinkat 301
 // debug
 #define __NR_dbg_ps   512
 #define __NR_dbg_log  511
+#define __NR_dbg_kmalloc 510
+// posix shared memory, not in linux (it uses open on /dev/shm)
+#define __NR_shm_open 513
+#define __NR_shm_unlink 514
+// getdents with attributes of entries, not in linux
+#define __NR_getdents_plus 515
 
 static int32_t sys_pipe(int32_t *fd) {
   sysapi_log(("sys_do_pipe: pid %d", get_current_process()->pid));
@@ -89,6 +103,10 @@ static int32_t sys_dbg_ps() {
   return 0;
 }
 
+static int32_t sys_dbg_kmalloc(int32_t cmd) {
+  return kmalloc_track_report(cmd);
+}
+
 static int32_t sys_dup2(int oldfd, int newfd) {
   sysapi_log(("sys_dup2"));
   
@@ -118,6 +136,11 @@ static int32_t sys_open(const char *path, int32_t flags, mode_t mode) {
   return vfs_open(path, flags, mode);
 }
 
+static int32_t sys_openat(int fd, const char *path, int32_t flags, mode_t mode) {
+  sysapi_log(("sys_openat: %s", path));
+  return vfs_openat(fd, path, flags, mode);
+}
+
 static int32_t sys_fstat(int32_t fd, struct kstat *stat) {
   sysapi_log(("sys_fstat"));
 	return vfs_fstat(fd, stat);
@@ -153,6 +176,57 @@ static void* sys_sbrk(size_t n) {
   return addr;
 }
 
+static int32_t sys_uselib(char *path) {
+  sysapi_log(("sys_uselib: %s", path));
+  virtual_addr base = 0;
+  int32_t ret = elf_map_library(path, &base);
+  return ret < 0 ? ret : (int32_t)base;
+}
+
+static int32_t sys_getrusage(int32_t who, struct rusage *usage) {
+  sysapi_log(("sys_getrusage"));
+  if (who != RUSAGE_SELF)
+    return -EINVAL;
+
+  memset(usage, 0, sizeof(struct rusage));
+  struct mm_rss *rss = &get_current_process()->mm_mos->rss;
+  usage->ru_maxrss = rss->hiwater_rss * PMM_FRAME_SIZE / 1024;
+  usage->ru_ixrss = rss->shared * PMM_FRAME_SIZE / 1024;
+  usage->ru_idrss = rss->heap * PMM_FRAME_SIZE / 1024;
+  usage->ru_isrss = rss->stack * PMM_FRAME_SIZE / 1024;
+  usage->ru_minflt = rss->min_flt;
+  usage->ru_majflt = rss->maj_flt;
+  usage->ru_nswap = rss->swapped;
+  return 0;
+}
+
+static int32_t sys_mmap(struct mmap_arg_struct *args) {
+  sysapi_log(("sys_mmap: len %d, fd %d", args->len, args->fd));
+  return shm_mmap(args);
+}
+
+static int32_t sys_munmap(virtual_addr addr, size_t len) {
+  sysapi_log(("sys_munmap: 0x%x", addr));
+  return shm_munmap(addr, len);
+}
+
+static int32_t sys_ftruncate(int32_t fd, off_t length) {
+  sysapi_log(("sys_ftruncate: fd %d", fd));
+  if (length < 0)
+    return -EINVAL;
+  return shm_ftruncate(fd, length);
+}
+
+static int32_t sys_shm_open(const char *name, int32_t flags, mode_t mode) {
+  sysapi_log(("sys_shm_open: %s", name));
+  return shm_open(name, flags, mode);
+}
+
+static int32_t sys_shm_unlink(const char *name) {
+  sysapi_log(("sys_shm_unlink: %s", name));
+  return shm_unlink(name);
+}
+
 static int32_t sys_getdents(unsigned int fd, struct dirent *dirent, unsigned int count) {
   sysapi_log(("sys_getdents"));
   struct process *current_process = get_current_process();
@@ -167,6 +241,20 @@ static int32_t sys_getdents(unsigned int fd, struct dirent *dirent, unsigned int
   return -ENOTDIR;
 }
 
+static int32_t sys_getdents_plus(unsigned int fd, struct dirent_plus *dirent, unsigned int count) {
+  sysapi_log(("sys_getdents_plus"));
+  struct process *current_process = get_current_process();
+  struct vfs_file *file = current_process->files->fd[fd];
+
+  if (!file)
+    return -EBADF;
+
+  if (file->f_op->readdirplus)
+    return file->f_op->readdirplus(file, dirent, count);
+
+  return -ENOTDIR;
+}
+
 static char CWD_PATH[MAXPATHLEN];
 
 static int32_t sys_getcwd(char *buf, size_t size) {
@@ -335,7 +423,8 @@ static int32_t sys_setsid() {
   if (current_process->pid == current_process->gid)
     return -1;
 
-  current_process->sid = current_process->gid = current_process->pid;
+  process_set_sid(current_process, current_process->pid);
+  process_set_pgid(current_process, current_process->pid);
   current_process->tty = NULL;
   return 0;
 }
@@ -349,17 +438,21 @@ static int32_t sys_fchdir(int fildes) {
   if (!S_ISDIR(filp->f_mode))
     return -ENOTDIR;
   
-  current_process->fs->d_root = filp->f_dentry;
+  dput(current_process->fs->d_root);
+  current_process->fs->d_root = dget(filp->f_dentry);
   current_process->fs->mnt_root = filp->f_vfsmnt;
   return 0;
 }
 
 static int32_t sys_chdir(const char *path) {
-  int ret = vfs_open(path, O_RDONLY);
-  if (ret < 0)
-    return ret;
+  int fd = vfs_open(path, O_RDONLY);
+  if (fd < 0)
+    return fd;
 
-  return sys_fchdir(ret);
+  // working directory keeps its own reference to dentry
+  int32_t ret = sys_fchdir(fd);
+  vfs_close(fd);
+  return ret;
 } 
 
 static int32_t sys_getpgid(pid_t pid) {
@@ -432,36 +525,14 @@ static int32_t sys_unlink(const char *path) {
 }
 
 static int32_t sys_unlinkat(int fd, const char *path, int flag) {
-  assert_not_implemented();
-  /*
   if (flag && flag & ~AT_REMOVEDIR)
     return -EINVAL;
 
-  char *interpreted_path;
-  int ret = interpret_path_from_fd(fd, path, &interpreted_path);
-
-  if (ret >= 0)
-    ret = vfs_unlink(interpreted_path, flag);
-
-  if (interpreted_path != path)
-    kfree(interpreted_path);
-  return ret;
-  */
+  return vfs_unlinkat(fd, path, flag);
 }
 
 static int32_t sys_mknodat(int fd, const char *path, mode_t mode, dev_t dev) {
-  assert_not_implemented();
-  /*
-  char *interpreted_path;
-  int ret = interpret_path_from_fd(fd, path, &interpreted_path);
-
-  if (ret >= 0)
-    ret = vfs_mknod(interpreted_path, mode, dev);
-
-  if (interpreted_path != path)
-    kfree(interpreted_path);
-  return ret;
-  */
+  return vfs_mknodat(fd, path, mode, dev);
 }
 
 static int32_t sys_mknod(const char *path, mode_t mode, dev_t dev) {
@@ -474,18 +545,7 @@ static int32_t sys_mkdir(const char *path, mode_t mode) {
 }
 
 static int32_t sys_mkdirat(int fd, const char *path, mode_t mode) {
-  assert_not_implemented();
-  /*
-  char *interpreted_path;
-  int ret = interpret_path_from_fd(fd, path, &interpreted_path);
-
-  if (ret >= 0)
-    ret = vfs_mkdir(interpreted_path, mode);
-
-  if (interpreted_path != path)
-    kfree(interpreted_path);
-  return ret;
-  */
+  return vfs_mkdirat(fd, path, mode);
 }
 
 static int32_t sys_fcntl(int fd, int cmd, unsigned long arg) {
@@ -498,8 +558,7 @@ static int32_t sys_getgid() {
 
 static int32_t sys_setgid(gid_t gid) {
   struct process *current_process = get_current_process();
-  current_process->gid = gid;
-  return 0;
+  return process_set_pgid(current_process, gid);
 }
 
 static int32_t sys_umask(mode_t cmask) {
@@ -544,6 +603,7 @@ static void *syscalls[] = {
   [__NR_read] = sys_read,
   [__NR_write] = sys_write,
   [__NR_open] = sys_open,
+  [__NR_openat] = sys_openat,
   [__NR_sbrk] = sys_sbrk,
   [__NR_getpgid] = sys_getpgid,
   [__NR_execve] = sys_execve,
@@ -592,7 +652,16 @@ static void *syscalls[] = {
   [__NR_fcntl] = sys_fcntl,
   [__NR_sigaction] = sys_sigaction,
   [__NR_sigprocmask] = sys_sigprocmask,
+  [__NR_getrusage] = sys_getrusage,
+  [__NR_uselib] = sys_uselib,
+  [__NR_mmap] = sys_mmap,
+  [__NR_munmap] = sys_munmap,
+  [__NR_ftruncate] = sys_ftruncate,
+  [__NR_shm_open] = sys_shm_open,
+  [__NR_shm_unlink] = sys_shm_unlink,
+  [__NR_getdents_plus] = sys_getdents_plus,
   [__NR_dbg_log] = sys_dbg_log,
+  [__NR_dbg_kmalloc] = sys_dbg_kmalloc,
   0
 };
 
@@ -1,4 +1,5 @@
 #include "kernel/cpu/hal.h"
+#include "kernel/system/softirq.h"
 #include "kernel/system/time.h"
 #include "kernel/util/debug.h"
 
@@ -14,7 +15,9 @@ static void assert_timer_valid(struct sleep_timer *timer) {
 
 void add_timer(struct sleep_timer *timer) {
   assert_timer_valid(timer);
+  uint32_t flags = irq_save();
   list_add_tail(&timer->sibling, &list_of_timer);
+  irq_restore(flags);
   
   /*
   struct sleep_timer *iter, *node = NULL;
@@ -34,7 +37,9 @@ void add_timer(struct sleep_timer *timer) {
 }
 
 void del_timer(struct sleep_timer *timer) {
+  uint32_t flags = irq_save();
   list_del(&timer->sibling);
+  irq_restore(flags);
 }
 
 void mod_timer(struct sleep_timer *timer, uint64_t expires) {
@@ -47,23 +52,44 @@ bool is_actived_timer(struct sleep_timer *timer) {
   return timer->sibling.prev != LIST_POISON1 && timer->sibling.next != LIST_POISON2;
 }
 
-static int32_t timer_schedule_handler(interrupt_registers *regs) {
-  
-  struct sleep_timer *iter, *next;
+static struct sleep_timer *pop_expired_timer(uint64_t cms) {
+  struct sleep_timer *iter;
+  list_for_each_entry(iter, &list_of_timer, sibling) {
+    assert_timer_valid(iter);
+
+    if (iter->expires <= cms) {
+      list_del(&iter->sibling);
+      return iter;
+    }
+  }
+  return NULL;
+}
+
+// runs in softirq context, interrupts are enabled, so callbacks are free to wake threads up
+static void run_timers() {
+  struct sleep_timer *timer;
 	uint64_t cms = get_seconds(NULL) * 1000;
-  
-  // should be safe because callback most probably will remove timer from the list
-  list_for_each_entry_safe(iter, next, &list_of_timer, sibling) {
-		assert_timer_valid(iter);
-    
-		if (iter->expires <= cms)
-			iter->callback(iter);
-	}
 
+  while (true) {
+    disable_interrupts();
+    timer = pop_expired_timer(cms);
+    enable_interrupts();
+
+    if (!timer)
+      break;
+
+    // timer is already removed from the list, list_del in callback is noop
+    timer->callback(timer);
+  }
+}
+
+static int32_t timer_schedule_handler(interrupt_registers *regs) {
+  raise_softirq(TIMER_SOFTIRQ);
 	return IRQ_HANDLER_CONTINUE;
 }
 
 void timer_init() {
   INIT_LIST_HEAD(&list_of_timer);
+  open_softirq(TIMER_SOFTIRQ, run_timers);
   register_interrupt_handler(IRQ8, timer_schedule_handler);
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "kernel/cpu/hal.h"
+#include "kernel/proc/task.h"
+#include "kernel/util/debug.h"
+
+#include "kernel/system/workqueue.h"
+
+static struct list_head work_list;
+static struct wait_queue_head worker_wait;
+
+bool queue_work(struct work_struct *work) {
+  uint32_t flags = irq_save();
+
+  if (work->pending) {
+    irq_restore(flags);
+    return false;
+  }
+
+  work->pending = true;
+  list_add_tail(&work->sibling, &work_list);
+  irq_restore(flags);
+
+  wake_up(&worker_wait);
+  return true;
+}
+
+static struct work_struct *pop_work() {
+  struct work_struct *work = NULL;
+  uint32_t flags = irq_save();
+
+  if (!list_empty(&work_list)) {
+    work = list_first_entry(&work_list, struct work_struct, sibling);
+    list_del(&work->sibling);
+    work->pending = false;
+  }
+
+  irq_restore(flags);
+  return work;
+}
+
+static void worker_thread() {
+  struct thread *th = get_current_thread();
+
+  DEFINE_WAIT(wait);
+  list_add_tail(&wait.sibling, &worker_wait.list);
+
+  while (true) {
+    // waiting before the list is checked, so a wake up from queue_work isn't lost
+    thread_wait(th);
+
+    struct work_struct *work = pop_work();
+    if (!work) {
+      schedule();
+      continue;
+    }
+
+    thread_wake(th);
+    work->func(work);
+  }
+}
+
+void workqueue_init() {
+  INIT_LIST_HEAD(&work_list);
+  INIT_LIST_HEAD(&worker_wait.list);
+
+  struct process *proc = create_system_process((virtual_addr)worker_thread, "kworker");
+  for (int i = 1; i < WORKQUEUE_WORKERS; ++i) {
+    struct thread *th = kernel_thread_create(proc, (virtual_addr)worker_thread);
+    sched_push_queue(th);
+  }
+
+  log("Workqueue: %d workers are started", WORKQUEUE_WORKERS);
+}
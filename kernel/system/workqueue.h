@@ -0,0 +1,33 @@
+#ifndef KERNEL_SYSTEM_WORKQUEUE_H
+#define KERNEL_SYSTEM_WORKQUEUE_H
+
+#include <stdbool.h>
+
+#include "kernel/include/list.h"
+
+#define WORKQUEUE_WORKERS 2
+
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *);
+
+struct work_struct {
+  work_func_t func;
+  volatile bool pending;
+  struct list_head sibling;
+};
+
+#define INIT_WORK(_work, _func)        \
+  ({                                   \
+    (_work)->func = (_func);           \
+    (_work)->pending = false;          \
+    INIT_LIST_HEAD(&(_work)->sibling); \
+  })
+
+#define from_work(var, callback_work, work_fieldname) \
+  container_of(callback_work, typeof(*var), work_fieldname)
+
+// work items run in a kernel worker thread, so unlike softirqs and tasklets they can sleep
+bool queue_work(struct work_struct *work);
+void workqueue_init();
+
+#endif
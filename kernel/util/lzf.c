@@ -0,0 +1,144 @@
+#include <stddef.h>
+
+#include "kernel/util/string/string.h"
+
+#include "kernel/util/lzf.h"
+
+#define LZF_HLOG 12
+#define LZF_HSIZE (1 << LZF_HLOG)
+#define LZF_MAX_LIT (1 << 5)
+#define LZF_MAX_OFF (1 << 13)
+#define LZF_MAX_REF ((1 << 8) + (1 << 3))
+
+#define lzf_hash(p) ((((p)[0] << 16 | (p)[1] << 8 | (p)[2]) * 2654435761u) >> (32 - LZF_HLOG))
+
+// too big for kernel stack, callers serialize compression
+static const uint8_t *lzf_htab[LZF_HSIZE];
+
+uint32_t lzf_compress(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t out_len) {
+  const uint8_t *ip = in;
+  const uint8_t *in_end = in + in_len;
+  uint8_t *op = out;
+  uint8_t *out_end = out + out_len;
+  int32_t lit = 0;
+
+  if (!in_len || !out_len)
+    return 0;
+
+  memset(lzf_htab, 0, sizeof(lzf_htab));
+  // reserve control byte of the first literal run
+  op++;
+
+  while (ip + 2 < in_end) {
+    uint32_t slot = lzf_hash(ip);
+    const uint8_t *ref = lzf_htab[slot];
+    lzf_htab[slot] = ip;
+
+    uint32_t off;
+    if (ref && (off = ip - ref - 1) < LZF_MAX_OFF &&
+        ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+      uint32_t len = 2;
+      uint32_t maxlen = in_end - ip - len;
+      maxlen = maxlen > LZF_MAX_REF ? LZF_MAX_REF : maxlen;
+
+      // back reference takes up to 3 bytes and the next literal run needs a control byte
+      if (op - !lit + 3 + 1 >= out_end)
+        return 0;
+
+      // close literal run, drop it if it's empty
+      op[-lit - 1] = lit - 1;
+      op -= !lit;
+
+      do
+        len++;
+      while (len < maxlen && ref[len] == ip[len]);
+
+      len -= 2;
+      ip++;
+
+      if (len < 7) {
+        *op++ = (off >> 8) + (len << 5);
+      } else {
+        *op++ = (off >> 8) + (7 << 5);
+        *op++ = len - 7;
+      }
+      *op++ = off;
+
+      lit = 0;
+      op++;
+      ip += len + 1;
+      continue;
+    }
+
+    if (op >= out_end)
+      return 0;
+
+    lit++;
+    *op++ = *ip++;
+    if (lit == LZF_MAX_LIT) {
+      op[-lit - 1] = lit - 1;
+      lit = 0;
+      op++;
+    }
+  }
+
+  while (ip < in_end) {
+    if (op >= out_end)
+      return 0;
+
+    lit++;
+    *op++ = *ip++;
+    if (lit == LZF_MAX_LIT) {
+      op[-lit - 1] = lit - 1;
+      lit = 0;
+      op++;
+    }
+  }
+
+  op[-lit - 1] = lit - 1;
+  op -= !lit;
+
+  return op - out;
+}
+
+uint32_t lzf_decompress(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t out_len) {
+  const uint8_t *ip = in;
+  const uint8_t *in_end = in + in_len;
+  uint8_t *op = out;
+  uint8_t *out_end = out + out_len;
+
+  while (ip < in_end) {
+    uint32_t ctrl = *ip++;
+
+    if (ctrl < LZF_MAX_LIT) {
+      ctrl++;
+      if (op + ctrl > out_end || ip + ctrl > in_end)
+        return 0;
+
+      memcpy(op, ip, ctrl);
+      op += ctrl;
+      ip += ctrl;
+    } else {
+      uint32_t len = ctrl >> 5;
+      if (len == 7) {
+        if (ip >= in_end)
+          return 0;
+        len += *ip++;
+      }
+
+      if (ip >= in_end)
+        return 0;
+
+      const uint8_t *ref = op - ((ctrl & 0x1f) << 8) - 1 - *ip++;
+      len += 2;
+      if (op + len > out_end || ref < out)
+        return 0;
+
+      // source and destination can overlap
+      while (len--)
+        *op++ = *ref++;
+    }
+  }
+
+  return op - out;
+}
@@ -0,0 +1,18 @@
+#ifndef UTIL_LZF_H
+#define UTIL_LZF_H
+
+#include <stdint.h>
+
+/*
+  LZF (LZ77 family) format, compatible with liblzf
+  000LLLLL <L+1 literal bytes>
+  LLLooooo oooooooo           back reference of L+2 bytes at offset o+1
+  111ooooo LLLLLLLL oooooooo  back reference of L+9 bytes at offset o+1
+*/
+
+// returns size of compressed data or 0 if it doesn't fit into out_len
+uint32_t lzf_compress(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t out_len);
+// returns size of decompressed data or 0 if input is corrupted or doesn't fit into out_len
+uint32_t lzf_decompress(const uint8_t *in, uint32_t in_len, uint8_t *out, uint32_t out_len);
+
+#endif
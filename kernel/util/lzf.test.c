@@ -0,0 +1,49 @@
+#include <test/greatest.h>
+
+#include "kernel/util/lzf.h"
+
+static uint8_t in[4096], out[4096], back[4096];
+
+TEST TEST_LZF_ZERO_PAGE(void) {
+  memset(in, 0, sizeof(in));
+  uint32_t size = lzf_compress(in, sizeof(in), out, sizeof(out) - 1);
+  ASSERT(size > 0 && size < 128);
+  ASSERT_EQ(lzf_decompress(out, size, back, sizeof(back)), sizeof(in));
+  ASSERT_EQ(memcmp(in, back, sizeof(in)), 0);
+
+  PASS();
+}
+
+TEST TEST_LZF_TEXT(void) {
+  const char *text = "the quick brown fox jumps over the lazy dog, ";
+  uint32_t length = strlen(text);
+  for (uint32_t i = 0; i < sizeof(in); ++i)
+    in[i] = text[i % length];
+
+  uint32_t size = lzf_compress(in, sizeof(in), out, sizeof(out) - 1);
+  ASSERT(size > 0 && size < sizeof(in) / 4);
+  ASSERT_EQ(lzf_decompress(out, size, back, sizeof(back)), sizeof(in));
+  ASSERT_EQ(memcmp(in, back, sizeof(in)), 0);
+
+  PASS();
+}
+
+TEST TEST_LZF_INCOMPRESSIBLE(void) {
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < sizeof(in); ++i) {
+    seed = seed * 1103515245 + 12345;
+    in[i] = seed >> 16;
+  }
+
+  ASSERT_EQ(lzf_compress(in, sizeof(in), out, sizeof(out) - 1), 0);
+  // corrupted input is rejected
+  ASSERT_EQ(lzf_decompress((const uint8_t *)"\x20\x05", 2, back, sizeof(back)), 0);
+
+  PASS();
+}
+
+SUITE(SUITE_LZF) {
+  RUN_TEST(TEST_LZF_ZERO_PAGE);
+  RUN_TEST(TEST_LZF_TEXT);
+  RUN_TEST(TEST_LZF_INCOMPRESSIBLE);
+}
@@ -16,6 +16,9 @@ then
 elif [ "$1" = "build_libc" ]
 then
   $ENVIRONMENT sh /src/libc.sh build && $ENVIRONMENT sh /src/libc.sh install
+elif [ "$1" = "build_libc_shared" ]
+then
+  $ENVIRONMENT sh /src/libc.sh shared
 elif [ "$1" = "rebuild_libc" ]
 then
   $ENVIRONMENT sh /src/libc.sh rebuild && $ENVIRONMENT sh /src/libc.sh install
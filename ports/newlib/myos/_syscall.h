@@ -43,6 +43,11 @@ extern char **environ; /* pointer to array of char * strings that define the cur
 #define __NR_setsid 66
 #define __NR_sigaction 67
 #define __NR_sigsuspend 72
+#define __NR_getrusage 77
+#define __NR_uselib 86
+#define __NR_mmap 90
+#define __NR_munmap 91
+#define __NR_ftruncate 93
 #define __NR_sigreturn 103
 #define __NR_stat 106
 #define __NR_fstat 108
@@ -55,12 +60,19 @@ extern char **environ; /* pointer to array of char * strings that define the cur
 #define __NR_poll 168
 #define __NR_getcwd 183
 #define __NR_waitid 284
+#define __NR_openat 295
 #define __NR_mkdirat 296
 #define __NR_mknodat 297
 #define __NR_unlinkat 301
 // debug
+#define __NR_dbg_kmalloc 510
 #define __NR_dbg_log  511
 #define __NR_dbg_ps 512
+// posix shared memory
+#define __NR_shm_open 513
+#define __NR_shm_unlink 514
+// getdents with attributes of entries
+#define __NR_getdents_plus 515
 
 #define _syscall0(name)                       \
   static inline int32_t syscall_##name() {    \
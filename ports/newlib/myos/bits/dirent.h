@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 #define MAX_FILENAME_LENGTH 256
 
@@ -15,6 +16,12 @@ struct dirent {
   char d_name[MAX_FILENAME_LENGTH];         /* Null-terminated filename */
 };
 
+// entry followed by its attributes, d_ent.d_reclen is the length of the whole record
+struct dirent_plus {
+  struct stat d_stat;
+  struct dirent d_ent;
+};
+
 struct __DIR {
   int fd;
   bool owned_fd;
@@ -35,5 +42,6 @@ int readdir_r(DIR *dirp, struct dirent *entry, struct dirent **result);
 void rewinddir(DIR *dirp);
 void seekdir(DIR *dirp, long int loc);
 long int telldir(DIR *dirp);
+int getdents_plus(unsigned int fd, struct dirent_plus *dirent, unsigned int count);
 
 #endif
\ No newline at end of file
@@ -66,7 +66,7 @@ struct dirent *readdir(DIR *dirp) {
     dirp->size = getdents(dirp->fd, (struct dirent *)dirp->buf, dirp->len);
     dirp->pos = 0;
   }
-  if (!dirp->size)
+  if (dirp->size <= 0)
     return NULL;
 
   struct dirent *entry = (struct dirent *)((char *)dirp->buf + dirp->pos);
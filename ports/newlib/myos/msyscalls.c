@@ -5,4 +5,9 @@
 _syscall0(dbg_ps);
 int dbg_ps() {
   SYSCALL_RETURN(syscall_dbg_ps());
+}
+
+_syscall1(dbg_kmalloc, int);
+int dbg_kmalloc(int cmd) {
+  SYSCALL_RETURN(syscall_dbg_kmalloc(cmd));
 }
\ No newline at end of file
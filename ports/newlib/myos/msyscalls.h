@@ -10,4 +10,10 @@
 int dbg_ps();
 int dbg_log(char* fmt, ...);
 
+// kernel heap usage per allocation site, printed by the kernel
+#define DBG_KMALLOC_REPORT 0
+#define DBG_KMALLOC_SNAPSHOT 1
+#define DBG_KMALLOC_DIFF 2
+int dbg_kmalloc(int cmd);
+
 #endif
\ No newline at end of file
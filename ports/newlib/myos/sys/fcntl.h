@@ -72,5 +72,6 @@
 #define SEEK_END 2 /* Seek from end of file.  */
 
 int open(const char* path, int oflag, ...);
+int openat(int fd, const char* path, int oflag, ...);
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef MMAN_H
+#define MMAN_H
+
+#include <sys/types.h>
+
+#define PROT_NONE 0x0  /* page can not be accessed */
+#define PROT_READ 0x1  /* page can be read */
+#define PROT_WRITE 0x2 /* page can be written */
+#define PROT_EXEC 0x4  /* page can be executed */
+
+#define MAP_SHARED 0x01    /* Share changes */
+#define MAP_PRIVATE 0x02   /* Changes are private, not supported */
+#define MAP_FIXED 0x10     /* Interpret addr exactly, not supported */
+#define MAP_ANONYMOUS 0x20 /* don't use a file */
+#define MAP_ANON MAP_ANONYMOUS
+
+#define MAP_FAILED ((void *)-1)
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t length);
+int shm_open(const char *name, int oflag, mode_t mode);
+int shm_unlink(const char *name);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RESOURCE_H
+#define RESOURCE_H
+
+#include <sys/time.h>
+
+#define RUSAGE_SELF 0      /* calling process */
+#define RUSAGE_CHILDREN -1 /* terminated child processes, not supported */
+
+/* same layout as linux, sizes are in kilobytes */
+struct rusage {
+  struct timeval ru_utime; /* user time used, not tracked */
+  struct timeval ru_stime; /* system time used, not tracked */
+  long ru_maxrss;          /* peak resident set size */
+  long ru_ixrss;           /* shared memory size */
+  long ru_idrss;           /* heap size */
+  long ru_isrss;           /* stack size */
+  long ru_minflt;          /* page faults served without i/o */
+  long ru_majflt;          /* page faults served from swap */
+  long ru_nswap;           /* pages in swap */
+  long ru_inblock;
+  long ru_oublock;
+  long ru_msgsnd;
+  long ru_msgrcv;
+  long ru_nsignals;
+  long ru_nvcsw;
+  long ru_nivcsw;
+};
+
+int getrusage(int who, struct rusage *usage);
+
+#endif
@@ -12,6 +12,8 @@
 #include <sys/times.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include "_syscall.h"
 
@@ -123,6 +125,11 @@ int getdents(unsigned int fd, struct dirent *dirent, unsigned int count) {
 	SYSCALL_RETURN_ORIGINAL(syscall_getdents(fd, dirent, count));
 }
 
+_syscall3(getdents_plus, unsigned int, struct dirent_plus *, unsigned int);
+int getdents_plus(unsigned int fd, struct dirent_plus *dirent, unsigned int count) {
+	SYSCALL_RETURN_ORIGINAL(syscall_getdents_plus(fd, dirent, count));
+}
+
 
 _syscall2(getcwd, char *, size_t);
 char *getcwd(char *buf, size_t size) {
@@ -218,6 +225,20 @@ int open(const char *name, int flags, ...) {
   SYSCALL_RETURN_ORIGINAL(syscall_open(name, flags, mode));
 }
 
+_syscall4(openat, int, const char *, int32_t, mode_t);
+int openat(int fd, const char *name, int flags, ...) {
+  mode_t mode = 0;
+
+  if (flags & O_CREAT) {
+    va_list ap;
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+
+  SYSCALL_RETURN_ORIGINAL(syscall_openat(fd, name, flags, mode));
+}
+
 _syscall0(getppid);
 int getppid() {
   SYSCALL_RETURN_ORIGINAL(syscall_getppid());
@@ -350,6 +371,58 @@ int mknodat(int fd, const char *path, mode_t mode, dev_t dev) {
 	SYSCALL_RETURN_ORIGINAL(syscall_mknodat(fd, path, mode, dev));
 }
 
+struct mmap_arg_struct {
+  unsigned long addr;
+  unsigned long len;
+  unsigned long prot;
+  unsigned long flags;
+  int fd;
+  unsigned long offset;
+};
+
+_syscall1(mmap, struct mmap_arg_struct *);
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+  struct mmap_arg_struct args = {
+    .addr = (unsigned long)addr,
+    .len = length,
+    .prot = prot,
+    .flags = flags,
+    .fd = fd,
+    .offset = offset,
+  };
+  int ret = syscall_mmap(&args);
+  if (ret < 0 && ret >= -1024) {
+    errno = -ret;
+    return MAP_FAILED;
+  }
+  return (void *)ret;
+}
+
+_syscall2(munmap, void *, size_t);
+int munmap(void *addr, size_t length) {
+  SYSCALL_RETURN(syscall_munmap(addr, length));
+}
+
+_syscall2(ftruncate, int, off_t);
+int ftruncate(int fd, off_t length) {
+  SYSCALL_RETURN(syscall_ftruncate(fd, length));
+}
+
+_syscall3(shm_open, const char *, int, mode_t);
+int shm_open(const char *name, int oflag, mode_t mode) {
+  SYSCALL_RETURN_ORIGINAL(syscall_shm_open(name, oflag, mode));
+}
+
+_syscall1(shm_unlink, const char *);
+int shm_unlink(const char *name) {
+  SYSCALL_RETURN(syscall_shm_unlink(name));
+}
+
+_syscall2(getrusage, int, struct rusage *);
+int getrusage(int who, struct rusage *usage) {
+  SYSCALL_RETURN(syscall_getrusage(who, usage));
+}
+
 int usleep(useconds_t usec) {
   struct timespec req = {.tv_sec = usec / 1000, .tv_nsec = usec * 1000};
   return nanosleep(&req, NULL);
@@ -1,6 +1,7 @@
 # clean
 # rebuild
 # build
+# shared
 
 BUILD_DIR=$BUILD/newlib-$NEWLIB_VERSION
 
@@ -16,6 +17,13 @@ elif [ "$1" = "rebuild" ]
 then
   rm -rf $BUILD_DIR && \
   sh ./configure_libc.sh && ./build_libc.sh
+elif [ "$1" = "shared" ]
+then
+  # newlib objects are position independent (configure_libc.sh), libc.a is linked as it is,
+  # libc.so goes next to ld.so (kernel/apps/ld) which searches only /lib
+  mkdir -p $SYSROOT/lib && \
+  $TARGET-gcc -shared -nostdlib -o $SYSROOT/lib/libc.so \
+    -Wl,--whole-archive $SYSROOT/usr/lib/libc.a -Wl,--no-whole-archive -lgcc
 elif [ "$1" = "install" ] 
 then
   rm -rf $SYSROOT/usr/include/* && rm -rf $SYSROOT/usr/lib/* && \
@@ -23,5 +31,5 @@ then
   rm -rf $SYSROOT/usr/$TARGET && \
   cp -r $BUILD_DIR/$TARGET/newlib/libc/sys/$OS_NAME/crt0.o $SYSROOT/usr/lib/
 else 
-  echo "Unknown param, use: clean, build, rebuild"
+  echo "Unknown param, use: clean, build, rebuild, shared"
 fi
@@ -16,6 +16,12 @@
 #undef ENDFILE_SPEC
 #define ENDFILE_SPEC "crtend.o%s crtn.o%s"
 
+/* Programs which are linked against shared objects are started by the dynamic loader
+  (kernel/apps/ld), libraries are searched in /lib. Until libc.so is installed there
+  ('libc.sh shared') only libc.a is found and programs are still linked statically. */
+#undef LINK_SPEC
+#define LINK_SPEC "%{shared:-shared} %{static:-static} %{!shared:%{!static:-dynamic-linker /lib/ld.so}} --hash-style=sysv"
+
 /* Additional predefined macros. */
 #undef TARGET_OS_CPP_BUILTINS
 #define TARGET_OS_CPP_BUILTINS()      \